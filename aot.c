@@ -0,0 +1,76 @@
+/**************************************************************
+ *
+ *                     aot.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the runtime entry points used by the C
+ *     that um2c generates
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "aot.h"
+#include "lilum.h"
+#include "instructions.h"
+
+/*
+    aot_load
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: the compiled image's segment 0, host order
+        size_t count: number of words
+    Returns:
+        a fresh machine whose segment 0 holds words, reading stdin and 
+        writing stdout
+    Effects:
+        Flushes output at newlines when stdout is a terminal, as um does
+    ***************************************************************************
+*/
+Memory aot_load(const uint32_t *words, size_t count)
+{
+        flush_at_newline = isatty(STDOUT_FILENO);
+        Memory mem = create_segment0(count);
+        append_segment0_words(mem, words, count);
+        return mem;
+}
+
+/*
+    aot_fallback
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct of the running compiled program
+        const uint32_t *registers: the compiled code's registers
+        uint32_t counter: address of the next instruction to run
+    Returns:
+        does not return
+    Effects:
+        Hands the machine to the interpreter: copies the registers into
+        mem, sets the program counter to counter and runs execute until the
+        program halts or runs off the end of segment 0, then exits through
+        halt. A map the interpreter cannot make is reported and exits with
+        failure. Compiled code calls this once segment 0 stops being the
+        image it was compiled from, when it jumps outside of it, or when
+        one of its maps is refused.
+    Expects: 
+        mem and registers are not NULL
+    ***************************************************************************
+*/
+void aot_fallback(Memory mem, const uint32_t *registers, uint32_t counter)
+{
+        assert(mem != NULL && registers != NULL);
+        memcpy(machine_registers(mem), registers, 8 * sizeof(uint32_t));
+        set_program_counter(mem, counter);
+        if (execute(mem) == STOP_MAP_FAILED) {
+                report_map_failure(mem, stderr);
+                free_segments(mem);
+                exit(EXIT_FAILURE);
+        }
+        halt(mem);
+}
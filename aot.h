@@ -0,0 +1,63 @@
+/**************************************************************
+ *
+ *                     aot.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     aot.h holds the runtime that programs translated to C by
+ *     um2c are linked against (with libum.a). Segments, map,
+ *     unmap and I/O come from the memory module; aot.c adds
+ *     the entry point and the way back into the interpreter.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include "memory.h"
+
+#ifndef AOT_H
+#define AOT_H
+
+/*
+    aot_load
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: the compiled image's segment 0, host order
+        size_t count: number of words
+    Returns:
+        a fresh machine whose segment 0 holds words, reading stdin and 
+        writing stdout
+    Effects:
+        Flushes output at newlines when stdout is a terminal, as um does
+    ***************************************************************************
+*/
+Memory aot_load(const uint32_t *words, size_t count);
+
+/*
+    aot_fallback
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct of the running compiled program
+        const uint32_t *registers: the compiled code's registers
+        uint32_t counter: address of the next instruction to run
+    Returns:
+        does not return
+    Effects:
+        Hands the machine to the interpreter: copies the registers into
+        mem, sets the program counter to counter and runs execute until the
+        set_program_counter(mem, counter);
+        if (execute(mem) == STOP_MAP_FAILED) {
+                report_map_failure(mem, stderr);
+                free_segments(mem);
+                exit(EXIT_FAILURE);
+        }
+        halt(mem);
+    Expects: 
+        mem and registers are not NULL
+    ***************************************************************************
+*/
+void aot_fallback(Memory mem, const uint32_t *registers, uint32_t counter)
+        __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,490 @@
+/**************************************************************
+ *
+ *                     batch.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the batch runner. Every job gets its
+ *     own Memory, so jobs share nothing but the loaded images
+ *     and run side by side on a pool of worker threads that
+ *     balance the load by stealing from each other's deques.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "batch.h"
+#include "lilum.h"
+#include "memory.h"
+#include "engine.h"
+#include "placement.h"
+#include "capture.h"
+
+/* An image named by the manifest, read once and shared by its jobs */
+typedef struct Image {
+        char *path;
+        char *bytes;
+        size_t size;
+} Image;
+
+typedef struct Job {
+        size_t line;            /* manifest line, for messages */
+        Image *image;
+        char *input_path;       /* NULL for no input */
+        char *output_path;      /* NULL for stdout */
+
+        /* Filled in by the worker that runs the job */
+        Capture capture;
+        double seconds;
+        int error;              /* errno from reading the input, or 0 */
+        bool map_failed;        /* stopped by a map over the quota */
+        Memory_stats memory;    /* the machine's counters when it stopped */
+} Job;
+
+/* A worker's jobs: the owner takes from the back, thieves from the front */
+typedef struct Deque {
+        pthread_mutex_t lock;
+        size_t *jobs;
+        size_t front, back;
+} Deque;
+
+typedef struct Worker {
+        pthread_t thread;
+        unsigned id;
+        unsigned count;         /* number of workers */
+        uint64_t quota;         /* per-job memory quota, 0 for none */
+        Deque *deques;
+        Job *jobs;
+        size_t stolen;
+} Worker;
+
+/*
+    now_seconds
+    ***************************************************************************
+    Returns:
+        the CLOCK_MONOTONIC time in seconds
+    ***************************************************************************
+*/
+static double now_seconds(void)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+    read_file
+    ***************************************************************************
+    Input:
+        const char *path: file to read
+        size_t *size: set to the number of bytes read
+    Returns:
+        malloc'd contents of the file, or NULL with errno set if it could
+        not be read
+    ***************************************************************************
+*/
+static char *read_file(const char *path, size_t *size)
+{
+        FILE *fp = fopen(path, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+        char *bytes = read_stream(fp, size);
+        int saved = errno;
+        fclose(fp);
+        errno = saved;
+        return bytes;
+}
+
+/*
+    find_image
+    ***************************************************************************
+    Input:
+        Image ***images: images read so far, grown as needed
+        size_t *count: number of entries in *images
+        const char *path: image the manifest names
+    Returns:
+        the entry for path, reading the file the first time it is named
+    Effects:
+        Exits with an error if the image cannot be read
+    ***************************************************************************
+*/
+static Image *find_image(Image ***images, size_t *count, const char *path)
+{
+        for (size_t i = 0; i < *count; i++) {
+                if (strcmp((*images)[i]->path, path) == 0) {
+                        return (*images)[i];
+                }
+        }
+        Image *image = malloc(sizeof(*image));
+        assert(image != NULL);
+        image->path = strdup(path);
+        image->bytes = read_file(path, &image->size);
+        if (image->bytes == NULL) {
+                fprintf(stderr, "um batch: %s: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+        *images = realloc(*images, (*count + 1) * sizeof(**images));
+        assert(*images != NULL);
+        (*images)[(*count)++] = image;
+        return image;
+}
+
+/*
+    read_manifest
+    ***************************************************************************
+    Input:
+        const char *path: manifest to read
+        size_t *count: set to the number of jobs
+        Image ***images: set to the images the jobs use
+        size_t *image_count: set to the number of images
+    Returns:
+        malloc'd array of the manifest's jobs, in order
+    Effects:
+        Exits with an error if the manifest cannot be read or a line has
+        more than three fields
+    ***************************************************************************
+*/
+static Job *read_manifest(const char *path, size_t *count, Image ***images,
+                          size_t *image_count)
+{
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "um batch: %s: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+        }
+        Job *jobs = NULL;
+        size_t capacity = 0;
+        *count = 0;
+        *images = NULL;
+        *image_count = 0;
+
+        char *line = NULL;
+        size_t line_capacity = 0;
+        for (size_t number = 1; getline(&line, &line_capacity, fp) != -1;
+             number++) {
+                char *save;
+                char *fields[4] = { NULL, NULL, NULL, NULL };
+                fields[0] = strtok_r(line, " \t\r\n", &save);
+                if (fields[0] == NULL || fields[0][0] == '#') {
+                        continue;
+                }
+                for (int i = 1; i < 4 && fields[i - 1] != NULL; i++) {
+                        fields[i] = strtok_r(NULL, " \t\r\n", &save);
+                }
+                if (fields[3] != NULL) {
+                        fprintf(stderr, "um batch: %s:%zu: expected IMAGE "
+                                        "[INPUT|- [OUTPUT]]\n", path, number);
+                        exit(EXIT_FAILURE);
+                }
+                if (*count == capacity) {
+                        capacity = capacity ? 2 * capacity : 64;
+                        jobs = realloc(jobs, capacity * sizeof(*jobs));
+                        assert(jobs != NULL);
+                }
+                Job *job = &jobs[(*count)++];
+                memset(job, 0, sizeof(*job));
+                job->line = number;
+                job->image = find_image(images, image_count, fields[0]);
+                if (fields[1] != NULL && strcmp(fields[1], "-") != 0) {
+                        job->input_path = strdup(fields[1]);
+                }
+                if (fields[2] != NULL) {
+                        job->output_path = strdup(fields[2]);
+                }
+        }
+        free(line);
+        fclose(fp);
+        return jobs;
+}
+
+/*
+    run_job
+    ***************************************************************************
+    Input:
+        Job *job: job to run
+        uint64_t quota: words the job's segments may hold, 0 for no limit
+    Effects:
+        Reads the job's input, runs its image on a fresh machine until it
+        halts, runs off the end of segment0 or makes a map over the quota,
+        and records its wall time and memory counters. A job whose input
+        cannot be read is not run and keeps the errno.
+    ***************************************************************************
+*/
+static void run_job(Job *job, uint64_t quota)
+{
+        double start = now_seconds();
+        char *input = NULL;
+        size_t length = 0;
+        if (job->input_path != NULL) {
+                input = read_file(job->input_path, &length);
+                if (input == NULL) {
+                        job->error = errno;
+                        job->seconds = now_seconds() - start;
+                        return;
+                }
+        }
+
+        Memory mem = create_segment0(job->image->size / sizeof(uint32_t));
+        capture_attach(mem, &job->capture, input, length);
+        load_instructions_buffer(job->image->bytes, job->image->size, mem);
+        set_memory_quota(mem, quota);
+        job->map_failed = execute(mem) == STOP_MAP_FAILED;
+        memory_stats(mem, &job->memory);
+        if (huge_pages) {
+                placement_sample();
+        }
+        free_segments(mem);
+
+        free(input);
+        job->capture.input = NULL;
+        job->seconds = now_seconds() - start;
+}
+
+/*
+    take_job
+    ***************************************************************************
+    Input:
+        Deque *deque: deque to take from
+        bool steal: take from the front (stealing) rather than the back
+        size_t *job: set to the job taken
+    Returns:
+        true if the deque had a job
+    ***************************************************************************
+*/
+static bool take_job(Deque *deque, bool steal, size_t *job)
+{
+        pthread_mutex_lock(&deque->lock);
+        bool found = deque->front < deque->back;
+        if (found) {
+                *job = steal ? deque->jobs[deque->front++]
+                             : deque->jobs[--deque->back];
+        }
+        pthread_mutex_unlock(&deque->lock);
+        return found;
+}
+
+/*
+    worker_main
+    ***************************************************************************
+    Input:
+        void *arg: the Worker
+    Returns:
+        NULL
+    Effects:
+        Runs jobs from the worker's own deque, then steals from the other
+        workers, starting with its neighbour, until every deque is empty.
+        The engine's per-thread state is set up first and released last,
+        and with --numa the thread is bound to its NUMA node first.
+        Jobs never create jobs, so a worker that finds every deque empty is
+        done.
+    ***************************************************************************
+*/
+static void *worker_main(void *arg)
+{
+        Worker *worker = arg;
+        size_t job;
+        if (!placement_bind_thread()) {
+                fprintf(stderr, "um batch: worker %u: cannot bind to a NUMA "
+                                "node\n", worker->id);
+        }
+        engine->init();
+        for (;;) {
+                if (take_job(&worker->deques[worker->id], false, &job)) {
+                        run_job(&worker->jobs[job], worker->quota);
+                        continue;
+                }
+                bool found = false;
+                for (unsigned i = 1; i < worker->count && !found; i++) {
+                        unsigned victim = (worker->id + i) % worker->count;
+                        found = take_job(&worker->deques[victim], true, &job);
+                }
+                if (!found) {
+                        engine->teardown();
+                        return NULL;
+                }
+                run_job(&worker->jobs[job], worker->quota);
+                worker->stolen++;
+        }
+}
+
+/*
+    write_output
+    ***************************************************************************
+    Input:
+        Job *job: finished job
+    Returns:
+        true if the output was written
+    Effects:
+        writes the job's captured output to its output file or to stdout
+    ***************************************************************************
+*/
+static bool write_output(Job *job)
+{
+        FILE *fp = stdout;
+        if (job->output_path != NULL) {
+                fp = fopen(job->output_path, "wb");
+                if (fp == NULL) {
+                        return false;
+                }
+        }
+        Capture *capture = &job->capture;
+        bool ok = fwrite(capture->output, 1, capture->output_length, fp) ==
+                  capture->output_length;
+        if (fp == stdout) {
+                return fflush(fp) == 0 && ok;
+        }
+        return fclose(fp) == 0 && ok;
+}
+
+/*
+    run_batch
+    ***************************************************************************
+    Input:
+        const char *manifest_path: job manifest. Each line names an image
+                                   and, optionally, an input file and an
+                                   output file: IMAGE [INPUT|- [OUTPUT]].
+                                   Blank lines and lines starting with '#'
+                                   are skipped.
+        unsigned threads: number of worker threads, 0 for one per core
+        uint64_t quota: words each job's segments may hold, 0 for no limit
+        bool stats: whether to print each job's memory counters
+    Returns:
+        EXIT_SUCCESS if every job ran, EXIT_FAILURE otherwise
+    Effects:
+        Loads every distinct image once, then runs the jobs on the worker
+        threads. Jobs are dealt out round robin to per-thread deques; a
+        worker takes jobs from the back of its own deque and, once that is
+        empty, steals from the front of the others. A job's input is read
+        from its INPUT file (none for "-") and its output is captured in
+        memory; once all jobs are done each output is written to its
+        OUTPUT file, or to stdout in manifest order if it has none. Prints
+        each job's wall time (and with stats its live segments, peak words
+        and maps) and the overall jobs per second to stderr. A job stopped
+        by a map over the quota keeps the output it printed but fails.
+        Exits with an error if the manifest or an image cannot be read.
+    Expects:
+        manifest_path is not NULL
+    ***************************************************************************
+*/
+int run_batch(const char *manifest_path, unsigned threads, uint64_t quota,
+              bool stats)
+{
+        assert(manifest_path != NULL);
+        size_t count, image_count;
+        Image **images;
+        Job *jobs = read_manifest(manifest_path, &count, &images,
+                                  &image_count);
+        if (threads == 0) {
+                long cores = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cores > 0 ? (unsigned)cores : 1;
+        }
+        if (count > 0 && threads > count) {
+                threads = count;
+        }
+        if (threads == 0) {
+                threads = 1;
+        }
+
+        Deque *deques = calloc(threads, sizeof(*deques));
+        Worker *workers = calloc(threads, sizeof(*workers));
+        assert(deques != NULL && workers != NULL);
+        for (unsigned i = 0; i < threads; i++) {
+                pthread_mutex_init(&deques[i].lock, NULL);
+                deques[i].jobs = malloc((count / threads + 1) *
+                                        sizeof(size_t));
+                assert(deques[i].jobs != NULL);
+        }
+        /* Deal in reverse so each worker runs its share in manifest order */
+        for (size_t j = count; j-- > 0; ) {
+                Deque *deque = &deques[j % threads];
+                deque->jobs[deque->back++] = j;
+        }
+
+        double start = now_seconds();
+        for (unsigned i = 0; i < threads; i++) {
+                workers[i].id = i;
+                workers[i].count = threads;
+                workers[i].quota = quota;
+                workers[i].deques = deques;
+                workers[i].jobs = jobs;
+                if (pthread_create(&workers[i].thread, NULL, worker_main,
+                                   &workers[i]) != 0) {
+                        fprintf(stderr, "um batch: cannot start thread\n");
+                        exit(EXIT_FAILURE);
+                }
+        }
+        size_t stolen = 0;
+        for (unsigned i = 0; i < threads; i++) {
+                pthread_join(workers[i].thread, NULL);
+                stolen += workers[i].stolen;
+        }
+        double seconds = now_seconds() - start;
+
+        int status = EXIT_SUCCESS;
+        for (size_t j = 0; j < count; j++) {
+                Job *job = &jobs[j];
+                if (job->error != 0) {
+                        fprintf(stderr, "um batch: %s: %s\n",
+                                job->input_path, strerror(job->error));
+                        status = EXIT_FAILURE;
+                } else if (job->map_failed) {
+                        fprintf(stderr, "um batch: job %zu (line %zu): map "
+                                        "failed with %llu of %llu words "
+                                        "mapped\n", j, job->line,
+                                (unsigned long long)job->memory.mapped_words,
+                                (unsigned long long)job->memory.quota_words);
+                        write_output(job);
+                        status = EXIT_FAILURE;
+                } else if (!write_output(job)) {
+                        fprintf(stderr, "um batch: %s: %s\n",
+                                job->output_path != NULL ?
+                                job->output_path : "stdout",
+                                strerror(errno));
+                        status = EXIT_FAILURE;
+                }
+                fprintf(stderr, "job %zu (line %zu) %s: %.3f ms, "
+                                "%zu bytes of output\n", j, job->line,
+                        job->image->path, job->seconds * 1e3,
+                        job->capture.output_length);
+                if (stats && job->error == 0) {
+                        fprintf(stderr, "    %u live segments, %llu words "
+                                        "at peak, %llu maps, %llu unmaps\n",
+                                job->memory.live_segments,
+                                (unsigned long long)job->memory.peak_words,
+                                (unsigned long long)job->memory.maps,
+                                (unsigned long long)job->memory.unmaps);
+                }
+                capture_free(&job->capture);
+                free(job->input_path);
+                free(job->output_path);
+        }
+        fprintf(stderr, "%zu jobs in %.3f s on %u threads (%zu stolen): "
+                        "%.1f jobs/sec\n", count, seconds, threads, stolen,
+                seconds > 0 ? count / seconds : 0.0);
+        placement_report(stderr);
+
+        for (unsigned i = 0; i < threads; i++) {
+                pthread_mutex_destroy(&deques[i].lock);
+                free(deques[i].jobs);
+        }
+        for (size_t i = 0; i < image_count; i++) {
+                free(images[i]->path);
+                free(images[i]->bytes);
+                free(images[i]);
+        }
+        free(images);
+        free(deques);
+        free(workers);
+        free(jobs);
+        return status;
+}
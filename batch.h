@@ -0,0 +1,53 @@
+/**************************************************************
+ *
+ *                     batch.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     batch.h holds the definition of the batch runner in
+ *     batch.c, which runs the jobs listed in a manifest on a
+ *     pool of threads inside a single um process
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef BATCH_H
+#define BATCH_H
+
+/*
+    run_batch
+    ***************************************************************************
+    Input: 
+        const char *manifest_path: job manifest. Each line names an image
+                                   and, optionally, an input file and an
+                                   output file: IMAGE [INPUT|- [OUTPUT]].
+                                   Blank lines and lines starting with '#'
+                                   are skipped.
+        unsigned threads: number of worker threads, 0 for one per core
+        uint64_t quota: words each job's segments may hold, 0 for no limit
+        bool stats: whether to print each job's memory counters
+    Returns:
+        EXIT_SUCCESS if every job ran, EXIT_FAILURE otherwise
+    Effects:
+        Loads every distinct image once, then runs the jobs on the worker
+        threads. Jobs are dealt out round robin to per-thread deques; a
+        worker takes jobs from the back of its own deque and, once that is
+        empty, steals from the front of the others. A job's input is read
+        from its INPUT file (none for "-") and its output is captured in 
+        memory; once all jobs are done each output is written to its 
+        OUTPUT file, or to stdout in manifest order if it has none. Prints
+        each job's wall time (and with stats its live segments, peak words
+        and maps) and the overall jobs per second to stderr. A job stopped
+        by a map over the quota keeps the output it printed but fails.
+        Exits with an error if the manifest or an image cannot be read.
+    Expects: 
+        manifest_path is not NULL
+    ***************************************************************************
+*/
+int run_batch(const char *manifest_path, unsigned threads, uint64_t quota,
+              bool stats);
+
+#endif
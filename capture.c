@@ -0,0 +1,151 @@
+/**************************************************************
+ *
+ *                     capture.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the input and output callbacks that
+ *     run a machine on a buffer of input and collect what it
+ *     prints in another, shared by the batch runner, whose
+ *     jobs read and write files, and by --compare, which
+ *     feeds two runs the same input and compares their output
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <assert.h>
+#include "capture.h"
+#include "memory.h"
+
+/*
+    capture_input
+    ***************************************************************************
+    Input:
+        void *context: the run's Capture
+    Returns:
+        the next byte of the input, or EOF once it is used up
+    ***************************************************************************
+*/
+static int capture_input(void *context)
+{
+        Capture *capture = context;
+        if (capture->input_at == capture->input_length) {
+                return EOF;
+        }
+        return (unsigned char)capture->input[capture->input_at++];
+}
+
+/*
+    capture_output
+    ***************************************************************************
+    Input:
+        uint8_t byte: byte the program printed
+        void *context: the run's Capture
+    Effects:
+        appends byte to the captured output
+    ***************************************************************************
+*/
+static void capture_output(uint8_t byte, void *context)
+{
+        Capture *capture = context;
+        if (capture->output_length == capture->output_capacity) {
+                capture->output_capacity = capture->output_capacity ?
+                                           2 * capture->output_capacity : 256;
+                capture->output = realloc(capture->output,
+                                          capture->output_capacity);
+                assert(capture->output != NULL);
+        }
+        capture->output[capture->output_length++] = byte;
+}
+
+/*
+    capture_attach
+    ***************************************************************************
+    Input:
+        Memory mem : machine to run
+        Capture *capture: the run's capture
+        const char *input: bytes the machine reads, may be NULL if length
+                           is 0
+        size_t length: number of bytes of input
+    Returns:
+        none
+    Effects:
+        Starts capture with input and no output, and sets mem's input and
+        output callbacks to read from it and append to it; at the end of
+        input the machine reads EOF
+    Expects:
+        mem and capture are not NULL; input outlives the run
+    ***************************************************************************
+*/
+void capture_attach(Memory mem, Capture *capture, const char *input,
+                    size_t length)
+{
+        assert(mem != NULL && capture != NULL);
+        assert(input != NULL || length == 0);
+        capture->input = input;
+        capture->input_length = length;
+        capture->input_at = 0;
+        capture->output = NULL;
+        capture->output_length = 0;
+        capture->output_capacity = 0;
+        set_machine_io(mem, capture_input, capture_output, capture);
+}
+
+/*
+    capture_free
+    ***************************************************************************
+    Input:
+        Capture *capture: capture whose output to free
+    Returns:
+        none
+    Effects:
+        Frees the captured output; the input is left to the caller
+    ***************************************************************************
+*/
+void capture_free(Capture *capture)
+{
+        free(capture->output);
+        capture->output = NULL;
+        capture->output_length = 0;
+        capture->output_capacity = 0;
+}
+
+/*
+    read_stream
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to read to its end
+        size_t *length: set to the number of bytes read
+    Returns:
+        malloc'd contents of the stream, or NULL with errno set if it could
+        not be read
+    ***************************************************************************
+*/
+char *read_stream(FILE *fp, size_t *length)
+{
+        size_t capacity = 4096;
+        char *bytes = malloc(capacity);
+        assert(bytes != NULL);
+        *length = 0;
+        size_t got;
+        while ((got = fread(bytes + *length, 1, capacity - *length,
+                            fp)) > 0) {
+                *length += got;
+                if (*length == capacity) {
+                        capacity *= 2;
+                        bytes = realloc(bytes, capacity);
+                        assert(bytes != NULL);
+                }
+        }
+        if (ferror(fp)) {
+                int saved = errno;
+                free(bytes);
+                errno = saved;
+                return NULL;
+        }
+        return bytes;
+}
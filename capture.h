@@ -0,0 +1,79 @@
+/**************************************************************
+ *
+ *                     capture.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     capture.h holds the definitions of the functions used in
+ *     capture.c, which runs a machine on input held in memory
+ *     and collects its output in memory, for the batch runner
+ *     and the --compare mode
+ *
+ **************************************************************/
+#include <stddef.h>
+#include <stdio.h>
+#include "memory.h"
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/* A run's input, which the caller owns, and its captured output, which
+   capture_free frees */
+typedef struct Capture {
+        const char *input;
+        size_t input_length, input_at;
+        char *output;
+        size_t output_length, output_capacity;
+} Capture;
+
+/*
+    capture_attach
+    ***************************************************************************
+    Input:
+        Memory mem : machine to run
+        Capture *capture: the run's capture
+        const char *input: bytes the machine reads, may be NULL if length
+                           is 0
+        size_t length: number of bytes of input
+    Returns:
+        none
+    Effects:
+        Starts capture with input and no output, and sets mem's input and
+        output callbacks to read from it and append to it; at the end of
+        input the machine reads EOF
+    Expects:
+        mem and capture are not NULL; input outlives the run
+    ***************************************************************************
+*/
+void capture_attach(Memory mem, Capture *capture, const char *input,
+                    size_t length);
+
+/*
+    capture_free
+    ***************************************************************************
+    Input:
+        Capture *capture: capture whose output to free
+    Returns:
+        none
+    Effects:
+        Frees the captured output; the input is left to the caller
+    ***************************************************************************
+*/
+void capture_free(Capture *capture);
+
+/*
+    read_stream
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to read to its end
+        size_t *length: set to the number of bytes read
+    Returns:
+        malloc'd contents of the stream, or NULL with errno set if it could
+        not be read
+    ***************************************************************************
+*/
+char *read_stream(FILE *fp, size_t *length);
+
+#endif
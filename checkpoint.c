@@ -0,0 +1,572 @@
+/**************************************************************
+ *
+ *                     checkpoint.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the periodic checkpoints of a long run.
+ *     Every checkpoint_interval seconds the machine forks, and
+ *     the child writes what changed since the last checkpoint
+ *     while the parent runs on, so the machine only stops for
+ *     the fork and pays nothing between checkpoints. The child
+ *     finds the changes by comparing a digest of every page
+ *     (memory_sums) with the digests the last checkpoint left
+ *     in checkpoint_path.sums, and then replaces those. A
+ *     checkpoint file is a
+ *     sequence of host-order 32-bit words:
+ *         CHECKPOINT_MAGIC, CHECKPOINT_VERSION, then records of
+ *         kind, sequence number, payload words (low word first),
+ *         registers[0..7] and the payload
+ *     The first record is a base (the image from write_memory)
+ *     and each later one a delta (write_memory_changes) against
+ *     the state before it. A record's size is written last, so
+ *     one cut short by a crash reads as empty.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "checkpoint.h"
+#include "snapshot.h"
+#include "instructions.h"
+#include "memory.h"
+
+/* Words before a record's payload: kind, sequence, size and registers */
+#define RECORD_HEADER 12
+
+/* Record kinds */
+#define RECORD_BASE  1u
+#define RECORD_DELTA 2u
+
+const char *checkpoint_path = NULL;
+unsigned checkpoint_interval = 60;
+volatile sig_atomic_t checkpoint_due = 0;
+
+/* The child writing the last checkpoint, or -1 */
+static pid_t writer = -1;
+
+/* Whether the next checkpoint must save the whole machine, and the
+   sequence number of the next delta */
+static bool need_base = true;
+static uint32_t next_sequence;
+
+/* Counters for checkpoint_report */
+static uint64_t bases, deltas, skipped, failed;
+static double stopped_seconds;
+
+/*
+    request_checkpoint
+    ***************************************************************************
+    Input:
+        int signo: signal number (unused)
+    Returns:
+        none
+    Effects:
+        Asks execute to stop at its next poll and take a checkpoint
+    ***************************************************************************
+*/
+static void request_checkpoint(int signo)
+{
+        (void) signo;
+        checkpoint_due = 1;
+        snapshot_requested = 1;
+}
+
+/*
+    checkpoint_start
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Starts a timer that, every checkpoint_interval seconds, sets
+        checkpoint_due and snapshot_requested so that the engine stops at
+        its next poll and calls snapshot_take. The first checkpoint saves
+        the whole machine.
+    Expects:
+        mem and checkpoint_path are not NULL; called once, before execute
+    ***************************************************************************
+*/
+void checkpoint_start(Memory mem)
+{
+        assert(mem != NULL && checkpoint_path != NULL);
+        assert(checkpoint_interval > 0);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_checkpoint;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGALRM, &action, NULL);
+
+        struct itimerval timer;
+        memset(&timer, 0, sizeof(timer));
+        timer.it_interval.tv_sec = checkpoint_interval;
+        timer.it_value.tv_sec = checkpoint_interval;
+        setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+/*
+    write_record
+    ***************************************************************************
+    Input:
+        FILE *fp: checkpoint file, positioned where the record goes
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint32_t kind: RECORD_BASE or RECORD_DELTA
+        uint32_t sequence: the record's number in the file
+        Memory_sums old: for a delta, the digests of the last checkpoint
+        Memory_sums now: for a delta, the digests of mem
+    Returns:
+        true if the record was written and synced, false otherwise
+    Effects:
+        Writes the record with a size of 0, syncs it, and only then fills
+        in its size and syncs again, so that a crash part way through
+        leaves a record restore stops at
+    ***************************************************************************
+*/
+static bool write_record(FILE *fp, Memory mem, uint32_t kind,
+                         uint32_t sequence, Memory_sums old, Memory_sums now)
+{
+        long start = ftell(fp);
+        uint32_t header[RECORD_HEADER] = { kind, sequence, 0, 0 };
+        memcpy(header + 4, machine_registers(mem), 8 * sizeof(uint32_t));
+        if (start < 0 || fwrite(header, sizeof(uint32_t), RECORD_HEADER,
+                                fp) != RECORD_HEADER) {
+                return false;
+        }
+        bool ok = kind == RECORD_BASE ? write_memory(mem, fp)
+                                      : write_memory_changes(mem, old, now,
+                                                             fp);
+        long end = ftell(fp);
+        if (!ok || end < 0 || fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+                return false;
+        }
+        uint64_t words = (uint64_t)(end - start) / sizeof(uint32_t) -
+                         RECORD_HEADER;
+        uint32_t size[2] = { (uint32_t)words, (uint32_t)(words >> 32) };
+        return fseek(fp, start + 2 * (long)sizeof(uint32_t), SEEK_SET) == 0 &&
+               fwrite(size, sizeof(uint32_t), 2, fp) == 2 &&
+               fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+}
+
+/*
+    write_base
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        true if the checkpoint file was replaced, false otherwise
+    Effects:
+        Writes a new checkpoint file holding only a base record to a
+        temporary file and renames it over checkpoint_path, so the old
+        file stays whole until the new one is
+    ***************************************************************************
+*/
+static bool write_base(Memory mem)
+{
+        size_t length = strlen(checkpoint_path) + sizeof(".4294967295.tmp");
+        char *temporary = malloc(length);
+        if (temporary == NULL) {
+                return false;
+        }
+        snprintf(temporary, length, "%s.%u.tmp", checkpoint_path,
+                 (unsigned)getpid());
+
+        FILE *fp = fopen(temporary, "wb");
+        if (fp == NULL) {
+                free(temporary);
+                return false;
+        }
+        uint32_t header[2] = { CHECKPOINT_MAGIC, CHECKPOINT_VERSION };
+        bool ok = fwrite(header, sizeof(uint32_t), 2, fp) == 2 &&
+                  write_record(fp, mem, RECORD_BASE, 0, NULL, NULL);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(temporary, checkpoint_path) == 0;
+        if (!ok) {
+                remove(temporary);
+        }
+        free(temporary);
+        return ok;
+}
+
+/*
+    write_delta
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint32_t sequence: the record's number in the file
+        Memory_sums old: the digests of the last checkpoint
+        Memory_sums now: the digests of mem
+    Returns:
+        true if the delta was appended and synced, false otherwise
+    ***************************************************************************
+*/
+static bool write_delta(Memory mem, uint32_t sequence, Memory_sums old,
+                        Memory_sums now)
+{
+        FILE *fp = fopen(checkpoint_path, "r+b");
+        if (fp == NULL) {
+                return false;
+        }
+        bool ok = fseek(fp, 0, SEEK_END) == 0 &&
+                  write_record(fp, mem, RECORD_DELTA, sequence, old, now);
+        return (fclose(fp) == 0) && ok;
+}
+
+/*
+    sums_path
+    ***************************************************************************
+    Input:
+        const char *suffix: added after checkpoint_path's ".sums"
+    Returns:
+        a new string naming the file the page digests of the last
+        checkpoint are kept in, followed by suffix, or NULL if there is no
+        memory for it
+    ***************************************************************************
+*/
+static char *sums_path(const char *suffix)
+{
+        size_t length = strlen(checkpoint_path) + strlen(".sums") +
+                        strlen(suffix) + 1;
+        char *path = malloc(length);
+        if (path != NULL) {
+                snprintf(path, length, "%s.sums%s", checkpoint_path, suffix);
+        }
+        return path;
+}
+
+/*
+    read_sums
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        the page digests the last checkpoint left, or NULL if they cannot
+        be read
+    ***************************************************************************
+*/
+static Memory_sums read_sums(void)
+{
+        char *path = sums_path("");
+        FILE *fp = path != NULL ? fopen(path, "rb") : NULL;
+        free(path);
+        if (fp == NULL) {
+                return NULL;
+        }
+        Memory_sums sums = read_memory_sums(fp);
+        fclose(fp);
+        return sums;
+}
+
+/*
+    write_sums
+    ***************************************************************************
+    Input:
+        Memory_sums sums: page digests of the checkpoint just written
+    Returns:
+        true if they replaced the last checkpoint's, false otherwise
+    Effects:
+        Writes sums to a temporary file and renames it over the old ones,
+        so a failed write leaves no digests that a delta could be taken
+        against by mistake
+    ***************************************************************************
+*/
+static bool write_sums(Memory_sums sums)
+{
+        char suffix[sizeof(".4294967295.tmp")];
+        snprintf(suffix, sizeof(suffix), ".%u.tmp", (unsigned)getpid());
+        char *temporary = sums_path(suffix);
+        char *path = sums_path("");
+        FILE *fp = temporary != NULL && path != NULL ? 
+                   fopen(temporary, "wb") : NULL;
+        bool ok = fp != NULL && write_memory_sums(sums, fp);
+        ok = (fp == NULL || fclose(fp) == 0) && ok;
+        ok = ok && rename(temporary, path) == 0;
+        if (!ok && fp != NULL) {
+                remove(temporary);
+        }
+        free(temporary);
+        free(path);
+        return ok;
+}
+
+/*
+    write_checkpoint
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        bool base: whether to start a new file with the whole machine
+        uint32_t sequence: the record's number in the file
+    Returns:
+        true if the record and its page digests were written, false
+        otherwise (or if there are no digests to take a delta against)
+    Effects:
+        Digests every page of mem, writes a base or a delta against the
+        last checkpoint's digests, and keeps the new digests for the next
+        delta
+    ***************************************************************************
+*/
+static bool write_checkpoint(Memory mem, bool base, uint32_t sequence)
+{
+        Memory_sums now = memory_sums(mem);
+        Memory_sums old = base ? NULL : read_sums();
+        bool ok = base ? write_base(mem) 
+                       : old != NULL && write_delta(mem, sequence, old, now);
+        ok = ok && write_sums(now);
+        free_memory_sums(&old);
+        free_memory_sums(&now);
+        return ok;
+}
+
+/*
+    reap_writer
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        false if the last checkpoint's child is still writing, true
+        otherwise
+    Effects:
+        Collects the child once it has exited. If its write failed, the
+        file may end in a partial record, so the next checkpoint starts a
+        new file with a base.
+    ***************************************************************************
+*/
+static bool reap_writer(void)
+{
+        if (writer < 0) {
+                return true;
+        }
+        int status;
+        pid_t done;
+        do {
+                done = waitpid(writer, &status, WNOHANG);
+        } while (done < 0 && errno == EINTR);
+        if (done == 0) {
+                return false;
+        }
+        if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "um: checkpoint to %s failed\n",
+                        checkpoint_path);
+                failed++;
+                need_base = true;
+        }
+        writer = -1;
+        return true;
+}
+
+/*
+    checkpoint_take
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Clears checkpoint_due and forks a child that appends what changed
+        since the last checkpoint (or, the first time and after a failed
+        write, the whole machine) to checkpoint_path, and returns at once.
+        If the previous child is still writing, this checkpoint is skipped
+        and its changes go into the next one.
+    Expects:
+        mem is not NULL and checkpoint_start has been called
+    ***************************************************************************
+*/
+void checkpoint_take(Memory mem)
+{
+        assert(mem != NULL);
+        checkpoint_due = 0;
+        if (!reap_writer()) {
+                skipped++;
+                return;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        bool base = need_base;
+        uint32_t sequence = base ? 0 : next_sequence;
+        /* The child leaves with _exit, so it never flushes the output the
+           parent has buffered */
+        pid_t pid = fork();
+        if (pid == 0) {
+                bool ok = write_checkpoint(mem, base, sequence);
+                _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+        bool ok = true;
+        if (pid > 0) {
+                writer = pid;
+        } else {
+                /* No child: write it on this thread */
+                ok = write_checkpoint(mem, base, sequence);
+        }
+        if (ok) {
+                need_base = false;
+                next_sequence = sequence + 1;
+                if (base) {
+                        bases++;
+                } else {
+                        deltas++;
+                }
+        } else {
+                perror(checkpoint_path);
+                failed++;
+                need_base = true;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stopped_seconds += (end.tv_sec - start.tv_sec) +
+                           (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+    replay
+    ***************************************************************************
+    Input:
+        const uint32_t *words: contents of a checkpoint file
+        size_t count: number of words in words
+        uint32_t limit: most records to apply
+        uint32_t *bad: set to the number of the first record that did not
+                       apply, or to limit if none failed
+    Returns:
+        Memory struct rebuilt from the base and the deltas after it, or
+        NULL if the base cannot be read
+    Effects:
+        Applies records in order until one is empty, runs past the end of
+        the file, is out of sequence or fails, or limit have been applied.
+        A delta that fails may have been partly applied, so the caller
+        replays again with limit set to *bad.
+    ***************************************************************************
+*/
+static Memory replay(const uint32_t *words, size_t count, uint32_t limit,
+                     uint32_t *bad)
+{
+        Memory mem = NULL;
+        size_t at = 2;
+        uint32_t records = 0;
+        *bad = limit;
+        while (records < limit && count - at >= RECORD_HEADER) {
+                const uint32_t *header = words + at;
+                uint64_t size = header[2] | (uint64_t)header[3] << 32;
+                uint32_t kind = records == 0 ? RECORD_BASE : RECORD_DELTA;
+                if (size == 0 || size > count - at - RECORD_HEADER ||
+                    header[0] != kind || header[1] != records) {
+                        break;
+                }
+                const uint32_t *payload = header + RECORD_HEADER;
+                size_t used = 0;
+                bool ok;
+                if (records == 0) {
+                        mem = read_memory(payload, size, &used);
+                        ok = mem != NULL;
+                } else {
+                        ok = apply_memory_changes(mem, payload, size, &used);
+                }
+                if (!ok || used != size) {
+                        *bad = records;
+                        break;
+                }
+                memcpy(machine_registers(mem), header + 4,
+                       8 * sizeof(uint32_t));
+                at += RECORD_HEADER + size;
+                records++;
+        }
+        return mem;
+}
+
+/*
+    checkpoint_restore
+    ***************************************************************************
+    Input:
+        const char *path: checkpoint file, or a snapshot from snapshot_save
+    Returns:
+        Memory struct rebuilt from the file, or NULL if it cannot be read
+        or does not start with a complete checkpoint
+    Effects:
+        Rebuilds the machine from the file's first checkpoint and then
+        applies every later one that was written completely, stopping at
+        the first that was cut short or does not apply. A snapshot file is
+        restored with snapshot_restore.
+    Expects:
+        path is not NULL
+    ***************************************************************************
+*/
+Memory checkpoint_restore(const char *path)
+{
+        assert(path != NULL);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                return NULL;
+        }
+        struct stat file_status;
+        if (fstat(fd, &file_status) != 0 ||
+            file_status.st_size < 2 * (off_t)sizeof(uint32_t)) {
+                close(fd);
+                return NULL;
+        }
+        size_t size = file_status.st_size;
+        const uint32_t *words = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd,
+                                     0);
+        close(fd);
+        if (words == MAP_FAILED) {
+                return NULL;
+        }
+        Memory mem = NULL;
+        if (words[0] == SNAPSHOT_MAGIC) {
+                munmap((void *)words, size);
+                return snapshot_restore(path);
+        }
+        if (words[0] == CHECKPOINT_MAGIC && words[1] == CHECKPOINT_VERSION) {
+                madvise((void *)words, size, MADV_SEQUENTIAL);
+                size_t count = size / sizeof(uint32_t);
+                uint32_t bad;
+                mem = replay(words, count, UINT32_MAX, &bad);
+                if (bad != UINT32_MAX && mem != NULL) {
+                        /* Rebuild without the delta that failed */
+                        free_segments(mem);
+                        mem = replay(words, count, bad, &bad);
+                }
+        }
+        munmap((void *)words, size);
+        return mem;
+}
+
+/*
+    checkpoint_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how many full and incremental checkpoints were started, how
+        many were skipped or failed, and how long the machine was stopped
+        for them in all
+    ***************************************************************************
+*/
+void checkpoint_report(FILE *fp)
+{
+        fprintf(fp, "checkpoints: %llu full, %llu incremental, %llu skipped, "
+                    "%llu failed; stopped %.3f ms in all\n",
+                (unsigned long long)bases, (unsigned long long)deltas,
+                (unsigned long long)skipped, (unsigned long long)failed,
+                stopped_seconds * 1e3);
+}
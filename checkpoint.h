@@ -0,0 +1,111 @@
+/**************************************************************
+ *
+ *                     checkpoint.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     checkpoint.h holds the definitions of the functions used
+ *     in checkpoint.c, which save a long run to a file every few
+ *     seconds, writing only what changed since the last save,
+ *     and rebuild the machine from that file after a crash
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "memory.h"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/* First two words of every checkpoint file */
+#define CHECKPOINT_MAGIC   0x554d434bu
+#define CHECKPOINT_VERSION 1u
+
+/* File checkpoints are written to (--checkpoint); NULL disables them */
+extern const char *checkpoint_path;
+
+/* Seconds between checkpoints (--checkpoint-every, default 60) */
+extern unsigned checkpoint_interval;
+
+/* Set by the timer; the next snapshot_take writes a checkpoint when this
+   is nonzero */
+extern volatile sig_atomic_t checkpoint_due;
+
+/*
+    checkpoint_start
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Starts a timer that, every checkpoint_interval seconds, sets
+        checkpoint_due and snapshot_requested so that the engine stops at
+        its next poll and calls snapshot_take. The first checkpoint saves
+        the whole machine.
+    Expects:
+        mem and checkpoint_path are not NULL; called once, before execute
+    ***************************************************************************
+*/
+void checkpoint_start(Memory mem);
+
+/*
+    checkpoint_take
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Clears checkpoint_due and forks a child that appends what changed
+        since the last checkpoint (or, the first time and after a failed
+        write, the whole machine) to checkpoint_path, and returns at once.
+        If the previous child is still writing, this checkpoint is skipped
+        and its changes go into the next one.
+    Expects:
+        mem is not NULL and checkpoint_start has been called
+    ***************************************************************************
+*/
+void checkpoint_take(Memory mem);
+
+/*
+    checkpoint_restore
+    ***************************************************************************
+    Input:
+        const char *path: checkpoint file, or a snapshot from snapshot_save
+    Returns:
+        Memory struct rebuilt from the file, or NULL if it cannot be read
+        or does not start with a complete checkpoint
+    Effects:
+        Rebuilds the machine from the file's first checkpoint and then
+        applies every later one that was written completely, stopping at
+        the first that was cut short or does not apply. A snapshot file is
+        restored with snapshot_restore.
+    Expects:
+        path is not NULL
+    ***************************************************************************
+*/
+Memory checkpoint_restore(const char *path);
+
+/*
+    checkpoint_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how many full and incremental checkpoints were started, how
+        many were skipped or failed, and how long the machine was stopped
+        for them in all
+    ***************************************************************************
+*/
+void checkpoint_report(FILE *fp);
+
+#endif
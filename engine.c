@@ -0,0 +1,183 @@
+/**************************************************************
+ *
+ *                     engine.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the table of execution engines that
+ *     --engine chooses from, and the A/B mode (--compare) that
+ *     runs one image on two of them and reports how fast each
+ *     was. A new engine only needs an entry in ENGINES.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "engine.h"
+#include "lilum.h"
+#include "memory.h"
+#include "snapshot.h"
+#include "threaded.h"
+#include "jit.h"
+#include "capture.h"
+
+/*
+    no_setup
+    ***************************************************************************
+    Effects:
+        none; init and teardown of the engines with no per-thread state
+    ***************************************************************************
+*/
+static void no_setup(void)
+{
+}
+
+static const Engine ENGINES[] = {
+        { "switch", no_setup, execute_switch, no_setup },
+        { "threaded", no_setup, execute_threaded, no_setup },
+        { "jit", jit_prepare, execute_jit, jit_release },
+};
+
+const Engine *engine = &ENGINES[1];
+
+/*
+    find_engine
+    ***************************************************************************
+    Input:
+        const char *name: engine name, as given to --engine
+    Returns:
+        the engine called name, or NULL if there is none
+    ***************************************************************************
+*/
+const Engine *find_engine(const char *name)
+{
+        for (size_t i = 0; i < sizeof(ENGINES) / sizeof(ENGINES[0]); i++) {
+                if (strcmp(ENGINES[i].name, name) == 0) {
+                        return &ENGINES[i];
+                }
+        }
+        return NULL;
+}
+
+/*
+    timed_run
+    ***************************************************************************
+    Input:
+        const Engine *e: engine to run on
+        Memory mem : machine to run, freed afterwards
+        Capture *capture: the run's capture
+        const char *input, size_t length: the run's input
+        double *seconds: set to the wall time of the run
+        uint64_t *count: set to the number of instructions executed
+    Returns:
+        why the run stopped
+    ***************************************************************************
+*/
+static Stop_reason timed_run(const Engine *e, Memory mem, Capture *capture,
+                             const char *input, size_t length,
+                             double *seconds, uint64_t *count)
+{
+        capture_attach(mem, capture, input, length);
+        e->init();
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Stop_reason reason = e->run(mem, UINT64_MAX, false);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        e->teardown();
+        *seconds = (end.tv_sec - start.tv_sec) +
+                   (end.tv_nsec - start.tv_nsec) / 1e9;
+        *count = instructions_executed(mem);
+        free_segments(mem);
+        return reason;
+}
+
+/*
+    compare_engines
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct holding the loaded program
+        const Engine *a: first engine to run the program on
+        const Engine *b: second engine to run the program on
+    Returns:
+        EXIT_SUCCESS if both engines produced the same output, stopped for
+        the same reason after the same number of instructions,
+        EXIT_FAILURE otherwise
+    Effects:
+        Reads all of standard input, then runs the program to completion
+        on a and on a copy of the machine on b, feeding each the same input
+        and capturing their output. Writes a's output to stdout and prints
+        each engine's instruction count, time and instructions per second,
+        and whether the runs agreed, to stderr. Frees mem.
+    Expects:
+        mem, a and b are not NULL
+    ***************************************************************************
+*/
+int compare_engines(Memory mem, const Engine *a, const Engine *b)
+{
+        static const char *const STOPPED[] = { "end", "budget", "input",
+                                               "halt", "map failed" };
+        assert(mem != NULL && a != NULL && b != NULL);
+        Memory copy = snapshot_copy(mem);
+        if (copy == NULL) {
+                fprintf(stderr, "um: cannot copy the machine\n");
+                free_segments(mem);
+                return EXIT_FAILURE;
+        }
+        /* The copy is a new machine, without mem's quota */
+        Memory_stats stats;
+        memory_stats(mem, &stats);
+        set_memory_quota(copy, stats.quota_words);
+        size_t length;
+        char *input = read_stream(stdin, &length);
+        if (input == NULL) {
+                perror("um: standard input");
+                free_segments(mem);
+                free_segments(copy);
+                return EXIT_FAILURE;
+        }
+        Capture captures[2];
+
+        const Engine *engines[2] = { a, b };
+        Memory machines[2] = { mem, copy };
+        Stop_reason reasons[2];
+        double seconds[2];
+        uint64_t counts[2];
+        for (int i = 0; i < 2; i++) {
+                reasons[i] = timed_run(engines[i], machines[i], &captures[i],
+                                       input, length, &seconds[i],
+                                       &counts[i]);
+                fprintf(stderr, "%-10s %llu instructions in %.3f s: "
+                                "%.1f M instructions/sec (%s)\n",
+                        engines[i]->name, (unsigned long long)counts[i],
+                        seconds[i], seconds[i] > 0 ?
+                        counts[i] / seconds[i] / 1e6 : 0.0,
+                        STOPPED[reasons[i]]);
+        }
+        fwrite(captures[0].output, 1, captures[0].output_length, stdout);
+        fflush(stdout);
+
+        bool same = reasons[0] == reasons[1] && counts[0] == counts[1] &&
+                    captures[0].output_length == captures[1].output_length &&
+                    (captures[0].output_length == 0 ||
+                     memcmp(captures[0].output, captures[1].output,
+                            captures[0].output_length) == 0);
+        if (same) {
+                fprintf(stderr, "%s/%s: %.2fx, same output\n", b->name,
+                        a->name, seconds[1] > 0 ?
+                        seconds[0] / seconds[1] : 0.0);
+        } else {
+                fprintf(stderr, "%s and %s DISAGREE: %zu and %zu bytes of "
+                                "output\n", a->name, b->name,
+                        captures[0].output_length, captures[1].output_length);
+        }
+        free(input);
+        capture_free(&captures[0]);
+        capture_free(&captures[1]);
+        return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
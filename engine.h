@@ -0,0 +1,70 @@
+/**************************************************************
+ *
+ *                     engine.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     engine.h holds the interface every execution engine
+ *     implements, the table of engines in engine.c and the A/B
+ *     mode that compares two of them on the same image
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "lilum.h"
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/* An execution engine. run has the contract of execute_until. init sets
+   up the calling thread's state for the engine ahead of its first run, 
+   and teardown releases it; both may be called more than once. */
+typedef struct Engine {
+        const char *name;
+        void (*init)(void);
+        Stop_reason (*run)(Memory mem, uint64_t budget, bool pause_at_io);
+        void (*teardown)(void);
+} Engine;
+
+/* Engine used by execute_until and execute: "threaded" unless --engine 
+   picks another, or "switch" with --profile */
+extern const Engine *engine;
+
+/*
+    find_engine
+    ***************************************************************************
+    Input: 
+        const char *name: engine name, as given to --engine
+    Returns:
+        the engine called name, or NULL if there is none
+    ***************************************************************************
+*/
+const Engine *find_engine(const char *name);
+
+/*
+    compare_engines
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct holding the loaded program
+        const Engine *a: first engine to run the program on
+        const Engine *b: second engine to run the program on
+    Returns:
+        EXIT_SUCCESS if both engines produced the same output, stopped for
+        the same reason after the same number of instructions, 
+        EXIT_FAILURE otherwise
+    Effects:
+        Reads all of standard input, then runs the program to completion
+        on a and on a copy of the machine on b, feeding each the same input
+        and capturing their output. Writes a's output to stdout and prints
+        each engine's instruction count, time and instructions per second,
+        and whether the runs agreed, to stderr. Frees mem.
+    Expects: 
+        mem, a and b are not NULL
+    ***************************************************************************
+*/
+int compare_engines(Memory mem, const Engine *a, const Engine *b);
+
+#endif
@@ -0,0 +1,198 @@
+/**************************************************************
+ *
+ *                     forkserver.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the fork server. A job is one
+ *     connection to the server's Unix socket: the client writes
+ *     the program's input, shuts down its side for writing, and
+ *     reads the program's output until the connection closes,
+ *     e.g.  socat - UNIX-CONNECT:um.sock < input > output
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "forkserver.h"
+#include "lilum.h"
+#include "memory.h"
+
+/*
+    warm_up
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct holding the loaded program
+        uint64_t warm_at: most instructions to run
+        size_t *length: set to the number of bytes of captured output
+    Returns:
+        malloc'd copy of everything the program printed while warming up
+    Effects:
+        Runs the program with standard output redirected to a temporary
+        file until it reaches its first input or halt instruction or has
+        run warm_at instructions, then restores standard output
+    ***************************************************************************
+*/
+static char *warm_up(Memory mem, uint64_t warm_at, size_t *length)
+{
+        FILE *capture = tmpfile();
+        if (capture == NULL)
+        {
+                perror("um: tmpfile");
+                exit(EXIT_FAILURE);
+        }
+        fflush(stdout);
+        int saved_stdout = dup(STDOUT_FILENO);
+        dup2(fileno(capture), STDOUT_FILENO);
+
+        execute_until(mem, warm_at, true);
+
+        flush_output(mem);
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+
+        long size = ftell(capture);
+        char *output = malloc(size > 0 ? size : 1);
+        assert(output != NULL);
+        rewind(capture);
+        *length = fread(output, 1, size > 0 ? size : 0, capture);
+        fclose(capture);
+        return output;
+}
+
+/*
+    listen_on
+    ***************************************************************************
+    Input:
+        const char *socket_path: path of the Unix socket
+    Returns:
+        listening socket descriptor
+    Effects:
+        Replaces any stale socket at socket_path and listens on it. Exits
+        with an error if that fails.
+    ***************************************************************************
+*/
+static int listen_on(const char *socket_path)
+{
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(address.sun_path))
+        {
+                fprintf(stderr, "%s: socket path too long\n", socket_path);
+                exit(EXIT_FAILURE);
+        }
+        strcpy(address.sun_path, socket_path);
+
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(socket_path);
+        if (listener < 0 ||
+            bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            listen(listener, SOMAXCONN) < 0)
+        {
+                perror(socket_path);
+                exit(EXIT_FAILURE);
+        }
+        return listener;
+}
+
+/*
+    run_job
+    ***************************************************************************
+    Input:
+        int connection: accepted client connection
+        Memory mem : the warm machine (this process's copy of it)
+        const char *prefix: output captured while warming up
+        size_t length: number of bytes in prefix
+    Returns:
+        does not return
+    Effects:
+        Makes connection the program's standard input and output, replays
+        the warm-up output and resumes the program. A refused map is
+        reported on the server's stderr and fails the job.
+    ***************************************************************************
+*/
+static void run_job(int connection, Memory mem, const char *prefix,
+                    size_t length)
+{
+        signal(SIGCHLD, SIG_DFL);
+        dup2(connection, STDIN_FILENO);
+        dup2(connection, STDOUT_FILENO);
+        close(connection);
+
+        fwrite(prefix, 1, length, stdout);
+        fflush(stdout);
+        if (execute(mem) == STOP_MAP_FAILED) {
+                report_map_failure(mem, stderr);
+                exit(EXIT_FAILURE);
+        }
+        exit(EXIT_SUCCESS);
+}
+
+/*
+    fork_server
+    ***************************************************************************
+    Input:
+        const char *socket_path: path of the Unix socket to listen on
+        Memory mem : Memory struct holding the loaded program
+        uint64_t warm_at: most instructions to run before serving jobs
+    Returns:
+        does not return
+    Effects:
+        Runs the program until its first input or halt instruction, or
+        until warm_at instructions have run, with its output captured. Then
+        listens on socket_path and, for every connection, forks a child
+        that uses the connection as standard input and output, replays the
+        captured output and resumes the program. Each job therefore starts
+        from a copy-on-write copy of the warm machine. Exits with an error
+        if the socket cannot be set up.
+    Expects:
+        socket_path and mem are not NULL
+    ***************************************************************************
+*/
+void fork_server(const char *socket_path, Memory mem, uint64_t warm_at)
+{
+        assert(socket_path != NULL && mem != NULL);
+        size_t length;
+        char *prefix = warm_up(mem, warm_at, &length);
+        int listener = listen_on(socket_path);
+
+        /* Finished jobs are reaped by the kernel */
+        signal(SIGCHLD, SIG_IGN);
+        fprintf(stderr, "um: serving jobs on %s\n", socket_path);
+
+        for (;;)
+        {
+                int connection = accept(listener, NULL, NULL);
+                if (connection < 0)
+                {
+                        if (errno == EINTR || errno == ECONNABORTED)
+                        {
+                                continue;
+                        }
+                        perror("um: accept");
+                        exit(EXIT_FAILURE);
+                }
+                pid_t child = fork();
+                if (child == 0)
+                {
+                        close(listener);
+                        run_job(connection, mem, prefix, length);
+                }
+                if (child < 0)
+                {
+                        perror("um: fork");
+                }
+                close(connection);
+        }
+}
@@ -0,0 +1,44 @@
+/**************************************************************
+ *
+ *                     forkserver.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     forkserver.h holds the definitions of the functions
+ *     used in forkserver.c, which run a program up to the point
+ *     where it wants input and then serve jobs from copies of
+ *     that warm machine
+ *
+ **************************************************************/
+#include <stdint.h>
+#include "memory.h"
+
+#ifndef FORKSERVER_H
+#define FORKSERVER_H
+
+/*
+    fork_server
+    ***************************************************************************
+    Input: 
+        const char *socket_path: path of the Unix socket to listen on
+        Memory mem : Memory struct holding the loaded program
+        uint64_t warm_at: most instructions to run before serving jobs
+    Returns:
+        does not return
+    Effects:
+        Runs the program until its first input or halt instruction, or
+        until warm_at instructions have run, with its output captured. Then
+        listens on socket_path and, for every connection, forks a child
+        that uses the connection as standard input and output, replays the
+        captured output and resumes the program. Each job therefore starts
+        from a copy-on-write copy of the warm machine. Exits with an error
+        if the socket cannot be set up.
+    Expects: 
+        socket_path and mem are not NULL
+    ***************************************************************************
+*/
+void fork_server(const char *socket_path, Memory mem, uint64_t warm_at);
+
+#endif
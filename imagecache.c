@@ -0,0 +1,205 @@
+/**************************************************************
+ *
+ *                     imagecache.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the functions for the image cache.
+ *     Entries are snapshots named after the fingerprint and
+ *     length of the original segment 0, taken at the first large
+ *     load_program from a non-zero segment, provided the program
+ *     has done no input or output by then. Each is keyed by the
+ *     whole original segment 0 (snapshot_save_keyed), so an image
+ *     whose fingerprint and length merely collide with another's
+ *     does not resume it
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "imagecache.h"
+#include "snapshot.h"
+#include "memory.h"
+
+char *image_cache_pending = NULL;
+uint32_t image_cache_min_words = IMAGE_CACHE_MIN_WORDS;
+
+/* Whether image_cache_store reports what it saved */
+static bool cache_report = false;
+
+/* Copy of the segment 0 that image_cache_pending is for, which the entry
+   is keyed by */
+static uint32_t *pending_image = NULL;
+static uint32_t pending_length = 0;
+
+/*
+    image_cache_default_dir
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        $UM_CACHE_DIR if it is set and not empty, otherwise NULL: the
+        cache is only used when it is asked for, since nothing removes
+        its entries
+    Effects:
+        None
+    ***************************************************************************
+*/
+const char *image_cache_default_dir(void)
+{
+        const char *env = getenv("UM_CACHE_DIR");
+        if (env != NULL && *env != '\0')
+        {
+                return env;
+        }
+        return NULL;
+}
+
+/*
+    make_directories
+    ***************************************************************************
+    Input:
+        const char *dir: directory path
+    Returns:
+        true if dir exists or was created, false otherwise
+    Effects:
+        Creates dir and any missing parent directories
+    ***************************************************************************
+*/
+static bool make_directories(const char *dir)
+{
+        char *path = strdup(dir);
+        assert(path != NULL);
+        for (char *slash = strchr(path + 1, '/'); slash != NULL;
+             slash = strchr(slash + 1, '/'))
+        {
+                *slash = '\0';
+                mkdir(path, 0777);
+                *slash = '/';
+        }
+        bool ok = mkdir(path, 0777) == 0 || errno == EEXIST;
+        free(path);
+        return ok;
+}
+
+/*
+    image_cache_open
+    ***************************************************************************
+    Input:
+        const char *dir: cache directory
+        Memory mem : freshly loaded machine; segment 0 holds the image
+        bool report: whether to report cache hits and stores on stderr
+    Returns:
+        the machine restored from the cache entry for this image if there
+        is one, otherwise NULL
+    Effects:
+        Names the entry after the fingerprint of segment 0, and uses it
+        only if it was saved from the same words (snapshot_restore_keyed).
+        On a hit the saved registers are loaded and the caller should
+        free mem and run the returned machine. On a miss, image_cache_pending
+        is set, and segment 0 copied, so that execute saves the entry once
+        the image has loaded its decompressed code.
+    Expects:
+        dir and mem are not NULL and mem has not executed any instruction
+    ***************************************************************************
+*/
+Memory image_cache_open(const char *dir, Memory mem, bool report)
+{
+        assert(dir != NULL && mem != NULL);
+        uint32_t words;
+        const uint32_t *image = program_words(mem, &words);
+        size_t length = strlen(dir) + 64;
+        char *path = malloc(length);
+        assert(path != NULL);
+        snprintf(path, length, "%s/%016llx-%u.umc", dir,
+                 (unsigned long long)segment_fingerprint(mem, 0),
+                 (unsigned)words);
+
+        Memory cached = snapshot_restore_keyed(path, image, words);
+        if (cached != NULL)
+        {
+                if (report)
+                {
+                        fprintf(stderr, "um: resumed from image cache %s\n",
+                                path);
+                }
+                free(path);
+                return cached;
+        }
+        if (!make_directories(dir))
+        {
+                free(path);
+                return NULL;
+        }
+        image_cache_disarm();
+        pending_image = malloc((words + 1) * sizeof(uint32_t));
+        assert(pending_image != NULL);
+        memcpy(pending_image, image, words * sizeof(uint32_t));
+        pending_length = words;
+        image_cache_pending = path;
+        cache_report = report;
+        return NULL;
+}
+
+/*
+    image_cache_store
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        If segment 0 holds at least image_cache_min_words words, saves the
+        machine to image_cache_pending and stops waiting; smaller programs
+        are left for a later load_program
+    Expects:
+        called right after a load_program from a non-zero segment, with
+        image_cache_pending not NULL
+    ***************************************************************************
+*/
+void image_cache_store(Memory mem)
+{
+        assert(image_cache_pending != NULL);
+        if (segment_length(mem, 0) < image_cache_min_words)
+        {
+                return;
+        }
+        bool saved = snapshot_save_keyed(image_cache_pending, pending_image,
+                                         pending_length, mem);
+        if (cache_report)
+        {
+                fprintf(stderr, saved ? "um: saved image cache %s\n"
+                                      : "um: could not save image cache %s\n",
+                        image_cache_pending);
+        }
+        image_cache_disarm();
+}
+
+/*
+    image_cache_disarm
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Stops waiting for a load_program to cache and frees the copy of
+        the image. Called when the program does input or output, after
+        which its state no longer depends on the image alone.
+    ***************************************************************************
+*/
+void image_cache_disarm(void)
+{
+        free(image_cache_pending);
+        image_cache_pending = NULL;
+        free(pending_image);
+        pending_image = NULL;
+        pending_length = 0;
+}
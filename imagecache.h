@@ -0,0 +1,105 @@
+/**************************************************************
+ *
+ *                     imagecache.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     imagecache.h holds the definitions of the functions
+ *     used in imagecache.c, which remember the state of a
+ *     self-decompressing image (sandmark.umz, codex.umz) right
+ *     after it loads its decompressed code, so later runs of the
+ *     same image can start from there
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+/* Smallest segment, in words, whose load_program is worth caching */
+#define IMAGE_CACHE_MIN_WORDS 16384
+
+/* Cache entry that execute writes on the next large non-zero load_program, 
+   or NULL when nothing is waiting to be cached */
+extern char *image_cache_pending;
+
+/* Minimum length of segment 0, in words, for image_cache_store to save it */
+extern uint32_t image_cache_min_words;
+
+/*
+    image_cache_default_dir
+    ***************************************************************************
+    Input: 
+        none
+    Returns:
+        $UM_CACHE_DIR if it is set and not empty, otherwise NULL: the
+        cache is only used when it is asked for, since nothing removes
+        its entries
+    Effects:
+        None
+    ***************************************************************************
+*/
+const char *image_cache_default_dir(void);
+
+/*
+    image_cache_open
+    ***************************************************************************
+    Input: 
+        const char *dir: cache directory
+        Memory mem : freshly loaded machine; segment 0 holds the image
+        bool report: whether to report cache hits and stores on stderr
+    Returns:
+        the machine restored from the cache entry for this image if there
+        is one, otherwise NULL
+    Effects:
+        Names the entry after the fingerprint of segment 0, and uses it
+        only if it was saved from the same words (snapshot_restore_keyed).
+        On a hit the saved registers are loaded and the caller should
+        free mem and run the returned machine. On a miss, image_cache_pending
+        is set, and segment 0 copied, so that execute saves the entry once
+        the image has loaded its decompressed code.
+    Expects: 
+        dir and mem are not NULL and mem has not executed any instruction
+    ***************************************************************************
+*/
+Memory image_cache_open(const char *dir, Memory mem, bool report);
+
+/*
+    image_cache_store
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        none
+    Effects:
+        If segment 0 holds at least image_cache_min_words words, saves the
+        machine to image_cache_pending and stops waiting; smaller programs
+        are left for a later load_program
+    Expects: 
+        called right after a load_program from a non-zero segment, with
+        image_cache_pending not NULL
+    ***************************************************************************
+*/
+void image_cache_store(Memory mem);
+
+/*
+    image_cache_disarm
+    ***************************************************************************
+    Input: 
+        none
+    Returns:
+        none
+    Effects:
+        Stops waiting for a load_program to cache and frees the copy of
+        the image. Called when the program does input or output, after
+        which its state no longer depends on the image alone.
+    ***************************************************************************
+*/
+void image_cache_disarm(void);
+
+#endif
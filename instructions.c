@@ -24,12 +24,11 @@
 #include "instructions.h"
 #include "memory.h"
 
-uint32_t registers[8] = {0};
-
 /*
     conditional_move
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -41,7 +40,8 @@ uint32_t registers[8] = {0};
         None
     ***************************************************************************
 */
-void conditional_move(uint32_t rA, uint32_t rB, uint32_t rC)
+void conditional_move(uint32_t *registers,
+                      uint32_t rA, uint32_t rB, uint32_t rC)
 {
     if (registers[rC] != 0)
     {
@@ -54,6 +54,7 @@ void conditional_move(uint32_t rA, uint32_t rB, uint32_t rC)
     segmented_load
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -67,7 +68,8 @@ void conditional_move(uint32_t rA, uint32_t rB, uint32_t rC)
         None
     ***************************************************************************
 */
-void segmented_load(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
+void segmented_load(uint32_t *registers,
+                    uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
 {
     assert(mem != NULL);
     registers[rA] = value_in_segment(mem, registers[rB], registers[rC]);
@@ -77,6 +79,7 @@ void segmented_load(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
     segmented_store
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -90,7 +93,8 @@ void segmented_load(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void segmented_store(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
+void segmented_store(uint32_t *registers,
+                     uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
 {
     assert(mem != NULL);
     store_in_segment(mem, registers[rC], registers[rA], registers[rB]);
@@ -100,6 +104,7 @@ void segmented_store(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
     addition
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -111,7 +116,7 @@ void segmented_store(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem)
         None
     ***************************************************************************
 */
-void addition(uint32_t rA, uint32_t rB, uint32_t rC)
+void addition(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC)
 {
     registers[rA] = (uint32_t)((registers[rB] + registers[rC]));
 }
@@ -120,6 +125,7 @@ void addition(uint32_t rA, uint32_t rB, uint32_t rC)
     multiplication
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -131,7 +137,7 @@ void addition(uint32_t rA, uint32_t rB, uint32_t rC)
         None
     ***************************************************************************
 */
-void multiplication(uint32_t rA, uint32_t rB, uint32_t rC)
+void multiplication(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC)
 {
     uint32_t rB_plz = registers[rB];
     uint32_t rC_plz = registers[rC];
@@ -143,6 +149,7 @@ void multiplication(uint32_t rA, uint32_t rB, uint32_t rC)
     division
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -154,7 +161,7 @@ void multiplication(uint32_t rA, uint32_t rB, uint32_t rC)
         None
     ***************************************************************************
 */
-void division(uint32_t rA, uint32_t rB, uint32_t rC)
+void division(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC)
 {
     registers[rA] = (registers[rB] / registers[rC]);
 }
@@ -163,6 +170,7 @@ void division(uint32_t rA, uint32_t rB, uint32_t rC)
     nand
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -175,7 +183,7 @@ void division(uint32_t rA, uint32_t rB, uint32_t rC)
         None
     ***************************************************************************
 */
-void nand(uint32_t rA, uint32_t rB, uint32_t rC)
+void nand(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC)
 {
     registers[rA] = ~(registers[rB] & registers[rC]);
 }
@@ -189,7 +197,9 @@ void nand(uint32_t rA, uint32_t rB, uint32_t rC)
     Returns:
         None
     Effects:
-        frees all allocated memory and exits the program
+        frees all allocated memory and exits the program. The engines 
+        stop in front of a halt instruction (STOP_HALT) rather than calling
+        this, so that a machine can halt without ending the process.
     Expects:
         Memory struct pointer is not NULL
     ***************************************************************************
@@ -205,35 +215,39 @@ void halt(Memory mem)
     map_segment
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences,
                         and program counter
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
     Returns:
-        None
+        false if the map was refused (over the quota or out of memory),
+        true otherwise
     Effects:
         A new segment is created with a number of words equal to $r[C]
-        index of newly mapped segment is
+        and the index of the newly mapped segment is stored in $r[B]; a
+        refused map leaves the registers unchanged
     Expects:
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void map_segment(Memory mem, uint32_t rB, uint32_t rC)
+bool map_segment(uint32_t *registers, Memory mem, uint32_t rB, uint32_t rC)
 {
     assert(mem != NULL);
     uint32_t num_words = registers[rC];
-    // TODO remove prints
-    // printf("numwords %u\n", num_words);
     uint32_t new_index = map_segment_helper(mem, num_words);
-    // printf("index %u\n", new_index);
+    if (new_index == 0) {
+        return false;
+    }
     registers[rB] = new_index;
-    // printf("register[rB] %u\n", registers[rB]);
+    return true;
 }
 
 /*
     unmap_segment
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences,
                         and program counter
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -246,7 +260,7 @@ void map_segment(Memory mem, uint32_t rB, uint32_t rC)
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void unmap_segment(Memory mem, uint32_t rC)
+void unmap_segment(uint32_t *registers, Memory mem, uint32_t rC)
 {
     assert(mem != NULL);
     unmap_segment_helper(mem, registers[rC]);
@@ -256,49 +270,55 @@ void unmap_segment(Memory mem, uint32_t rC)
     output
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rC: value of C from unpacked 32-bit instruction
+        Memory mem : Memory struct whose output callback is used
     Returns:
         None
     Effects:
-        prints the value in $r[C] to stdout
+        writes the value in $r[C] to the machine's output (machine_output)
     Expects:
         value in $r[C] is between 0 and 255
     ***************************************************************************
 */
-void output(uint32_t rC)
+void output(uint32_t *registers, uint32_t rC, Memory mem)
 {
     assert(registers[rC] <= 255);
-    fprintf(stdout, "%c", (char)registers[rC]);
-    fflush(stdout);
+    machine_output(mem, (uint8_t)registers[rC]);
 }
 
 /*
     input
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rC: value of C from unpacked 32-bit instruction
+        Memory mem : Memory struct whose input callback is used
     Returns:
-        None
+        false if no input is available yet (UM_INPUT_WAIT), true otherwise
     Effects:
-        gets input from stdin and stores it in $r[C]
+        gets a byte from the machine's input (machine_input) and stores it
+        in $r[C]; end of input stores the all-ones word
     Expects:
-        ASCII value of inputted character must range from 0-255
+        None
     ***************************************************************************
 */
-void input(uint32_t rC)
+bool input(uint32_t *registers, uint32_t rC, Memory mem)
 {
-    int c = fgetc(stdin);
-    // TODO check cat.um eof
-    // assert(0 <= c && c <= 255);
+    int c = machine_input(mem);
+    if (c == UM_INPUT_WAIT) {
+        return false;
+    }
+    /* EOF (-1) becomes the all-ones word */
     registers[rC] = (uint32_t)c;
-
-    /* TODO LOAD EVERY BIT IS 1*/
+    return true;
 }
 
 /*
     load_program
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences,
                         and program counter
         uint32_t rB: value of C from unpacked 32-bit instruction
@@ -311,7 +331,7 @@ void input(uint32_t rC)
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void load_program(Memory mem, uint32_t rB, uint32_t rC)
+void load_program(uint32_t *registers, Memory mem, uint32_t rB, uint32_t rC)
 {
     assert(mem != NULL);
     rB = registers[rB];
@@ -323,6 +343,7 @@ void load_program(Memory mem, uint32_t rB, uint32_t rC)
     load_value
     ***************************************************************************
     Input:
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of C from unpacked 32-bit instruction
         uint32_t rB: value of C from unpacked 32-bit instruction
     Returns:
@@ -333,7 +354,7 @@ void load_program(Memory mem, uint32_t rB, uint32_t rC)
         ascii value of inputted character must range from 0-255
     ***************************************************************************
 */
-void load_value(uint32_t rA, uint32_t value)
+void load_value(uint32_t *registers, uint32_t rA, uint32_t value)
 {
     registers[rA] = value;
 }
\ No newline at end of file
@@ -15,21 +15,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <seq.h>
-#include <bitpack.h>
 #include <byteswap.h>
-#include <uarray.h>
 #include <assert.h>
+#include <stdbool.h>
 #include "memory.h"
 
 
-extern uint32_t registers[8];
-
-
 /*
     conditional_move
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -41,12 +37,14 @@ extern uint32_t registers[8];
         None
     ***************************************************************************
 */
-void conditional_move(uint32_t rA, uint32_t rB, uint32_t rC);
+void conditional_move(uint32_t *registers,
+                      uint32_t rA, uint32_t rB, uint32_t rC);
 
 /*
     segmented_load
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -60,12 +58,14 @@ void conditional_move(uint32_t rA, uint32_t rB, uint32_t rC);
         None
     ***************************************************************************
 */
-void segmented_load(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
+void segmented_load(uint32_t *registers,
+                    uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
 
 /*
     segmented_store
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -79,12 +79,14 @@ void segmented_load(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void segmented_store(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
+void segmented_store(uint32_t *registers,
+                     uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
 
 /*
     addition
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -96,12 +98,13 @@ void segmented_store(uint32_t rA, uint32_t rB, uint32_t rC, Memory mem);
         None
     ***************************************************************************
 */
-void addition(uint32_t rA, uint32_t rB, uint32_t rC);
+void addition(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC);
 
 /*
     multiplication
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -113,12 +116,14 @@ void addition(uint32_t rA, uint32_t rB, uint32_t rC);
         None
     ***************************************************************************
 */
-void multiplication(uint32_t rA, uint32_t rB, uint32_t rC);
+void multiplication(uint32_t *registers,
+                    uint32_t rA, uint32_t rB, uint32_t rC);
 
 /*
     division
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -130,12 +135,13 @@ void multiplication(uint32_t rA, uint32_t rB, uint32_t rC);
         None
     ***************************************************************************
 */
-void division(uint32_t rA, uint32_t rB, uint32_t rC);
+void division(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC);
 
 /*
     nand
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of A from unpacked 32-bit instruction 
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -148,7 +154,7 @@ void division(uint32_t rA, uint32_t rB, uint32_t rC);
         None
     ***************************************************************************
 */
-void nand(uint32_t rA, uint32_t rB, uint32_t rC);
+void nand(uint32_t *registers, uint32_t rA, uint32_t rB, uint32_t rC);
 
 /*
     halt
@@ -159,36 +165,42 @@ void nand(uint32_t rA, uint32_t rB, uint32_t rC);
     Returns:
         None
     Effects:
-        frees all allocated memory and exits the program
+        frees all allocated memory and exits the program. The engines 
+        stop in front of a halt instruction (STOP_HALT) rather than calling
+        this, so that a machine can halt without ending the process.
     Expects: 
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void halt(Memory mem);
+void halt(Memory mem) __attribute__((noreturn));
 
 /*
     map_segment
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
         uint32_t rB: value of B from unpacked 32-bit instruction
         uint32_t rC: value of C from unpacked 32-bit instruction
     Returns:
-        None
+        false if the map was refused (over the quota or out of memory),
+        true otherwise
     Effects:
         A new segment is created with a number of words equal to $r[C]
-        index of newly mapped segment is 
+        and the index of the newly mapped segment is stored in $r[B]; a
+        refused map leaves the registers unchanged
     Expects: 
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void map_segment(Memory mem, uint32_t rB, uint32_t rC);
+bool map_segment(uint32_t *registers, Memory mem, uint32_t rB, uint32_t rC);
 
 /*
     unmap_segment
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
         uint32_t rC: value of C from unpacked 32-bit instruction
@@ -201,42 +213,48 @@ void map_segment(Memory mem, uint32_t rB, uint32_t rC);
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void unmap_segment(Memory mem, uint32_t rC);
+void unmap_segment(uint32_t *registers, Memory mem, uint32_t rC);
 
 /*
     output
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rC: value of C from unpacked 32-bit instruction
+        Memory mem : Memory struct whose output callback is used
     Returns:
         None
     Effects:
-        prints the value in $r[C] to stdout
+        writes the value in $r[C] to the machine's output (machine_output)
     Expects: 
         value in $r[C] is between 0 and 255
     ***************************************************************************
 */
-void output(uint32_t rC);
+void output(uint32_t *registers, uint32_t rC, Memory mem);
 
 /*
     input
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rC: value of C from unpacked 32-bit instruction
+        Memory mem : Memory struct whose input callback is used
     Returns:
-        None
+        false if no input is available yet (UM_INPUT_WAIT), true otherwise
     Effects:
-        gets input from stdin and stores it in $r[C]
+        gets a byte from the machine's input (machine_input) and stores it
+        in $r[C]; end of input stores the all-ones word
     Expects: 
-        ASCII value of inputted character must range from 0-255
+        None
     ***************************************************************************
 */
-void input(uint32_t rC);
+bool input(uint32_t *registers, uint32_t rC, Memory mem);
 
 /*
     load_program
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
         uint32_t rB: value of C from unpacked 32-bit instruction
@@ -249,12 +267,13 @@ void input(uint32_t rC);
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void load_program(Memory mem, uint32_t rB, uint32_t rC);
+void load_program(uint32_t *registers, Memory mem, uint32_t rB, uint32_t rC);
 
 /*
     load_value
     ***************************************************************************
     Input: 
+        uint32_t *registers: the machine's registers (machine_registers)
         uint32_t rA: value of C from unpacked 32-bit instruction
         uint32_t rB: value of C from unpacked 32-bit instruction
     Returns:
@@ -265,4 +284,4 @@ void load_program(Memory mem, uint32_t rB, uint32_t rC);
         ascii value of inputted character must range from 0-255
     ***************************************************************************
 */
-void load_value(uint32_t rA, uint32_t value);
\ No newline at end of file
+void load_value(uint32_t *registers, uint32_t rA, uint32_t value);
\ No newline at end of file
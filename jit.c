@@ -0,0 +1,1123 @@
+/**************************************************************
+ *
+ *                     jit.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the x86-64 basic-block compiler. A
+ *     block of segment 0 runs up to the next load program,
+ *     halt, input or output and is translated into machine
+ *     code that keeps the eight UM registers in host registers.
+ *     Blocks end in a jump to the next block (load program of
+ *     segment 0) or a return to the driver loop here, which
+ *     performs input, output, halt, and load program of other
+ *     segments, and handles budgets and snapshots.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+#include "jit.h"
+#include "threaded.h"
+#include "instructions.h"
+#include "snapshot.h"
+#include "imagecache.h"
+#include "memory.h"
+
+#if defined(__x86_64__)
+
+/* Size of the code buffer, and the most instructions or bytes of code a
+   single block may take */
+#define JIT_CODE_BYTES  (32u << 20)
+#define JIT_BLOCK_WORDS 256
+#define JIT_BLOCK_BYTES (JIT_BLOCK_WORDS * 256 + 256)
+
+/* Machine state shared with the generated code, which addresses it
+   through r9 */
+typedef struct Jit_state {
+        uint32_t r[8];
+        uint32_t *program;
+        void **table;
+        uint64_t remaining;     /* instructions left before the next event */
+        uint32_t length;
+        uint32_t pc;            /* where to continue after an exit */
+        uint32_t reason;        /* why the generated code returned */
+        Segment_table segments; /* for loads and stores of other segments */
+} Jit_state;
+
+/* Why the generated code returned to execute_jit */
+enum Jit_exit {
+        EXIT_NEXT = 0,          /* continue at pc */
+        EXIT_BUDGET,            /* block at pc is longer than remaining */
+        EXIT_LOADP,             /* load program of a nonzero segment at pc */
+        EXIT_STALE,             /* a translated word was stored to */
+        EXIT_MAP_FAILED         /* the map at pc was refused */
+};
+
+/* x86-64 register numbers */
+enum Host_reg {
+        RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15,
+        NO_REG = -1
+};
+
+/* Host register holding each UM register. r8 holds the segment 0 base
+   and r9 the Jit_state; the rest are scratch. */
+static const int H[8] = { RBX, RBP, R12, R13, R14, R15, R10, R11 };
+
+/* x86 condition codes */
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5 };
+
+typedef void (*Enter_fn)(Jit_state *state, const void *code);
+
+/* The translation of each word of a segment 0, and whether the word is
+   part of any translation */
+typedef struct Jit_tables {
+        uint64_t image;         /* program image the tables are for */
+        uint64_t last_used;
+        void **table;
+        uint8_t *covered;
+        uint32_t length;
+        uint32_t capacity;
+} Jit_tables;
+
+/* The code buffer, the tables for the current segment 0, and the tables
+   of recent program images, which load_program may bring back. Each 
+   thread has its own, so machines on different threads can run at once;
+   machines that take turns on one thread retranslate each time.
+   version is segment 0's version (see program_version) when execute_jit
+   last returned; the translations are kept if it is the same on entry. */
+static __thread struct {
+        uint8_t *code;
+        size_t used;
+        size_t first_block;     /* bytes taken by the entry and exit code */
+        Enter_fn enter;
+        uint8_t *leave;
+        Jit_tables current;
+        Jit_tables saved[PROGRAM_IMAGES];
+        uint64_t clock;
+        Memory mem;
+        uint64_t version;
+        bool failed;
+} jit;
+
+/*
+    emit_u32, emit_u64
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        value: little-endian value to write
+    Returns:
+        address after the value
+    ***************************************************************************
+*/
+static uint8_t *emit_u32(uint8_t *p, uint32_t value)
+{
+        memcpy(p, &value, sizeof(value));
+        return p + sizeof(value);
+}
+
+static uint8_t *emit_u64(uint8_t *p, uint64_t value)
+{
+        memcpy(p, &value, sizeof(value));
+        return p + sizeof(value);
+}
+
+/*
+    emit_op
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int w: 1 for a 64-bit operation
+        int op: one-byte opcode, or 0x0fxx for a two-byte one
+        int reg, index, base: registers that need REX extension bits
+    Returns:
+        address after the opcode
+    Effects:
+        Writes a REX prefix, if one is needed, and the opcode
+    ***************************************************************************
+*/
+static uint8_t *emit_op(uint8_t *p, int w, int op, int reg, int index,
+                        int base)
+{
+        uint8_t rex = 0x40 | w << 3 | (reg & 8) >> 1 | (index & 8) >> 2 |
+                      (base & 8) >> 3;
+        if (rex != 0x40) {
+                *p++ = rex;
+        }
+        if (op > 0xff) {
+                *p++ = (uint8_t)(op >> 8);
+        }
+        *p++ = (uint8_t)op;
+        return p;
+}
+
+/*
+    emit_rr
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int w, op: as for emit_op
+        int reg: register (or opcode extension) in the ModRM reg field
+        int rm: register operand
+    Returns:
+        address after the instruction
+    ***************************************************************************
+*/
+static uint8_t *emit_rr(uint8_t *p, int w, int op, int reg, int rm)
+{
+        p = emit_op(p, w, op, reg, 0, rm);
+        *p++ = (uint8_t)(0xc0 | (reg & 7) << 3 | (rm & 7));
+        return p;
+}
+
+/*
+    emit_rm
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int w, op: as for emit_op
+        int reg: register (or opcode extension) in the ModRM reg field
+        int base, index: memory operand registers; index may be NO_REG
+        int scale: log2 of the index scale
+        int32_t disp: memory operand displacement
+    Returns:
+        address after the instruction
+    Effects:
+        Writes an instruction whose operand is [base + index << scale +
+        disp]
+    ***************************************************************************
+*/
+static uint8_t *emit_rm(uint8_t *p, int w, int op, int reg, int base,
+                        int index, int scale, int32_t disp)
+{
+        p = emit_op(p, w, op, reg, index == NO_REG ? 0 : index, base);
+        int mod = 2;
+        if (disp == 0 && (base & 7) != RBP) {
+                mod = 0;
+        } else if (disp >= -128 && disp <= 127) {
+                mod = 1;
+        }
+        if (index == NO_REG && (base & 7) != RSP) {
+                *p++ = (uint8_t)(mod << 6 | (reg & 7) << 3 | (base & 7));
+        } else {
+                *p++ = (uint8_t)(mod << 6 | (reg & 7) << 3 | RSP);
+                *p++ = (uint8_t)(scale << 6 |
+                                 ((index == NO_REG ? RSP : index) & 7) << 3 |
+                                 (base & 7));
+        }
+        if (mod == 1) {
+                *p++ = (uint8_t)disp;
+        } else if (mod == 2) {
+                p = emit_u32(p, (uint32_t)disp);
+        }
+        return p;
+}
+
+/* Field of the Jit_state as a memory operand */
+#define STATE(field) R9, NO_REG, 0, (int32_t)offsetof(Jit_state, field)
+
+/*
+    emit_mov_imm
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int reg: destination register
+        uint64_t value: value to load; 64 bits wide if it does not fit in 32
+    Returns:
+        address after the instruction
+    ***************************************************************************
+*/
+static uint8_t *emit_mov_imm(uint8_t *p, int reg, uint64_t value)
+{
+        if (value <= UINT32_MAX) {
+                p = emit_op(p, 0, 0xb8 + (reg & 7), 0, 0, reg);
+                return emit_u32(p, (uint32_t)value);
+        }
+        p = emit_op(p, 1, 0xb8 + (reg & 7), 0, 0, reg);
+        return emit_u64(p, value);
+}
+
+/*
+    emit_push, emit_pop
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int reg: register to push or pop
+    Returns:
+        address after the instruction
+    ***************************************************************************
+*/
+static uint8_t *emit_push(uint8_t *p, int reg)
+{
+        return emit_op(p, 0, 0x50 + (reg & 7), 0, 0, reg);
+}
+
+static uint8_t *emit_pop(uint8_t *p, int reg)
+{
+        return emit_op(p, 0, 0x58 + (reg & 7), 0, 0, reg);
+}
+
+/*
+    emit_jump
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int cc: condition code, or -1 for an unconditional jump
+        uint8_t **target: set to the address of the displacement, for
+                          patch_jump
+    Returns:
+        address after the instruction
+    ***************************************************************************
+*/
+static uint8_t *emit_jump(uint8_t *p, int cc, uint8_t **target)
+{
+        if (cc < 0) {
+                *p++ = 0xe9;
+        } else {
+                *p++ = 0x0f;
+                *p++ = (uint8_t)(0x80 + cc);
+        }
+        *target = p;
+        return emit_u32(p, 0);
+}
+
+/*
+    patch_jump
+    ***************************************************************************
+    Input:
+        uint8_t *at: displacement returned by emit_jump
+        const uint8_t *destination: where the jump goes
+    Returns:
+        none
+    ***************************************************************************
+*/
+static void patch_jump(uint8_t *at, const uint8_t *destination)
+{
+        emit_u32(at, (uint32_t)(int32_t)(destination - (at + 4)));
+}
+
+/*
+    emit_call
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        uintptr_t function: address of a C function
+    Returns:
+        address after the call
+    Effects:
+        Calls function, preserving the UM registers and r8 and r9. The
+        arguments must be loaded between the saves and the call, so the
+        call is split in two: emit_call_save and emit_call.
+    ***************************************************************************
+*/
+static uint8_t *emit_call_save(uint8_t *p)
+{
+        /* Four pushes keep the stack 16-byte aligned */
+        p = emit_push(p, R8);
+        p = emit_push(p, R9);
+        p = emit_push(p, R10);
+        return emit_push(p, R11);
+}
+
+static uint8_t *emit_call(uint8_t *p, uintptr_t function)
+{
+        p = emit_mov_imm(p, RAX, function);
+        p = emit_rr(p, 0, 0xff, 2, RAX);
+        p = emit_pop(p, R11);
+        p = emit_pop(p, R10);
+        p = emit_pop(p, R9);
+        return emit_pop(p, R8);
+}
+
+/*
+    emit_exit
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        uint32_t pc: where execution continues
+        enum Jit_exit reason: why the block returns
+    Returns:
+        address after the exit
+    Effects:
+        Writes code that returns to execute_jit
+    ***************************************************************************
+*/
+static uint8_t *emit_exit(uint8_t *p, uint32_t pc, enum Jit_exit reason)
+{
+        uint8_t *target;
+        p = emit_rm(p, 0, 0xc7, 0, STATE(pc));
+        p = emit_u32(p, pc);
+        p = emit_rm(p, 0, 0xc7, 0, STATE(reason));
+        p = emit_u32(p, reason);
+        p = emit_jump(p, -1, &target);
+        patch_jump(target, jit.leave);
+        return p;
+}
+
+/*
+    emit_refund
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        uint32_t count: number of instructions to give back
+    Returns:
+        address after the instruction
+    Effects:
+        Writes code that adds count back to the remaining budget, for a
+        block that leaves before its end
+    ***************************************************************************
+*/
+static uint8_t *emit_refund(uint8_t *p, uint32_t count)
+{
+        if (count == 0) {
+                return p;
+        }
+        p = emit_rm(p, 1, 0x81, 0, STATE(remaining));
+        return emit_u32(p, count);
+}
+
+/*
+    emit_segment_lookup
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        int id: register holding a segment id other than 0
+        int offset: register holding an address in that segment
+        uint8_t **slow: set to the displacements of the three jumps taken
+                        if id is not mapped or offset is not inside it
+    Returns:
+        address after the code
+    Effects:
+        Writes code that looks id up in the machine's segment table and
+        checks offset against the segment's length header, leaving the
+        segment's words in rdx
+    ***************************************************************************
+*/
+static uint8_t *emit_segment_lookup(uint8_t *p, int id, int offset,
+                                    uint8_t **slow)
+{
+        p = emit_rm(p, 1, 0x8b, RDX, STATE(segments.count));
+        p = emit_rm(p, 0, 0x3b, id, RDX, NO_REG, 0, 0);
+        p = emit_jump(p, CC_AE, &slow[0]);
+        p = emit_rm(p, 1, 0x8b, RDX, STATE(segments.segments));
+        p = emit_rm(p, 1, 0x8b, RDX, RDX, NO_REG, 0, 0);
+        p = emit_rm(p, 1, 0x8b, RDX, RDX, id, 3, 0);
+        p = emit_rr(p, 1, 0x85, RDX, RDX);
+        p = emit_jump(p, CC_E, &slow[1]);
+        p = emit_rm(p, 0, 0x3b, offset, RDX, NO_REG, 0, -4);
+        return emit_jump(p, CC_AE, &slow[2]);
+}
+
+/*
+    store_program_word
+    ***************************************************************************
+    Input:
+        uint32_t index: word of segment 0 to store to
+        uint32_t value: value to store
+    Returns:
+        whether the word is part of a translation
+    Effects:
+        Called from generated code for a store to segment 0
+    ***************************************************************************
+*/
+static uint32_t store_program_word(uint32_t index, uint32_t value)
+{
+        store_in_segment(jit.mem, value, 0, index);
+        return index < jit.current.length && jit.current.covered[index];
+}
+
+/*
+    emit_instruction
+    ***************************************************************************
+    Input:
+        uint8_t *p: where to write
+        uint32_t word: instruction to translate
+        uint32_t pc: address of word
+        uint32_t left: instructions after word in its block
+    Returns:
+        address after the translation
+    Effects:
+        Writes the machine code for one instruction that does not end a
+        block, or for the load program that does
+    ***************************************************************************
+*/
+static uint8_t *emit_instruction(uint8_t *p, uint32_t word, uint32_t pc,
+                                 uint32_t left)
+{
+        int a = H[(word >> 6) & 7];
+        int b = H[(word >> 3) & 7];
+        int c = H[word & 7];
+        uintptr_t mem = (uintptr_t)jit.mem;
+        uint8_t *slow, *done, *next, *over, *other, *checked[3];
+
+        switch (word >> 28) {
+        case 0:
+                /* test c, c; cmovne a, b */
+                p = emit_rr(p, 0, 0x85, c, c);
+                p = emit_rr(p, 0, 0x0f45, a, b);
+                break;
+        case 1:
+                /* Segment 0 and the other segments inline; an id that is
+                   not mapped or an address out of bounds through
+                   value_in_segment, which reports it */
+                p = emit_rr(p, 0, 0x85, b, b);
+                p = emit_jump(p, CC_NE, &other);
+                p = emit_rm(p, 0, 0x3b, c, STATE(length));
+                p = emit_jump(p, CC_AE, &over);
+                p = emit_rm(p, 0, 0x8b, RAX, R8, c, 2, 0);
+                p = emit_jump(p, -1, &done);
+                patch_jump(other, p);
+                p = emit_segment_lookup(p, b, c, checked);
+                p = emit_rm(p, 0, 0x8b, RAX, RDX, c, 2, 0);
+                p = emit_jump(p, -1, &next);
+                patch_jump(over, p);
+                for (int i = 0; i < 3; i++) {
+                        patch_jump(checked[i], p);
+                }
+                p = emit_call_save(p);
+                p = emit_mov_imm(p, RDI, mem);
+                p = emit_rr(p, 0, 0x89, b, RSI);
+                p = emit_rr(p, 0, 0x89, c, RDX);
+                p = emit_call(p, (uintptr_t)value_in_segment);
+                patch_jump(done, p);
+                patch_jump(next, p);
+                p = emit_rr(p, 0, 0x89, RAX, a);
+                break;
+        case 2:
+                /* Other segments inline; segment 0 through 
+                   store_program_word, which tells whether the store hit
+                   a translation */
+                p = emit_rr(p, 0, 0x85, a, a);
+                p = emit_jump(p, CC_E, &other);
+                p = emit_segment_lookup(p, a, b, checked);
+                p = emit_rm(p, 0, 0x89, c, RDX, b, 2, 0);
+                /* The segment no longer holds a cached program image */
+                p = emit_rm(p, 1, 0x8b, RDX, STATE(segments.image_count));
+                p = emit_rm(p, 0, 0x3b, a, RDX, NO_REG, 0, 0);
+                p = emit_jump(p, CC_AE, &done);
+                p = emit_rm(p, 1, 0x8b, RDX, STATE(segments.images));
+                p = emit_rm(p, 1, 0x8b, RDX, RDX, NO_REG, 0, 0);
+                p = emit_rm(p, 1, 0xc7, 0, RDX, a, 3, 0);
+                p = emit_u32(p, 0);
+                p = emit_jump(p, -1, &next);
+                for (int i = 0; i < 3; i++) {
+                        patch_jump(checked[i], p);
+                }
+                p = emit_call_save(p);
+                p = emit_mov_imm(p, RDI, mem);
+                p = emit_rr(p, 0, 0x89, c, RSI);
+                p = emit_rr(p, 0, 0x89, a, RDX);
+                p = emit_rr(p, 0, 0x89, b, RCX);
+                p = emit_call(p, (uintptr_t)store_in_segment);
+                p = emit_jump(p, -1, &over);
+                patch_jump(other, p);
+                p = emit_call_save(p);
+                p = emit_rr(p, 0, 0x89, b, RDI);
+                p = emit_rr(p, 0, 0x89, c, RSI);
+                p = emit_call(p, (uintptr_t)store_program_word);
+                p = emit_rr(p, 0, 0x85, RAX, RAX);
+                p = emit_jump(p, CC_E, &slow);
+                /* The rest of this block may be what was stored to */
+                p = emit_refund(p, left);
+                p = emit_exit(p, pc + 1, EXIT_STALE);
+                patch_jump(done, p);
+                patch_jump(next, p);
+                patch_jump(over, p);
+                patch_jump(slow, p);
+                break;
+        case 3:
+                p = emit_rr(p, 0, 0x89, b, RAX);
+                p = emit_rr(p, 0, 0x01, c, RAX);
+                p = emit_rr(p, 0, 0x89, RAX, a);
+                break;
+        case 4:
+                p = emit_rr(p, 0, 0x89, b, RAX);
+                p = emit_rr(p, 0, 0x0faf, RAX, c);
+                p = emit_rr(p, 0, 0x89, RAX, a);
+                break;
+        case 5:
+                p = emit_rr(p, 0, 0x89, b, RAX);
+                p = emit_rr(p, 0, 0x31, RDX, RDX);
+                p = emit_rr(p, 0, 0xf7, 6, c);
+                p = emit_rr(p, 0, 0x89, RAX, a);
+                break;
+        case 6:
+                p = emit_rr(p, 0, 0x89, b, RAX);
+                if (b != c) {
+                        p = emit_rr(p, 0, 0x21, c, RAX);
+                }
+                p = emit_rr(p, 0, 0xf7, 2, RAX);
+                p = emit_rr(p, 0, 0x89, RAX, a);
+                break;
+        case 8:
+                p = emit_call_save(p);
+                p = emit_mov_imm(p, RDI, mem);
+                p = emit_rr(p, 0, 0x89, c, RSI);
+                p = emit_call(p, (uintptr_t)map_segment_helper);
+                p = emit_rr(p, 0, 0x85, RAX, RAX);
+                p = emit_jump(p, CC_NE, &done);
+                /* Refused: leave in front of the map, which did not run */
+                p = emit_refund(p, left + 1);
+                p = emit_exit(p, pc, EXIT_MAP_FAILED);
+                patch_jump(done, p);
+                p = emit_rr(p, 0, 0x89, RAX, b);
+                break;
+        case 9:
+                p = emit_call_save(p);
+                p = emit_mov_imm(p, RDI, mem);
+                p = emit_rr(p, 0, 0x89, c, RSI);
+                p = emit_call(p, (uintptr_t)unmap_segment_helper);
+                break;
+        case 12:
+                p = emit_rr(p, 0, 0x85, b, b);
+                p = emit_jump(p, CC_E, &next);
+                p = emit_exit(p, pc, EXIT_LOADP);
+                patch_jump(next, p);
+                /* Jump to the target's translation, unless there is none
+                   or a snapshot was asked for; then leave with pc = eax */
+                p = emit_rr(p, 0, 0x89, c, RAX);
+                p = emit_mov_imm(p, RCX, (uintptr_t)&snapshot_requested);
+                p = emit_rm(p, 0, 0x83, 7, RCX, NO_REG, 0, 0);
+                *p++ = 0;
+                p = emit_jump(p, CC_NE, &slow);
+                p = emit_rm(p, 0, 0x3b, RAX, STATE(length));
+                p = emit_jump(p, CC_AE, &done);
+                p = emit_rm(p, 1, 0x8b, RCX, STATE(table));
+                p = emit_rm(p, 1, 0x8b, RCX, RCX, RAX, 3, 0);
+                p = emit_rr(p, 1, 0x85, RCX, RCX);
+                p = emit_jump(p, CC_E, &next);
+                p = emit_rr(p, 0, 0xff, 4, RCX);
+                patch_jump(slow, p);
+                patch_jump(done, p);
+                patch_jump(next, p);
+                p = emit_rm(p, 0, 0x89, RAX, STATE(pc));
+                p = emit_rm(p, 0, 0xc7, 0, STATE(reason));
+                p = emit_u32(p, EXIT_NEXT);
+                p = emit_jump(p, -1, &next);
+                patch_jump(next, jit.leave);
+                break;
+        case 13:
+                p = emit_mov_imm(p, H[(word >> 25) & 7], word & 0x1ffffff);
+                break;
+        default:
+                /* Opcodes 14 and 15 do nothing, as in execute_until */
+                break;
+        }
+        return p;
+}
+
+/*
+    emit_entry_code
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Writes the code at the start of the buffer that enters a block from
+        C (jit.enter) and returns from one (jit.leave)
+    ***************************************************************************
+*/
+static void emit_entry_code(void)
+{
+        static const int saved[6] = { RBX, RBP, R12, R13, R14, R15 };
+        uint8_t *p = jit.code;
+
+        /* enter(state, code): save the callee-saved registers, align the
+           stack, load the machine state and jump to code */
+        for (int i = 0; i < 6; i++) {
+                p = emit_push(p, saved[i]);
+        }
+        p = emit_rr(p, 1, 0x83, 5, RSP);
+        *p++ = 8;
+        p = emit_rr(p, 1, 0x89, RDI, R9);
+        p = emit_rm(p, 1, 0x8b, R8, STATE(program));
+        for (int i = 0; i < 8; i++) {
+                p = emit_rm(p, 0, 0x8b, H[i], R9, NO_REG, 0, 4 * i);
+        }
+        p = emit_rr(p, 0, 0xff, 4, RSI);
+
+        /* leave: store the registers and return */
+        jit.leave = p;
+        for (int i = 0; i < 8; i++) {
+                p = emit_rm(p, 0, 0x89, H[i], R9, NO_REG, 0, 4 * i);
+        }
+        p = emit_rr(p, 1, 0x83, 0, RSP);
+        *p++ = 8;
+        for (int i = 5; i >= 0; i--) {
+                p = emit_pop(p, saved[i]);
+        }
+        *p++ = 0xc3;
+
+        jit.enter = (Enter_fn)(uintptr_t)jit.code;
+        jit.first_block = (size_t)(p - jit.code);
+}
+
+/*
+    jit_start
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        whether there is a code buffer
+    Effects:
+        Maps the code buffer the first time it is called
+    ***************************************************************************
+*/
+static bool jit_start(void)
+{
+        if (jit.code != NULL || jit.failed) {
+                return !jit.failed;
+        }
+        void *code = mmap(NULL, JIT_CODE_BYTES,
+                          PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+                jit.failed = true;
+                return false;
+        }
+        jit.code = code;
+        emit_entry_code();
+        return true;
+}
+
+/*
+    reset_tables
+    ***************************************************************************
+    Input:
+        Jit_tables *tables: tables to reset
+        uint32_t length: number of words in segment 0
+    Returns:
+        none
+    Effects:
+        Sizes tables for length words, none of them translated
+    ***************************************************************************
+*/
+static void reset_tables(Jit_tables *tables, uint32_t length)
+{
+        if (tables->table == NULL || length > tables->capacity) {
+                free(tables->table);
+                free(tables->covered);
+                tables->table = malloc(((size_t)length + 1) *
+                                       sizeof(void *));
+                tables->covered = malloc((size_t)length + 1);
+                assert(tables->table != NULL && tables->covered != NULL);
+                tables->capacity = length;
+        }
+        tables->length = length;
+        memset(tables->table, 0, (size_t)length * sizeof(void *));
+        memset(tables->covered, 0, length);
+}
+
+/*
+    jit_flush
+    ***************************************************************************
+    Input:
+        Jit_state *state: state whose segment 0 the translations are for
+    Returns:
+        none
+    Effects:
+        Drops every translation, including those of saved program images, 
+        and sizes the tables for segment 0 as it is now
+    ***************************************************************************
+*/
+static void jit_flush(Jit_state *state)
+{
+        jit.used = jit.first_block;
+        for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                jit.saved[i].image = 0;
+        }
+        reset_tables(&jit.current, state->length);
+        state->table = jit.current.table;
+}
+
+/*
+    jit_switch_program
+    ***************************************************************************
+    Input:
+        Jit_state *state: state whose segment 0 was just replaced
+        uint64_t old_image: program image of the replaced segment 0
+        uint64_t new_image: program image of the new segment 0
+    Returns:
+        none
+    Effects:
+        Saves the translations of the old segment 0 under old_image, in
+        place of the least recently used saved tables, and brings back 
+        those of new_image if they were saved, or starts empty tables.
+        program_image retires an image id once segment 0 is modified from
+        it, so saved translations always match their image's words.
+    ***************************************************************************
+*/
+static void jit_switch_program(Jit_state *state, uint64_t old_image,
+                               uint64_t new_image)
+{
+        Jit_tables swap;
+        if (old_image != 0) {
+                Jit_tables *oldest = &jit.saved[0];
+                for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                        if (jit.saved[i].image == 0) {
+                                oldest = &jit.saved[i];
+                                break;
+                        }
+                        if (jit.saved[i].last_used < oldest->last_used) {
+                                oldest = &jit.saved[i];
+                        }
+                }
+                swap = *oldest;
+                *oldest = jit.current;
+                jit.current = swap;
+                oldest->image = old_image;
+                oldest->last_used = ++jit.clock;
+        }
+        for (int i = 0; new_image != 0 && i < PROGRAM_IMAGES; i++) {
+                Jit_tables *saved = &jit.saved[i];
+                if (saved->image == new_image &&
+                    saved->length == state->length) {
+                        swap = *saved;
+                        *saved = jit.current;
+                        jit.current = swap;
+                        saved->image = 0;
+                        state->table = jit.current.table;
+                        return;
+                }
+        }
+        reset_tables(&jit.current, state->length);
+        state->table = jit.current.table;
+}
+
+/*
+    translate
+    ***************************************************************************
+    Input:
+        Jit_state *state: machine state
+        uint32_t start: address of the first word of the block
+    Returns:
+        the block's code
+    Effects:
+        Translates the block at start, flushing every translation first if
+        the code buffer is full
+    Expects:
+        the word at start is not an input, output or halt
+    ***************************************************************************
+*/
+static void *translate(Jit_state *state, uint32_t start)
+{
+        if (jit.used + JIT_BLOCK_BYTES > JIT_CODE_BYTES) {
+                jit_flush(state);
+        }
+        const uint32_t *program = state->program;
+        uint32_t end = start;
+        while (end < state->length && end - start < JIT_BLOCK_WORDS) {
+                uint32_t opcode = program[end] >> 28;
+                if (opcode == 7 || opcode == 10 || opcode == 11) {
+                        break;
+                }
+                end++;
+                if (opcode == 12) {
+                        break;
+                }
+        }
+        uint32_t count = end - start;
+
+        uint8_t *code = jit.code + jit.used;
+        uint8_t *p = code;
+        uint8_t *over;
+        /* Charge the whole block against the budget up front */
+        p = emit_rm(p, 1, 0x81, 5, STATE(remaining));
+        p = emit_u32(p, count);
+        p = emit_jump(p, CC_B, &over);
+        for (uint32_t at = start; at < end; at++) {
+                p = emit_instruction(p, program[at], at, end - at - 1);
+                jit.current.covered[at] = 1;
+        }
+        if (end == start || program[end - 1] >> 28 != 12) {
+                p = emit_exit(p, end, EXIT_NEXT);
+        }
+        patch_jump(over, p);
+        p = emit_refund(p, count);
+        p = emit_exit(p, start, EXIT_BUDGET);
+
+        assert((size_t)(p - code) <= JIT_BLOCK_BYTES);
+        jit.used += (size_t)(p - code);
+        jit.current.table[start] = code;
+        return code;
+}
+
+/*
+    sync_out, sync_in
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        Jit_state *state: machine state
+    Returns:
+        none
+    Effects:
+        Copies the registers and program counter from state to mem, or 
+        back along with segment 0
+    ***************************************************************************
+*/
+static void sync_out(Memory mem, Jit_state *state)
+{
+        uint32_t *registers = machine_registers(mem);
+        for (int i = 0; i < 8; i++) {
+                registers[i] = state->r[i];
+        }
+        set_program_counter(mem, state->pc);
+}
+
+static void sync_in(Memory mem, Jit_state *state)
+{
+        uint32_t *registers = machine_registers(mem);
+        for (int i = 0; i < 8; i++) {
+                state->r[i] = registers[i];
+        }
+        state->program = program_words(mem, &state->length);
+        state->pc = program_counter(mem);
+}
+
+/*
+    jit_return
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        Jit_state *state: machine state
+        uint64_t count: instructions run by the translations
+    Returns:
+        none
+    Effects:
+        Copies state to mem, counts the instructions and notes segment 0's
+        version, which the translations are up to date with, for the next
+        call of execute_jit
+    ***************************************************************************
+*/
+static void jit_return(Memory mem, Jit_state *state, uint64_t count)
+{
+        sync_out(mem, state);
+        count_executed(mem, count);
+        jit.version = program_version(mem);
+}
+
+/*
+    execute_jit
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped, exactly as for execute_until
+    Effects:
+        Executes the program with the same semantics as the switch loop in
+        execute_until by translating each basic block of segment 0 into
+        x86-64 code the first time it runs. A block ends at a load program,
+        halt, input or output; blocks that end in a load program of segment
+        0 jump straight to the translation of their target. Translations
+        are dropped when a word they cover is stored to; when segment 0 is
+        replaced they are kept with its program image and come back if
+        the image is loaded again. They are also kept from one call to the
+        next, unless segment 0's version has changed in between. Runs on
+        execute_threaded if the host is not x86-64 or executable memory
+        cannot be had.
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_jit(Memory mem, uint64_t budget, bool pause_at_io)
+{
+        assert(mem != NULL);
+        if (!jit_start()) {
+                return execute_threaded(mem, budget, pause_at_io);
+        }
+        Jit_state state;
+        sync_in(mem, &state);
+        state.segments = segment_table(mem);
+        /* The generated code has mem built in; the translations are kept
+           unless segment 0 has changed since the last call */
+        if (mem != jit.mem || program_version(mem) != jit.version) {
+                jit.mem = mem;
+                jit_flush(&state);
+        } else {
+                state.table = jit.current.table;
+        }
+
+        uint64_t executed = 0;
+        /* Instructions run by execute_threaded, which counts its own */
+        uint64_t interpreted = 0;
+        uint64_t next_event = snapshot_at < budget ? snapshot_at : budget;
+        uint32_t *r = state.r;
+        for (;;) {
+                if (state.pc >= state.length) {
+                        jit_return(mem, &state, executed - interpreted);
+                        return STOP_END;
+                }
+                if (executed == next_event) {
+                        if (executed == budget) {
+                                jit_return(mem, &state,
+                                           executed - interpreted);
+                                return STOP_BUDGET;
+                        }
+                        /* executed == snapshot_at */
+                        next_event = budget;
+                        sync_out(mem, &state);
+                        snapshot_take(mem, executed);
+                } else if (__builtin_expect(snapshot_requested, 0)) {
+                        sync_out(mem, &state);
+                        snapshot_take(mem, executed);
+                }
+
+                uint32_t word = state.program[state.pc];
+                uint32_t opcode = word >> 28;
+                if (opcode == 7 || opcode == 10 || opcode == 11) {
+                        int input = 0;
+                        if (opcode == 11 && !pause_at_io) {
+                                input = machine_input(mem);
+                        }
+                        if (opcode == 7 || (opcode == 11 && (pause_at_io ||
+                                            input == UM_INPUT_WAIT))) {
+                                jit_return(mem, &state,
+                                           executed - interpreted);
+                                return opcode == 7 ? STOP_HALT : STOP_INPUT;
+                        }
+                        executed++;
+                        state.pc++;
+                        if (opcode == 10) {
+                                assert(r[word & 7] <= 255);
+                                machine_output(mem, (uint8_t)r[word & 7]);
+                        } else {
+                                /* EOF (-1) becomes the all-ones word */
+                                r[word & 7] = (uint32_t)input;
+                        }
+                        if (image_cache_pending != NULL) {
+                                image_cache_disarm();
+                        }
+                        continue;
+                }
+
+                void *code = jit.current.table[state.pc];
+                if (code == NULL) {
+                        code = translate(&state, state.pc);
+                }
+                state.remaining = next_event - executed;
+                jit.enter(&state, code);
+                executed = next_event - state.remaining;
+
+                if (state.reason == EXIT_STALE) {
+                        jit_flush(&state);
+                } else if (state.reason == EXIT_MAP_FAILED) {
+                        jit_return(mem, &state, executed - interpreted);
+                        return STOP_MAP_FAILED;
+                } else if (state.reason == EXIT_LOADP) {
+                        word = state.program[state.pc];
+                        uint32_t target = r[word & 7];
+                        uint64_t old_image = program_image(mem);
+                        load_program_helper(mem, r[(word >> 3) & 7], target);
+                        state.program = program_words(mem, &state.length);
+                        state.pc = target;
+                        jit_switch_program(&state, old_image,
+                                           program_image(mem));
+                        if (image_cache_pending != NULL) {
+                                sync_out(mem, &state);
+                                image_cache_store(mem);
+                        }
+                } else if (state.reason == EXIT_BUDGET) {
+                        /* The event falls inside this block: interpret up
+                           to it. The interpreter may store to segment 0
+                           behind the translations' backs, which changes
+                           its version. snapshot_at is only touched when
+                           set, so that machines running on other threads
+                           never see it change. */
+                        uint64_t saved_at = snapshot_at;
+                        uint64_t version = program_version(mem);
+                        sync_out(mem, &state);
+                        if (saved_at != UINT64_MAX) {
+                                snapshot_at = UINT64_MAX;
+                        }
+                        Stop_reason reason = execute_threaded(mem,
+                                        next_event - executed, pause_at_io);
+                        if (saved_at != UINT64_MAX) {
+                                snapshot_at = saved_at;
+                        }
+                        sync_in(mem, &state);
+                        if (program_version(mem) != version) {
+                                jit_flush(&state);
+                        }
+                        if (reason != STOP_BUDGET) {
+                                jit_return(mem, &state,
+                                           executed - interpreted);
+                                return reason;
+                        }
+                        interpreted += next_event - executed;
+                        executed = next_event;
+                }
+        }
+}
+
+/*
+    jit_prepare
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Maps the calling thread's code buffer now rather than on the first
+        run, so that the first run is not charged for it
+    ***************************************************************************
+*/
+void jit_prepare(void)
+{
+        jit_start();
+}
+
+/*
+    jit_release
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Unmaps the calling thread's code buffer and frees its translation
+        tables; the next run starts from scratch
+    ***************************************************************************
+*/
+void jit_release(void)
+{
+        if (jit.code != NULL) {
+                munmap(jit.code, JIT_CODE_BYTES);
+        }
+        free(jit.current.table);
+        free(jit.current.covered);
+        for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                free(jit.saved[i].table);
+                free(jit.saved[i].covered);
+        }
+        memset(&jit, 0, sizeof(jit));
+}
+
+#else
+
+Stop_reason execute_jit(Memory mem, uint64_t budget, bool pause_at_io)
+{
+        return execute_threaded(mem, budget, pause_at_io);
+}
+
+void jit_prepare(void)
+{
+}
+
+void jit_release(void)
+{
+}
+
+#endif
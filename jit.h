@@ -0,0 +1,77 @@
+/**************************************************************
+ *
+ *                     jit.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     jit.h holds the definition of the x86-64 basic-block
+ *     compiler in jit.c
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "lilum.h"
+
+#ifndef JIT_H
+#define JIT_H
+
+/*
+    execute_jit
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped, exactly as for execute_until
+    Effects:
+        Executes the program with the same semantics as the switch loop in
+        execute_until by translating each basic block of segment 0 into
+        x86-64 code the first time it runs. A block ends at a load program,
+        halt, input or output; blocks that end in a load program of segment
+        0 jump straight to the translation of their target. Translations
+        are dropped when a word they cover is stored to; when segment 0 is
+        replaced they are kept with its program image and come back if
+        the image is loaded again. They are also kept from one call to the
+        next, unless segment 0's version has changed in between. Runs on
+        execute_threaded if the host is not x86-64 or executable memory
+        cannot be had.
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_jit(Memory mem, uint64_t budget, bool pause_at_io);
+
+/*
+    jit_prepare
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Maps the calling thread's code buffer now rather than on the first
+        run, so that the first run is not charged for it
+    ***************************************************************************
+*/
+void jit_prepare(void);
+
+/*
+    jit_release
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Unmaps the calling thread's code buffer and frees its translation
+        tables; the next run starts from scratch
+    ***************************************************************************
+*/
+void jit_release(void);
+
+#endif
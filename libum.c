@@ -0,0 +1,230 @@
+/**************************************************************
+ *
+ *                     libum.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     libum.c implements the embedding interface in libum.h on
+ *     top of the Memory module and execute_until. All machine
+ *     state lives in the Memory handle, so a Um is just that
+ *     handle plus its I/O settings.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <assert.h>
+#include "libum.h"
+#include "memory.h"
+#include "lilum.h"
+#include "engine.h"
+
+struct Um {
+        Memory mem;
+        Um_input_fn input;
+        Um_output_fn output;
+        void *context;
+        uint64_t quota_words;
+};
+
+/* Machines made by um_new and not yet freed on this thread; the engine's
+   state for the thread is set up with the first and released with the 
+   last */
+static __thread unsigned live_machines = 0;
+
+/*
+    um_new
+    ***************************************************************************
+    Input: 
+        none
+    Returns: 
+        a machine with an empty program and the registers cleared that reads
+        stdin and writes stdout
+    Effects: 
+        sets up the calling thread's state for the engine selected for the
+        process, if this is its only machine
+    ***************************************************************************
+*/
+Um um_new(void)
+{
+        Um um = malloc(sizeof(*um));
+        assert(um != NULL);
+        if (live_machines++ == 0) {
+                engine->init();
+        }
+        um->mem = create_segment0(0);
+        um->input = NULL;
+        um->output = NULL;
+        um->context = NULL;
+        um->quota_words = 0;
+        return um;
+}
+
+/*
+    um_free
+    ***************************************************************************
+    Input: 
+        Um um: machine to free, may be NULL
+    Effects: 
+        frees the machine and all of its segments, and releases the calling
+        thread's engine state with its last machine
+    Expects: 
+        called on the thread that made um
+    ***************************************************************************
+*/
+void um_free(Um um)
+{
+        if (um == NULL) {
+                return;
+        }
+        free_segments(um->mem);
+        free(um);
+        if (--live_machines == 0) {
+                engine->teardown();
+        }
+}
+
+/*
+    um_load
+    ***************************************************************************
+    Input: 
+        Um um: machine to load into
+        const void *image: a .um image (big-endian words)
+        size_t size: number of bytes in image
+    Returns: 
+        true if the image held at least one instruction
+    Effects: 
+        replaces the machine's program, segments and registers with a fresh
+        machine running image; the I/O callbacks and quota are kept
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+bool um_load(Um um, const void *image, size_t size)
+{
+        assert(um != NULL);
+        free_segments(um->mem);
+        um->mem = create_segment0(size / sizeof(uint32_t));
+        set_machine_io(um->mem, um->input, um->output, um->context);
+        set_memory_quota(um->mem, um->quota_words);
+        return load_instructions_buffer(image, size, um->mem) > 0;
+}
+
+/*
+    um_set_io
+    ***************************************************************************
+    Input: 
+        Um um: machine to configure
+        Um_input_fn input: called by the input instruction, NULL for stdin
+        Um_output_fn output: called by the output instruction, NULL for 
+                             stdout
+        void *context: passed to both callbacks
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+void um_set_io(Um um, Um_input_fn input, Um_output_fn output, void *context)
+{
+        assert(um != NULL);
+        um->input = input;
+        um->output = output;
+        um->context = context;
+        set_machine_io(um->mem, input, output, context);
+}
+
+/*
+    um_run_for
+    ***************************************************************************
+    Input: 
+        Um um: machine to run
+        uint64_t budget: maximum number of instructions to execute
+    Returns: 
+        why the machine stopped. A halted or ended machine stays stopped 
+        until um_load is called again; the other states can be resumed with
+        another call.
+    Effects: 
+        runs the machine on the engine selected for the process
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+Um_status um_run_for(Um um, uint64_t budget)
+{
+        assert(um != NULL);
+        switch (execute_until(um->mem, budget, false)) {
+        case STOP_HALT:
+                return UM_HALTED;
+        case STOP_INPUT:
+                return UM_WAITING_INPUT;
+        case STOP_BUDGET:
+                return UM_BUDGET_EXHAUSTED;
+        case STOP_MAP_FAILED:
+                return UM_MAP_FAILED;
+        default:
+                return UM_ENDED;
+        }
+}
+
+/*
+    um_register
+    ***************************************************************************
+    Input: 
+        Um um: machine to inspect
+        unsigned index: register number, 0 to 7
+    Returns: 
+        the current value of the register
+    ***************************************************************************
+*/
+uint32_t um_register(Um um, unsigned index)
+{
+        assert(um != NULL && index < 8);
+        return machine_registers(um->mem)[index];
+}
+
+/*
+    um_set_quota
+    ***************************************************************************
+    Input: 
+        Um um: machine to limit
+        uint64_t words: most words the segments other than segment 0 may
+                        hold at once, 0 for no limit
+    Effects: 
+        a map that would go over the quota stops um_run_for in front of it
+        with UM_MAP_FAILED rather than mapping anything; the quota is kept
+        by um_load
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+void um_set_quota(Um um, uint64_t words)
+{
+        assert(um != NULL);
+        um->quota_words = words;
+        set_memory_quota(um->mem, words);
+}
+
+/*
+    um_memory
+    ***************************************************************************
+    Input: 
+        Um um: machine to inspect
+        Um_memory *memory: set to the machine's memory counters
+    Effects: 
+        fills in memory; cheap enough to call between any two um_run_for
+        calls. um_load starts the counters over.
+    Expects: 
+        um and memory are not NULL
+    ***************************************************************************
+*/
+void um_memory(Um um, Um_memory *memory)
+{
+        assert(um != NULL && memory != NULL);
+        Memory_stats stats;
+        memory_stats(um->mem, &stats);
+        memory->live_segments = stats.live_segments;
+        memory->mapped_words = stats.mapped_words;
+        memory->peak_words = stats.peak_words;
+        memory->maps = stats.maps;
+        memory->unmaps = stats.unmaps;
+        memory->failed_maps = stats.failed_maps;
+}
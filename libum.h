@@ -0,0 +1,179 @@
+/**************************************************************
+ *
+ *                     libum.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     libum.h is the embedding interface of libum.a: it lets a
+ *     host program run any number of independent machines, each
+ *     with its own segments, registers and I/O callbacks. It
+ *     does not need the CII headers.
+ *
+ **************************************************************/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef LIBUM_H
+#define LIBUM_H
+
+typedef struct Um *Um;
+
+/* Why um_run_for returned */
+typedef enum Um_status {
+        UM_HALTED = 0,          /* the program reached a halt    */
+        UM_WAITING_INPUT,       /* the input callback returned UM_INPUT_WAIT */
+        UM_BUDGET_EXHAUSTED,    /* the instruction budget ran out */
+        UM_ENDED,               /* the program counter left segment0 */
+        UM_MAP_FAILED           /* a map was over the quota or out of
+                                   memory */
+} Um_status;
+
+/* Returned by an input callback that has no byte yet; the machine stops in
+   front of the input instruction and retries it on the next um_run_for */
+#define UM_INPUT_WAIT (-2)
+
+/* A machine's memory counters (see um_memory). Words are counted in the
+   segments other than segment 0. */
+typedef struct Um_memory {
+        uint32_t live_segments;
+        uint64_t mapped_words;
+        uint64_t peak_words;
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t failed_maps;
+} Um_memory;
+
+/* Input callbacks return a byte, EOF at end of input, or UM_INPUT_WAIT */
+typedef int (*Um_input_fn)(void *context);
+typedef void (*Um_output_fn)(uint8_t byte, void *context);
+
+/*
+    um_new
+    ***************************************************************************
+    Input: 
+        none
+    Returns: 
+        a machine with an empty program and the registers cleared that reads
+        stdin and writes stdout
+    Effects: 
+        sets up the calling thread's state for the engine selected for the
+        process, if this is its only machine
+    ***************************************************************************
+*/
+Um um_new(void);
+
+/*
+    um_free
+    ***************************************************************************
+    Input: 
+        Um um: machine to free, may be NULL
+    Effects: 
+        frees the machine and all of its segments, and releases the calling
+        thread's engine state with its last machine
+    Expects: 
+        called on the thread that made um
+    ***************************************************************************
+*/
+void um_free(Um um);
+
+/*
+    um_load
+    ***************************************************************************
+    Input: 
+        Um um: machine to load into
+        const void *image: a .um image (big-endian words)
+        size_t size: number of bytes in image
+    Returns: 
+        true if the image held at least one instruction
+    Effects: 
+        replaces the machine's program, segments and registers with a fresh
+        machine running image; the I/O callbacks are kept
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+bool um_load(Um um, const void *image, size_t size);
+
+/*
+    um_set_io
+    ***************************************************************************
+    Input: 
+        Um um: machine to configure
+        Um_input_fn input: called by the input instruction, NULL for stdin
+        Um_output_fn output: called by the output instruction, NULL for 
+                             stdout
+        void *context: passed to both callbacks
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+void um_set_io(Um um, Um_input_fn input, Um_output_fn output, void *context);
+
+/*
+    um_run_for
+    ***************************************************************************
+    Input: 
+        Um um: machine to run
+        uint64_t budget: maximum number of instructions to execute
+    Returns: 
+        why the machine stopped. A halted or ended machine stays stopped 
+        until um_load is called again; the other states can be resumed with
+        another call.
+    Effects: 
+        runs the machine on the engine selected for the process. Machines
+        may run on different threads at the same time as long as each is 
+        only run by one thread at a time.
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+Um_status um_run_for(Um um, uint64_t budget);
+
+/*
+    um_register
+    ***************************************************************************
+    Input: 
+        Um um: machine to inspect
+        unsigned index: register number, 0 to 7
+    Returns: 
+        the current value of the register
+    ***************************************************************************
+*/
+uint32_t um_register(Um um, unsigned index);
+
+/*
+    um_set_quota
+    ***************************************************************************
+    Input: 
+        Um um: machine to limit
+        uint64_t words: most words the segments other than segment 0 may
+                        hold at once, 0 for no limit
+    Effects: 
+        a map that would go over the quota stops um_run_for in front of it
+        with UM_MAP_FAILED rather than mapping anything; the quota is kept
+        by um_load
+    Expects: 
+        um is not NULL
+    ***************************************************************************
+*/
+void um_set_quota(Um um, uint64_t words);
+
+/*
+    um_memory
+    ***************************************************************************
+    Input: 
+        Um um: machine to inspect
+        Um_memory *memory: set to the machine's memory counters
+    Effects: 
+        fills in memory; cheap enough to call between any two um_run_for
+        calls. um_load starts the counters over.
+    Expects: 
+        um and memory are not NULL
+    ***************************************************************************
+*/
+void um_memory(Um um, Um_memory *memory);
+
+#endif
@@ -19,12 +19,33 @@
 #include <byteswap.h>
 #include <uarray.h>
 #include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "lilum.h"
 #include "memory.h"
 #include "instructions.h"
+#include "snapshot.h"
+#include "imagecache.h"
+#include "engine.h"
+#include "profile.h"
 
 const int FAILURE = 1;
 
+/* Bytes requested per read() when streaming a program from a pipe */
+#define STREAM_CHUNK (1 << 20)
+
+/* Sixteen bytes (four UM words) converted per step of swap_words; the mask
+   reverses the bytes within each 32-bit lane */
+typedef uint8_t Word_bytes __attribute__((vector_size(16)));
+static const Word_bytes SWAP_MASK = { 3, 2, 1, 0, 7, 6, 5, 4,
+                                      11, 10, 9, 8, 15, 14, 13, 12 };
+
 /*
     open_file
     ***************************************************************************
@@ -61,15 +82,16 @@ FILE *open_file(char *filename)
         Memory mem : Memory struct that holds the segments, free sequences,
                         and program counter
     Returns:
-        none
+        number of words added to segment0
     Effects:
         Read the contents of the file into 32-bit words and fills segment0 with
         those words
     Expects:
     ***************************************************************************
 */
-void read_instructions(FILE *input_file, Memory mem)
+size_t read_instructions(FILE *input_file, Memory mem)
 {
+        size_t count = 0;
         while (!feof(input_file))
         {
                 int parta = getc(input_file);
@@ -100,25 +122,294 @@ void read_instructions(FILE *input_file, Memory mem)
                 word = Bitpack_newu(word, 8, 0, (uint32_t)partd);
 
                 append_segment0(mem, word);
+                count++;
         }
         fclose(input_file);
+        return count;
 }
 
 /*
-    execute.c
+    swap_words
     ***************************************************************************
     Input:
+        uint32_t *dst: destination for count host-order words
+        const uint32_t *src: count big-endian words, as stored in a .um file
+        size_t count: number of words to convert
+    Returns:
+        none
+    Effects:
+        Converts every word of src to host order and writes it to dst, four
+        words at a time through a vector byte shuffle
+    Expects:
+        dst and src are either the same array or do not overlap
+    ***************************************************************************
+*/
+static void swap_words(uint32_t *dst, const uint32_t *src, size_t count)
+{
+        size_t i = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        for (; i + 4 <= count; i += 4) {
+                Word_bytes bytes;
+                memcpy(&bytes, src + i, sizeof(bytes));
+                bytes = __builtin_shuffle(bytes, SWAP_MASK);
+                memcpy(dst + i, &bytes, sizeof(bytes));
+        }
+        for (; i < count; i++) {
+                dst[i] = __builtin_bswap32(src[i]);
+        }
+#else
+        memmove(dst, src, count * sizeof(uint32_t));
+        (void) i;
+#endif
+}
+
+/*
+    elapsed_seconds
+    ***************************************************************************
+    Input:
+        struct timespec *start: earlier CLOCK_MONOTONIC reading
+    Returns:
+        seconds elapsed since start
+    ***************************************************************************
+*/
+static double elapsed_seconds(struct timespec *start)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (double)(now.tv_sec - start->tv_sec) +
+               (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+    stream_instructions
+    ***************************************************************************
+    Input:
+        int fd: open descriptor positioned at the start of a .um image
         Memory mem : Memory struct that holds the segments, free sequences,
                         and program counter
     Returns:
-        none
+        number of words added to segment0
+    Effects:
+        Reads fd to end of file in large chunks into a growable byte buffer,
+        then converts it into segment0 with load_instructions_buffer, which
+        sizes segment0 exactly once the image's length is known. No size
+        needs to be known in advance, so pipes, sockets and terminals work
+        as well as regular files. Exits with an error if a read fails.
+    Expects:
+        fd is open for reading
+    ***************************************************************************
+*/
+static size_t stream_instructions(int fd, Memory mem)
+{
+        size_t capacity = STREAM_CHUNK;
+        size_t filled = 0;
+        unsigned char *buffer = malloc(capacity);
+        assert(buffer != NULL);
+
+        for (;;)
+        {
+                if (capacity - filled < STREAM_CHUNK)
+                {
+                        capacity *= 2;
+                        buffer = realloc(buffer, capacity);
+                        assert(buffer != NULL);
+                }
+                ssize_t got = read(fd, buffer + filled, capacity - filled);
+                if (got == 0)
+                {
+                        break;
+                }
+                if (got < 0)
+                {
+                        if (errno == EINTR)
+                        {
+                                continue;
+                        }
+                        perror("um: read");
+                        exit(FAILURE);
+                }
+                filled += (size_t)got;
+        }
+
+        size_t count = load_instructions_buffer(buffer, filled, mem);
+        free(buffer);
+        return count;
+}
+
+/*
+    load_instructions_buffer
+    ***************************************************************************
+    Input:
+        const void *image: a .um image (big-endian words) in memory
+        size_t size: number of bytes in image
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        number of words added to segment0
+    Effects:
+        Converts the image to host order in a single pass, writing it
+        straight into the end of segment0 (extend_segment0), so the image
+        is never copied a second time. A trailing partial word is ignored,
+        as in read_instructions.
+    Expects:
+        image is not NULL unless size is 0
+    ***************************************************************************
+*/
+size_t load_instructions_buffer(const void *image, size_t size, Memory mem)
+{
+        assert(image != NULL || size == 0);
+        size_t count = size / sizeof(uint32_t);
+        swap_words(extend_segment0(mem, count), image, count);
+        return count;
+}
+
+/*
+    map_instructions
+    ***************************************************************************
+    Input:
+        int fd: open descriptor for a regular .um file
+        off_t size: size of the file in bytes
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        number of words added to segment0, or 0 if the file could not be
+        mapped
+    Effects:
+        Maps the file into memory and converts the whole image from big-endian
+        to host order in a single pass, then fills segment0 with the result
+    Expects:
+        size is at least one word
+    ***************************************************************************
+*/
+static size_t map_instructions(int fd, off_t size, Memory mem)
+{
+        void *image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image == MAP_FAILED)
+        {
+                return 0;
+        }
+        madvise(image, size, MADV_SEQUENTIAL);
+
+        size_t count = load_instructions_buffer(image, size, mem);
+        munmap(image, size);
+        return count;
+}
+
+/*
+    load_instructions_fd
+    ***************************************************************************
+    Input:
+        int fd: open descriptor for a .um image
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        bool report: whether to print load throughput to stderr
+    Returns:
+        number of words added to segment0
+    Effects:
+        Fills segment0 with the image read from fd. A regular file read from
+        its beginning is memory-mapped; anything else (pipes, sockets,
+        devices, or a file that has already been partly read) is streamed
+        with read(). The descriptor is left open.
+    Expects:
+        fd is open for reading
+    ***************************************************************************
+*/
+size_t load_instructions_fd(int fd, Memory mem, bool report)
+{
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        size_t count = 0;
+        struct stat file_status;
+        if (fstat(fd, &file_status) == 0 && S_ISREG(file_status.st_mode) &&
+            file_status.st_size >= (off_t)sizeof(uint32_t) &&
+            lseek(fd, 0, SEEK_CUR) == 0)
+        {
+                count = map_instructions(fd, file_status.st_size, mem);
+        }
+        if (count == 0)
+        {
+                count = stream_instructions(fd, mem);
+        }
+
+        if (report)
+        {
+                double seconds = elapsed_seconds(&start);
+                double megabytes = (double)(count * sizeof(uint32_t)) / 1e6;
+                fprintf(stderr, "um: loaded %zu words (%.2f MB) in %.3f ms, "
+                                "%.1f MB/s\n", count, megabytes,
+                        seconds * 1e3,
+                        seconds > 0 ? megabytes / seconds : 0.0);
+        }
+        return count;
+}
+
+/*
+    load_instructions
+    ***************************************************************************
+    Input:
+        char *filename: name of the .um file to load, or "-" for stdin
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        bool report: whether to print load throughput to stderr
+    Returns:
+        number of words added to segment0
     Effects:
-        executes instruction based on opcode from 32-bit word
+        Opens the file and loads it with load_instructions_fd. Exits with an
+        error if the file cannot be opened.
+    Expects:
+        filename is not NULL
+    ***************************************************************************
+*/
+size_t load_instructions(char *filename, Memory mem, bool report)
+{
+        assert(filename != NULL);
+        if (strcmp(filename, "-") == 0)
+        {
+                return load_instructions_fd(STDIN_FILENO, mem, report);
+        }
+
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+                fprintf(stderr, "%s: ", filename);
+                fprintf(stderr, "No such file or directory\n");
+                exit(FAILURE);
+        }
+        size_t count = load_instructions_fd(fd, mem, report);
+        close(fd);
+        return count;
+}
+
+/*
+    execute_switch
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped: STOP_END if the program counter ran off the
+        end of segment0, STOP_BUDGET once budget instructions have run, 
+        STOP_HALT when the next instruction is a halt, and STOP_INPUT when
+        it is an input and either pause_at_io is set or the input callback 
+        has nothing yet (UM_INPUT_WAIT), and STOP_MAP_FAILED when it is a
+        map that map_segment_helper refused. The program counter is left at
+        the instruction that was not executed, so calling again resumes
+        there.
+    Effects:
+        The reference engine ("switch" in engine.c), which the others must
+        agree with: executes instruction based on opcode from 32-bit word,
+        fetching and decoding each word as it goes. Before each
+        instruction, saves a snapshot if one was requested by signal or
+        snapshot_at instructions have been executed. Saves the image cache
+        entry, if one is pending, after a large load_program.
     Expects:
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-void execute(Memory mem)
+Stop_reason execute_switch(Memory mem, uint64_t budget, bool pause_at_io)
 {
         /* loop and increment the counter, then execute each instruction */
         uint64_t word;
@@ -127,11 +418,34 @@ void execute(Memory mem)
         uint32_t rB;
         uint32_t rC;
         uint32_t value = 0;
+        uint64_t executed = 0;
+        uint32_t *registers = machine_registers(mem);
 
         while (instructions_complete(mem))
         {
+                if (__builtin_expect(snapshot_requested ||
+                                     executed == snapshot_at, 0))
+                {
+                        snapshot_take(mem, executed);
+                }
+                if (executed == budget)
+                {
+                        count_executed(mem, executed);
+                        return STOP_BUDGET;
+                }
                 word = (uint64_t)instruction(mem);
                 opcode = (uint32_t)Bitpack_getu(word, 4, 28);
+                if (opcode == 7 || (pause_at_io && opcode == 11))
+                {
+                        set_program_counter(mem, program_counter(mem) - 1);
+                        count_executed(mem, executed);
+                        return opcode == 7 ? STOP_HALT : STOP_INPUT;
+                }
+                executed++;
+                if (profiling)
+                {
+                        profile_record((uint32_t)word);
+                }
 
                 /* Based on instruction, get information from 32-bit word */
                 if (opcode == 13)
@@ -149,47 +463,118 @@ void execute(Memory mem)
                 switch (opcode)
                 {
                 case 0:
-                        conditional_move(rA, rB, rC);
+                        conditional_move(registers, rA, rB, rC);
                         break;
                 case 1:
-                        segmented_load(rA, rB, rC, mem);
+                        segmented_load(registers, rA, rB, rC, mem);
                         break;
                 case 2:
-                        segmented_store(rA, rB, rC, mem);
+                        segmented_store(registers, rA, rB, rC, mem);
                         break;
                 case 3:
-                        addition(rA, rB, rC);
+                        addition(registers, rA, rB, rC);
                         break;
                 case 4:
-                        multiplication(rA, rB, rC);
+                        multiplication(registers, rA, rB, rC);
                         break;
                 case 5:
-                        division(rA, rB, rC);
+                        division(registers, rA, rB, rC);
                         break;
                 case 6:
-                        nand(rA, rB, rC);
-                        break;
-                case 7:
-                        halt(mem);
+                        nand(registers, rA, rB, rC);
                         break;
                 case 8:
-                        map_segment(mem, rB, rC);
+                        if (!map_segment(registers, mem, rB, rC))
+                        {
+                                set_program_counter(mem, 
+                                                    program_counter(mem) - 1);
+                                count_executed(mem, executed - 1);
+                                return STOP_MAP_FAILED;
+                        }
                         break;
                 case 9:
-                        unmap_segment(mem, rC);
+                        unmap_segment(registers, mem, rC);
                         break;
                 case 10:
-                        output(rC);
+                        output(registers, rC, mem);
+                        if (image_cache_pending != NULL)
+                        {
+                                image_cache_disarm();
+                        }
                         break;
                 case 11:
-                        input(rC);
+                        if (!input(registers, rC, mem))
+                        {
+                                set_program_counter(mem, 
+                                                    program_counter(mem) - 1);
+                                count_executed(mem, executed - 1);
+                                return STOP_INPUT;
+                        }
+                        if (image_cache_pending != NULL)
+                        {
+                                image_cache_disarm();
+                        }
                         break;
                 case 12:
-                        load_program(mem, rB, rC);
+                        load_program(registers, mem, rB, rC);
+                        if (image_cache_pending != NULL && registers[rB] != 0)
+                        {
+                                image_cache_store(mem);
+                        }
                         break;
                 case 13:
-                        load_value(rA, value);
+                        load_value(registers, rA, value);
                         break;
                 }
         }
+        count_executed(mem, executed);
+        return STOP_END;
+}
+
+/*
+    execute_until
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped (see execute_switch)
+    Effects:
+        runs the program on the engine selected by the engine variable (see
+        engine.h) and flushes its buffered output unless it only ran out of
+        budget
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_until(Memory mem, uint64_t budget, bool pause_at_io)
+{
+        Stop_reason reason = engine->run(mem, budget, pause_at_io);
+        if (reason != STOP_BUDGET)
+        {
+                flush_output(mem);
+        }
+        return reason;
+}
+
+/*
+    execute
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        STOP_HALT, STOP_END, STOP_INPUT if the input callback has
+        nothing yet, or STOP_MAP_FAILED if a map was refused
+    Effects:
+        executes the program until it stops (see execute_until)
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute(Memory mem)
+{
+        return execute_until(mem, UINT64_MAX, false);
 }
@@ -14,16 +14,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <seq.h>
-#include <bitpack.h>
 #include <byteswap.h>
-#include <uarray.h>
 #include <assert.h>
+#include <stdbool.h>
 #include "memory.h"
 
 #ifndef LILUM_H
 #define LILUM_H
 
+/* Why execute_until returned */
+typedef enum Stop_reason {
+        STOP_END = 0, STOP_BUDGET, STOP_INPUT, STOP_HALT, STOP_MAP_FAILED
+} Stop_reason;
+
 
 /*
     open_file
@@ -49,29 +52,149 @@ FILE * open_file(char *filename);
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
     Returns:
-        none
+        number of words added to segment0
     Effects:
         Read the contents of the file into 32-bit words and fills segment0 with
         those words
     Expects: 
     ***************************************************************************
 */
-void read_instructions(FILE *input_file, Memory mem);
+size_t read_instructions(FILE *input_file, Memory mem);
 
 /*
-    execute.c
+    load_instructions_buffer
     ***************************************************************************
     Input: 
+        const void *image: a .um image (big-endian words) in memory
+        size_t size: number of bytes in image
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
     Returns:
-        none
+        number of words added to segment0
     Effects:
-        Read the contents of the file into 32-bit words and fills segment0 with
-        those words
+        Converts the image to host order in a single pass, writing it
+        straight into the end of segment0 (extend_segment0), so the image
+        is never copied a second time. A trailing partial word is ignored,
+        as in read_instructions.
+    Expects: 
+        image is not NULL unless size is 0
+    ***************************************************************************
+*/
+size_t load_instructions_buffer(const void *image, size_t size, Memory mem);
+
+/*
+    load_instructions_fd
+    ***************************************************************************
+    Input: 
+        int fd: open descriptor for a .um image
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        bool report: whether to print load throughput to stderr
+    Returns:
+        number of words added to segment0
+    Effects:
+        Fills segment0 with the image read from fd. A regular file read from
+        its beginning is memory-mapped; anything else (pipes, sockets,
+        devices, or a file that has already been partly read) is streamed
+        with read(). The descriptor is left open.
+    Expects: 
+        fd is open for reading
+    ***************************************************************************
+*/
+size_t load_instructions_fd(int fd, Memory mem, bool report);
+
+/*
+    load_instructions
+    ***************************************************************************
+    Input: 
+        char *filename: name of the .um file to load, or "-" for stdin
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        bool report: whether to print load throughput to stderr
+    Returns:
+        number of words added to segment0
+    Effects:
+        Opens the file and loads it with load_instructions_fd. Exits with an
+        error if the file cannot be opened.
+    Expects: 
+        filename is not NULL
+    ***************************************************************************
+*/
+size_t load_instructions(char *filename, Memory mem, bool report);
+
+/*
+    execute_switch
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped: STOP_END if the program counter ran off the
+        end of segment0, STOP_BUDGET once budget instructions have run, 
+        STOP_HALT when the next instruction is a halt, and STOP_INPUT when
+        it is an input and either pause_at_io is set or the input callback 
+        has nothing yet (UM_INPUT_WAIT), and STOP_MAP_FAILED when it is a
+        map that map_segment_helper refused. The program counter is left at
+        the instruction that was not executed, so calling again resumes
+        there.
+    Effects:
+        The reference engine ("switch" in engine.c), which the others must
+        agree with: executes instruction based on opcode from 32-bit word,
+        fetching and decoding each word as it goes. Before each
+        instruction, saves a snapshot if one was requested by signal or
+        snapshot_at instructions have been executed. Saves the image cache
+        entry, if one is pending, after a large load_program.
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_switch(Memory mem, uint64_t budget, bool pause_at_io);
+
+/*
+    execute_until
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped: STOP_END if the program counter ran off the
+        end of segment0, STOP_BUDGET once budget instructions have run, 
+        STOP_HALT when the next instruction is a halt, and STOP_INPUT when
+        it is an input and either pause_at_io is set or the input callback 
+        has nothing yet (UM_INPUT_WAIT), and STOP_MAP_FAILED when it is a
+        map that map_segment_helper refused. The program counter is left at
+        the instruction that was not executed, so calling again resumes
+        there.
+    Effects:
+        executes instructions on the selected engine. Before each
+        instruction, saves a snapshot if one was requested by signal or
+        snapshot_at instructions have been executed. Saves the image cache
+        entry, if one is pending, after a large load_program.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_until(Memory mem, uint64_t budget, bool pause_at_io);
+
+/*
+    execute
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        STOP_HALT, STOP_END, STOP_INPUT if the input callback has
+        nothing yet, or STOP_MAP_FAILED if a map was refused
+    Effects:
+        executes the program until it stops (see execute_until)
     Expects: 
+        Memory struct pointer is not NULL
     ***************************************************************************
 */
-void execute(Memory mem);
+Stop_reason execute(Memory mem);
 
 #endif
\ No newline at end of file
@@ -11,25 +11,383 @@
  *     instructions.c. 
  *
  **************************************************************/
+/* For memfd_create */
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
-#include <seq.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <bitpack.h>
 #include <assert.h>
 #include "memory.h"
+#include "slab.h"
+#include "placement.h"
+#include "writer.h"
 
+bool flush_at_newline = false;
+
+/* The last segment 0 version given out, to any machine of the process */
+static uint64_t last_program_version = 0;
+
+/* A segment load_program has copied into segment 0, kept so that loading
+the same code again is a memcpy and keeps its decoded words. id names the
+content for as long as it is cached; words never change, and decoded, if
+not NULL, is segment 0's decoded form of them from the last time they were
+swapped out unmodified. The words of an image of SHARED_IMAGE_WORDS or
+more live in a memfd (fd), and segment 0 is loaded from it with a private
+mapping, so loading it is O(1) and only pages segment 0 writes are copied */
+typedef struct Program_image {
+        uint64_t id;            /* 0 for an empty slot */
+        uint64_t fingerprint;
+        uint64_t last_used;
+        uint32_t length;
+        uint32_t *words;
+        int fd;                 /* -1 if words is malloc'd */
+        Predecoded *decoded;
+} Program_image;
+
+/* Smallest image, in words, kept in a memfd rather than malloc'd */
+#define SHARED_IMAGE_WORDS 16384
 
 /* Definition of Memory struct that holds segments, free segments and the 
-program counter */
+program counter. Segment 0 is the code segment and is read on every
+instruction, so it is kept as a flat word array (program) rather than in
+segments, whose entry 0 is always NULL. Every other segment is one block
+of words preceded by its length, taken from the machine's slab allocator
+(see new_segment), and segments[id] points
+just past that header, so a load or store is an index into a raw array and
+a word costs 4 bytes rather than a boxed Seq_T slot. free_ids is a stack
+of the unmapped ids: map reuses the one unmapped most recently, so the ids
+(and blocks) a program churns through stay in cache. decoded runs parallel to
+program and caches each word's decoded form for the execution engines; an
+entry is cleared whenever its word is stored to, and all of them are
+replaced when load_program replaces segment 0. program_mapped is non-zero
+when program is a copy-on-write mapping of a shared image rather than
+malloc'd (see map_program). program_image is the image
+segment 0 was last loaded from, and segment_image[id] the image segment id
+is known to hold (0 for none) until it is stored to or remapped.
+program_version changes with every change to segment 0 (see 
+program_version).
+mapped_words and peak_words count the words of the segments other than 0
+(not their headers), and quota_words caps mapped_words (UINT64_MAX for no
+quota); failed_length is the length of the last map that was refused.
+output_buffer holds the output_length bytes printed since the last flush
+(see flush_output), and has room for output_space; it is NULL until the
+machine first prints to stdout, and with --async-output it is space in the
+writer's ring, claimed again after each flush.
+Bytes of standard input are served from input_at up to input_end, which
+point into input_map (standard input itself, mapped when it is a regular
+file) or input_buffer (filled by read); input_probed says whether mapping
+was tried, and input_ended that a read found the end of the input. */
 struct Memory {
-        Seq_T segment_sequence;
-        Seq_T free_segments; 
+        uint32_t **segments;
+        uint32_t segment_count;
+        uint32_t segment_capacity;
+        uint32_t *free_ids;
+        uint32_t free_count;
+        uint32_t free_capacity;
         long program_counter;
+        uint32_t *program;
+        Predecoded *decoded;
+        uint32_t program_length;
+        uint32_t program_capacity;
+        size_t program_mapped;
+        Program_image images[PROGRAM_IMAGES];
+        uint64_t program_image;
+        uint64_t program_version;
+        uint64_t next_image;
+        uint64_t clock;
+        uint64_t *segment_image;
+        uint32_t segment_image_length;
+        uint32_t registers[8];
+        Input_fn input;
+        Output_fn output;
+        void *io_context;
+        uint8_t *output_buffer;
+        uint32_t output_length;
+        uint32_t output_space;
+        const uint8_t *input_at;
+        const uint8_t *input_end;
+        uint8_t *input_buffer;
+        void *input_map;
+        size_t input_map_bytes;
+        bool input_probed;
+        bool input_ended;
+        uint64_t executed;
+        Slab slab;
+        uint64_t mapped_words;
+        uint64_t peak_words;
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t failed_maps;
+        uint64_t quota_words;
+        uint32_t failed_length;
+        struct timespec created;
+};
+
+/* Digests of the pages of count segment ids: lengths[id] is the length
+   of segment id (UNMAPPED_SEGMENT if it is unmapped), and the digests of
+   its pages start at sums[first[id]]; first[count] is their total */
+struct Memory_sums {
+        uint32_t count;
+        uint32_t *lengths;
+        size_t *first;
+        uint64_t *sums;
 };
 
+/*
+    new_segment, segment_words_length, free_segment
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t length: number of words the segment holds
+        uint32_t *words: a segment from new_segment
+    Returns:
+        new_segment: the words of a new zeroed segment of length words, 
+        stored right after a header word holding length, or NULL if the
+        host has no memory for a large one
+        segment_words_length: the length in that header
+    Effects:
+        new_segment takes the block from mem's slab, which recycles small
+        blocks and callocs large ones, so a large segment comes from zero 
+        pages; free_segment gives it back (NULL is ignored). Both keep
+        mapped_words, and new_segment peak_words, up to date.
+    ***************************************************************************
+*/
+static uint32_t *new_segment(Memory mem, uint32_t length) {
+        uint32_t *block = slab_alloc(mem->slab, (size_t)length + 1);
+        if (block == NULL) {
+                return NULL;
+        }
+        block[0] = length;
+        mem->mapped_words += length;
+        if (mem->mapped_words > mem->peak_words) {
+                mem->peak_words = mem->mapped_words;
+        }
+        return block + 1;
+}
+
+static inline uint32_t segment_words_length(const uint32_t *words) {
+        return words[-1];
+}
+
+static void free_segment(Memory mem, uint32_t *words) {
+        if (words != NULL) {
+                mem->mapped_words -= words[-1];
+                slab_release(mem->slab, words - 1, (size_t)words[-1] + 1);
+        }
+}
+
+/*
+    add_segment
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t *words: segment from new_segment, or NULL for an unmapped 
+                         id
+    Returns:
+        the id words now has
+    Effects:
+        Appends words to the segment table, doubling the table if it is 
+        full
+    ***************************************************************************
+*/
+static uint32_t add_segment(Memory mem, uint32_t *words) {
+        if (mem->segment_count == mem->segment_capacity) {
+                uint32_t capacity = mem->segment_capacity > 0 ? 
+                                    2 * mem->segment_capacity : 16;
+                mem->segments = realloc(mem->segments, 
+                                        capacity * sizeof(uint32_t *));
+                assert(mem->segments != NULL);
+                mem->segment_capacity = capacity;
+        }
+        mem->segments[mem->segment_count] = words;
+        return mem->segment_count++;
+}
+
+/*
+    push_free_id
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t id: id that is no longer mapped
+    Returns:
+        none
+    Effects:
+        Pushes id onto the free id stack, doubling the stack if it is full
+    ***************************************************************************
+*/
+static void push_free_id(Memory mem, uint32_t id) {
+        if (mem->free_count == mem->free_capacity) {
+                uint32_t capacity = mem->free_capacity > 0 ? 
+                                    2 * mem->free_capacity : 16;
+                mem->free_ids = realloc(mem->free_ids, 
+                                        capacity * sizeof(uint32_t));
+                assert(mem->free_ids != NULL);
+                mem->free_capacity = capacity;
+        }
+        mem->free_ids[mem->free_count++] = id;
+}
+
+/*
+    page_count
+    ***************************************************************************
+    Input: 
+        uint32_t length: number of words in a segment
+    Returns:
+        the number of CHECKPOINT_PAGE_WORDS pages the segment spans
+    ***************************************************************************
+*/
+static inline uint32_t page_count(uint32_t length) {
+        return (uint32_t)(((uint64_t)length + CHECKPOINT_PAGE_WORDS - 1) / 
+                          CHECKPOINT_PAGE_WORDS);
+}
+
+/*
+    reserve_program
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        size_t length: number of words segment0 must be able to hold
+    Returns:
+        none
+    Effects:
+        Grows the segment0 array and its predecoded entries, at least 
+        doubling them, if they are too small. New entries are not decoded.
+        A mapped segment0 is copied into a malloc'd array. With 
+        --huge-pages, large arrays are advised to use huge pages.
+    ***************************************************************************
+*/
+static void reserve_program(Memory mem, size_t length) {
+        if (length <= mem->program_capacity) {
+                return;
+        }
+        size_t capacity = 2 * (size_t)mem->program_capacity;
+        if (capacity < length) {
+                capacity = length;
+        }
+        if (mem->program_mapped != 0) {
+                uint32_t *words = malloc(capacity * sizeof(uint32_t));
+                assert(words != NULL);
+                memcpy(words, mem->program, 
+                       (size_t)mem->program_length * sizeof(uint32_t));
+                munmap(mem->program, mem->program_mapped);
+                mem->program = words;
+                mem->program_mapped = 0;
+        } else {
+                mem->program = realloc(mem->program, 
+                                       capacity * sizeof(uint32_t));
+                assert(mem->program != NULL);
+        }
+        placement_advise(mem->program, capacity * sizeof(uint32_t));
+        mem->decoded = realloc(mem->decoded, capacity * sizeof(Predecoded));
+        assert(mem->decoded != NULL);
+        memset(mem->decoded + mem->program_capacity, 0, 
+               (capacity - mem->program_capacity) * sizeof(Predecoded));
+        placement_advise(mem->decoded, capacity * sizeof(Predecoded));
+        mem->program_capacity = (uint32_t)capacity;
+}
+
+/*
+    release_program
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Frees or unmaps the segment0 array and leaves segment0 empty, with
+        no capacity. The predecoded array is kept; reserve_program resizes
+        it along with the next segment0 array.
+    ***************************************************************************
+*/
+static void release_program(Memory mem) {
+        if (mem->program_mapped != 0) {
+                munmap(mem->program, mem->program_mapped);
+        } else {
+                free(mem->program);
+        }
+        mem->program = NULL;
+        mem->program_mapped = 0;
+        mem->program_length = 0;
+        mem->program_capacity = 0;
+}
+
+/*
+    init_machine
+    ***************************************************************************
+    Input: 
+        Memory mem : newly allocated Memory struct
+    Returns:
+        none
+    Effects:
+        Initializes everything but the program counter: an empty segment
+        table, free id stack, slab, segment 0 and image cache, cleared
+        registers, standard input and output, an instruction count of 0
+        and zeroed memory counters with no quota
+    ***************************************************************************
+*/
+static void init_machine(Memory mem)
+{
+        mem->segments = NULL;
+        mem->segment_count = 0;
+        mem->segment_capacity = 0;
+        mem->free_ids = NULL;
+        mem->free_count = 0;
+        mem->free_capacity = 0;
+        mem->program = NULL;
+        mem->decoded = NULL;
+        mem->program_length = 0;
+        mem->program_capacity = 0;
+        mem->program_mapped = 0;
+        memset(mem->images, 0, sizeof(mem->images));
+        for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                mem->images[i].fd = -1;
+        }
+        mem->program_image = 0;
+        note_program_changed(mem);
+        mem->next_image = 1;
+        mem->clock = 0;
+        mem->segment_image = NULL;
+        mem->segment_image_length = 0;
+        memset(mem->registers, 0, sizeof(mem->registers));
+        mem->input = NULL;
+        mem->output = NULL;
+        mem->output_buffer = NULL;
+        mem->output_length = 0;
+        mem->output_space = 0;
+        mem->input_at = NULL;
+        mem->input_end = NULL;
+        mem->input_buffer = NULL;
+        mem->input_map = NULL;
+        mem->input_map_bytes = 0;
+        mem->input_probed = false;
+        mem->input_ended = false;
+        mem->io_context = NULL;
+        mem->executed = 0;
+        mem->slab = slab_new();
+        mem->mapped_words = 0;
+        mem->peak_words = 0;
+        mem->maps = 0;
+        mem->unmaps = 0;
+        mem->failed_maps = 0;
+        mem->quota_words = UINT64_MAX;
+        mem->failed_length = 0;
+        clock_gettime(CLOCK_MONOTONIC, &mem->created);
+}
+
 /*
     create_segment0
     ***************************************************************************
@@ -46,11 +404,10 @@ struct Memory {
 Memory create_segment0(long hint){
         Memory mem = malloc(sizeof(struct Memory));
         assert(mem != NULL);
-        mem->segment_sequence = Seq_new(0);
-        mem->free_segments = Seq_new(0);
-        Seq_T segment0 = Seq_new(hint);
-        Seq_addhi(mem->segment_sequence, segment0);        
         mem->program_counter = 0;
+        init_machine(mem);
+        add_segment(mem, NULL);
+        reserve_program(mem, hint > 0 ? hint : 1);
         return mem;
 }
 
@@ -69,7 +426,60 @@ Memory create_segment0(long hint){
     ***************************************************************************
 */
 void append_segment0(Memory mem, uint32_t word) {
-        Seq_addhi(Seq_get(mem->segment_sequence, 0), (void *)(uintptr_t)word);
+        reserve_program(mem, (size_t)mem->program_length + 1);
+        mem->program[mem->program_length++] = word;
+        note_program_changed(mem);
+}
+
+/*
+    append_segment0_words
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        const uint32_t *words: host-order words to append
+        size_t count: number of words in the words array
+    Returns:
+        none
+    Effects:
+        Adds all count words to the end of segment0, in order
+    Expects: 
+        words is not NULL unless count is 0
+    ***************************************************************************
+*/
+void append_segment0_words(Memory mem, const uint32_t *words, size_t count) {
+        assert(words != NULL || count == 0);
+        reserve_program(mem, (size_t)mem->program_length + count);
+        memcpy(mem->program + mem->program_length, words, 
+               count * sizeof(uint32_t));
+        mem->program_length += count;
+        note_program_changed(mem);
+}
+
+/*
+    extend_segment0
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        size_t count: number of words to add
+    Returns:
+        address of the count words now at the end of segment0, for the
+        caller to fill in place
+    Effects:
+        Grows segment0 by count words whose contents are unspecified until
+        the caller writes them, so that a loader can convert an image
+        straight into segment0's storage instead of copying it there
+    Expects: 
+        The caller writes all count words before segment0 is used
+    ***************************************************************************
+*/
+uint32_t *extend_segment0(Memory mem, size_t count) {
+        reserve_program(mem, (size_t)mem->program_length + count);
+        uint32_t *words = mem->program + mem->program_length;
+        mem->program_length += count;
+        note_program_changed(mem);
+        return words;
 }
 
 /*
@@ -80,34 +490,46 @@ void append_segment0(Memory mem, uint32_t word) {
                         and program counter
         uint32_t num_words: number of words the sequenc will hold
     Returns:
-        uint32_t holding the index of the mapped segment
+        uint32_t holding the index of the mapped segment, or 0 if the map
+        was refused
     Effects:
         Creates a new memory segment and adds it to the sequence of segments.
-        If there is a free (unmapped) index, the segment is placed at that
-        index; otherwise, the segment is added to the end of the sequence
+        If there is a free (unmapped) index, the segment is placed at the
+        one unmapped most recently; otherwise, the segment is added to the
+        end of the table. A map that would take the mapped words over the
+        machine's quota, or that the host has no memory for, maps nothing
+        and is counted as failed; the engines then stop in front of it
+        (STOP_MAP_FAILED).
     Expects: 
         memory struct pointer is not NULL
     ***************************************************************************
 */
 uint32_t map_segment_helper(Memory mem, uint32_t num_words){
-        Seq_T new_segment = Seq_new(num_words);
-        /* Initialize sequence to all 0s*/
-        for (uint32_t i = 0; i < num_words; i++) {
-                Seq_addhi(new_segment, (void *)(uintptr_t)0);
-        }
-        /* If free_segments is empty, append the created segment to the end 
-           of the sequence; otherwise, place the sequence at the free index 
-           from free_segments */
-        if (Seq_length(mem->free_segments) == 0){
-             Seq_addhi(mem->segment_sequence, (void *)(uintptr_t)new_segment);
-             return (uint32_t)(Seq_length(mem->segment_sequence) - 1);
+        uint32_t *words = NULL;
+        if (__builtin_expect(mem->mapped_words + num_words <= 
+                             mem->quota_words, 1)) {
+                words = new_segment(mem, num_words);
+        }
+        if (__builtin_expect(words == NULL, 0)) {
+                mem->failed_maps++;
+                mem->failed_length = num_words;
+                return 0;
+        }
+        mem->maps++;
+        /* If no id is free, append the created segment to the end of the
+           table; otherwise, place the segment at the id on top of the 
+           free id stack */
+        uint32_t index;
+        if (mem->free_count == 0){
+             index = add_segment(mem, words);
         } else {
-            int index = (int)(uintptr_t)Seq_remlo(mem->free_segments);
-            Seq_put(mem->segment_sequence, index, 
-                                            (void *)(uintptr_t)new_segment);
-            return (uint32_t)index;
+            index = mem->free_ids[--mem->free_count];
+            mem->segments[index] = words;
+            if (index < mem->segment_image_length) {
+                    mem->segment_image[index] = 0;
+            }
         } 
-
+        return index;
 }
 
 /*
@@ -121,176 +543,1783 @@ uint32_t map_segment_helper(Memory mem, uint32_t num_words){
         none
     Effects:
         Replaces the segment at the specified index with a NULL pointer 
-        and appends the (now free) index to the free_segments sequence
+        and pushes the (now free) index onto the free id stack
     Expects: 
-        memory struct pointer is not NULL
+        memory struct pointer is not NULL, rC is a mapped segment other 
+        than segment 0
     ***************************************************************************
 */
 void unmap_segment_helper(Memory mem, uint32_t rC){
-    Seq_T remove = Seq_get(mem->segment_sequence, rC);
-    Seq_free(&remove);
-    Seq_put(mem->segment_sequence, rC, NULL);
-    Seq_addhi(mem->free_segments, (void *)(uintptr_t)rC);
+    assert(rC != 0 && rC < mem->segment_count && mem->segments[rC] != NULL);
+    free_segment(mem, mem->segments[rC]);
+    mem->segments[rC] = NULL;
+    mem->unmaps++;
+    push_free_id(mem, rC);
 }
 
 /*
-    load_program_helper
+    fnv_word
+    ***************************************************************************
+    Input: 
+        uint64_t hash: FNV-1a hash so far
+        uint32_t word: word to add to the hash
+    Returns:
+        hash after one FNV-1a round per byte of word, most significant first
+    ***************************************************************************
+*/
+static inline uint64_t fnv_word(uint64_t hash, uint32_t word) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+                hash ^= (word >> shift) & 0xff;
+                hash *= 0x100000001b3ull;
+        }
+        return hash;
+}
+
+/*
+    find_image
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
-        uint32_t rB: value in register B indicating which segment will be
-                     duplicated
-        uint32_t rC: value in register C indicating which instruction in the
-                     segment is meant to be executed
+        uint64_t id: program image id, or 0
     Returns:
-        none
-    Effects:
-        Creates a duplicate of segment[rB] and replaces segemnt 0 with that 
-        segment.
-        If the index being duplicated is not segment 0, segment 0 is freed.
-        Program counter is set to rC
-    Expects: 
-        memory struct pointer is not NULL
+        the cached image with that id, or NULL if it is 0 or not cached
     ***************************************************************************
 */
-void load_program_helper(Memory mem, uint32_t rB, uint32_t rC) {
-        if (rB != 0){
-                Seq_T old = (Seq_T)Seq_get(mem->segment_sequence, rB);
-                int length = Seq_length(old);
-                Seq_T duplicate = Seq_new(length);
-                /* Populate the duplicate segment with the elements in the 
-                   original */
-                for (int i = 0; i < length; i++) {
-                        Seq_addhi(duplicate, 
-                                          (void *)(uintptr_t)Seq_get(old, i));
+static Program_image *find_image(Memory mem, uint64_t id) {
+        for (int i = 0; id != 0 && i < PROGRAM_IMAGES; i++) {
+                if (mem->images[i].id == id) {
+                        return &mem->images[i];
                 }
-                Seq_T old_0 = (Seq_T)Seq_get(mem->segment_sequence, 0);
-                Seq_free(&old_0);
-                Seq_put(mem->segment_sequence, 0, duplicate);  
         }
-        mem->program_counter = rC;
+        return NULL;
 }
 
-
 /*
-    value_in_segment
+    stash_program
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
-        uint32_t indexB : value in $r[B] representing the segmentID
-        uint32_t indexC : value in $r[C] representing the address in segment 
     Returns:
-        value in segment[indexB][indexC]
+        none
     Effects:
-        None
-    Expects: 
-        Memory struct pointer is not NULL
+        Before segment0 is replaced, saves its decoded words with the image
+        it was loaded from if it still holds exactly that image; a mapped 
+        segment0 hands its decoded array over and is unmapped, leaving 
+        segment0 empty. If it was modified, the image gets a new id, so 
+        that nothing derived from the modified program is used with the 
+        image again.
     ***************************************************************************
 */
-uint32_t value_in_segment(Memory mem, uint32_t indexB, uint32_t indexC){
-        Seq_T segment = (Seq_T)Seq_get(mem->segment_sequence, indexB);
-        uint32_t value = (uint32_t)(uintptr_t)Seq_get(segment, indexC);
-        return value;
+static void stash_program(Memory mem) {
+        Program_image *image = find_image(mem, mem->program_image);
+        mem->program_image = 0;
+        if (image == NULL) {
+                return;
+        }
+        size_t length = image->length;
+        bool same = length == mem->program_length && 
+                    memcmp(image->words, mem->program, 
+                           length * sizeof(uint32_t)) == 0;
+        if (same && mem->program_mapped != 0) {
+                free(image->decoded);
+                image->decoded = mem->decoded;
+                mem->decoded = NULL;
+                release_program(mem);
+        } else if (same) {
+                if (image->decoded == NULL) {
+                        image->decoded = malloc((length + 1) * 
+                                                sizeof(Predecoded));
+                        assert(image->decoded != NULL);
+                }
+                memcpy(image->decoded, mem->decoded, 
+                       length * sizeof(Predecoded));
+        } else {
+                image->id = mem->next_image++;
+                free(image->decoded);
+                image->decoded = NULL;
+        }
+}
+
+/*
+    copy_image_words
+    ***************************************************************************
+    Input: 
+        const uint32_t *segment: words of the segment being cached
+        uint32_t length: number of words in segment
+        int *fd: set to the memfd holding the copy, or -1 if it is malloc'd
+    Returns:
+        a copy of the words that is never written again
+    Effects:
+        A segment of SHARED_IMAGE_WORDS or more is copied into a new memfd,
+        which is mapped read-only, so that segment0 can be a private 
+        mapping of the same pages (map_program). Smaller segments, or any
+        segment if the memfd cannot be had, are copied with malloc.
+    ***************************************************************************
+*/
+static uint32_t *copy_image_words(const uint32_t *segment, uint32_t length,
+                                  int *fd) {
+        size_t bytes = (size_t)length * sizeof(uint32_t);
+        *fd = -1;
+        if (length >= SHARED_IMAGE_WORDS) {
+                int memfd = memfd_create("um-image", MFD_CLOEXEC);
+                void *words = MAP_FAILED;
+                if (memfd >= 0 && ftruncate(memfd, bytes) == 0) {
+                        words = mmap(NULL, bytes, PROT_READ | PROT_WRITE, 
+                                     MAP_SHARED, memfd, 0);
+                }
+                if (words != MAP_FAILED) {
+                        memcpy(words, segment, bytes);
+                        mprotect(words, bytes, PROT_READ);
+                        *fd = memfd;
+                        return words;
+                }
+                if (memfd >= 0) {
+                        close(memfd);
+                }
+        }
+        uint32_t *words = malloc(bytes + sizeof(uint32_t));
+        assert(words != NULL);
+        memcpy(words, segment, bytes);
+        return words;
 }
 
+/*
+    release_image
+    ***************************************************************************
+    Input: 
+        Program_image *image: image cache slot
+    Returns:
+        none
+    Effects:
+        Frees or unmaps the words of the image, closes its memfd and frees
+        its decoded words, leaving the slot empty
+    ***************************************************************************
+*/
+static void release_image(Program_image *image) {
+        if (image->fd >= 0) {
+                munmap(image->words, (size_t)image->length * 
+                                     sizeof(uint32_t));
+                close(image->fd);
+        } else {
+                free(image->words);
+        }
+        free(image->decoded);
+        image->id = 0;
+        image->words = NULL;
+        image->fd = -1;
+        image->decoded = NULL;
+}
 
 /*
-    store_in_segment
+    image_for_segment
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
-        uint32_t value  : value in $r[C]
-        uint32_t indexA : value in $r[A] representing the segmentID
-        uint32_t indexB : value in $r[B] representing the address in segment 
+        uint32_t id: nonzero segment being loaded as a program
     Returns:
-        None
+        the cached image holding the contents of segment[id]
     Effects:
-        Stores 'value' in segment[indexA][indexB]
+        If segment[id] was loaded before and has not been stored to since,
+        returns that image without reading the segment. Otherwise 
+        fingerprints the segment and looks for an image with the same 
+        fingerprint, length and words, and failing that puts a copy of it
+        (copy_image_words) in place of the least recently used image. 
+        Either way, remembers the image as segment[id]'s.
     Expects: 
-        Memory struct pointer is not NULL
+        segment[id] is mapped
     ***************************************************************************
 */
-void store_in_segment(Memory mem, uint32_t value, uint32_t indexA, 
-                        uint32_t indexB){
-        Seq_T segment = (Seq_T)Seq_get(mem->segment_sequence, indexA);
-        Seq_put(segment, indexB, (void *)(uintptr_t)value);
-}
+static Program_image *image_for_segment(Memory mem, uint32_t id) {
+        Program_image *image = NULL;
+        if (id < mem->segment_image_length) {
+                image = find_image(mem, mem->segment_image[id]);
+        }
+        if (image == NULL) {
+                const uint32_t *segment = mem->segments[id];
+                uint32_t length = segment_words_length(segment);
+                uint64_t fingerprint = fnv_word(0xcbf29ce484222325ull, 
+                                                length);
+                for (uint32_t i = 0; i < length; i++) {
+                        fingerprint = fnv_word(fingerprint, segment[i]);
+                }
 
+                Program_image *oldest = &mem->images[0];
+                for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                        Program_image *cached = &mem->images[i];
+                        if (cached->id != 0 && 
+                            cached->fingerprint == fingerprint &&
+                            cached->length == length &&
+                            memcmp(cached->words, segment, 
+                                   length * sizeof(uint32_t)) == 0) {
+                                image = cached;
+                                break;
+                        }
+                        if (cached->last_used < oldest->last_used) {
+                                oldest = cached;
+                        }
+                }
+                if (image == NULL) {
+                        image = oldest;
+                        release_image(image);
+                        image->id = mem->next_image++;
+                        image->fingerprint = fingerprint;
+                        image->length = length;
+                        image->words = copy_image_words(segment, length,
+                                                        &image->fd);
+                }
+
+                if (id >= mem->segment_image_length) {
+                        uint32_t grown = 2 * id + 1;
+                        mem->segment_image = realloc(mem->segment_image, 
+                                                grown * sizeof(uint64_t));
+                        assert(mem->segment_image != NULL);
+                        memset(mem->segment_image + 
+                               mem->segment_image_length, 0,
+                               (grown - mem->segment_image_length) * 
+                               sizeof(uint64_t));
+                        mem->segment_image_length = grown;
+                }
+                mem->segment_image[id] = image->id;
+        }
+        image->last_used = ++mem->clock;
+        return image;
+}
 
 /*
-    instruction
+    map_program
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
+        Program_image *image: image being loaded as segment0
     Returns:
-        32-bit instruction located at program_counter in segment0. 
+        true if segment0 is now a mapping of image, false if image is not 
+        in a memfd or cannot be mapped
     Effects:
-        Extracts the 32-bit word from segment0 and increments the program 
-        counter by 1, indicating that the instruction is processed. 
-    Expects: 
-        Memory struct pointer is not NULL
+        Replaces segment0 with a private mapping of the image's memfd. The
+        pages are shared with the image until segment0 writes one, when 
+        the kernel copies that page alone. The image's decoded words, if it
+        has any, become segment0's without a copy; otherwise segment0 
+        starts with a zeroed (not decoded) array.
     ***************************************************************************
 */
-uint32_t instruction(Memory mem) {
-        Seq_T seg0 = Seq_get(mem->segment_sequence, 0);
-        uint32_t word = (uint32_t)(uintptr_t)Seq_get(seg0, 
-                                                        mem->program_counter);
-        mem->program_counter += 1;
-        return word;
+static bool map_program(Memory mem, Program_image *image) {
+        if (image->fd < 0) {
+                return false;
+        }
+        size_t bytes = (size_t)image->length * sizeof(uint32_t);
+        uint32_t *words = mmap(NULL, bytes, PROT_READ | PROT_WRITE, 
+                               MAP_PRIVATE, image->fd, 0);
+        if (words == MAP_FAILED) {
+                return false;
+        }
+        release_program(mem);
+        free(mem->decoded);
+        if (image->decoded != NULL) {
+                mem->decoded = image->decoded;
+                image->decoded = NULL;
+        } else {
+                mem->decoded = calloc((size_t)image->length + 1, 
+                                      sizeof(Predecoded));
+                assert(mem->decoded != NULL);
+        }
+        placement_advise(words, bytes);
+        placement_advise(mem->decoded, ((size_t)image->length + 1) * 
+                                       sizeof(Predecoded));
+        mem->program = words;
+        mem->program_mapped = bytes;
+        mem->program_length = image->length;
+        mem->program_capacity = image->length;
+        return true;
 }
 
-
 /*
-    free_segments 
+    load_program_helper
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
+        uint32_t rB: value in register B indicating which segment will be
+                     duplicated
+        uint32_t rC: value in register C indicating which instruction in the
+                     segment is meant to be executed
     Returns:
-        None
+        none
     Effects:
-        Frees all segments, free_sequences, and the sequence that holds the 
-        segments. All allocated memory is deallocated in this function,
-        including the Memory struct
+        Creates a duplicate of segment[rB] and replaces segemnt 0 with that 
+        segment.
+        If the index being duplicated is not segment 0, segment 0 is 
+        replaced through the program image cache: the old segment 0, if it
+        still matches its image, leaves its decoded words with the image
+        (stash_program), and the new one is copied from its image 
+        (image_for_segment) along with any decoded words the image has.
+        A large image is not copied: segment 0 becomes a copy-on-write 
+        mapping of it (map_program) and takes over its decoded words, so
+        the jump costs the same whatever the size of the segment.
+        Program counter is set to rC
     Expects: 
-        Memory struct pointer is not NULL
+        memory struct pointer is not NULL
     ***************************************************************************
 */
-void free_segments(Memory mem) {
-        int seq_length = Seq_length(mem->segment_sequence);
-        /* Call Seq_free on all sequences withing or segments_sequence */
-        for (int i = 0; i < seq_length; i++){
-                Seq_T free_seq = Seq_get(mem->segment_sequence, i);
-                if(free_seq != NULL){
-                        Seq_free(&free_seq);
+void load_program_helper(Memory mem, uint32_t rB, uint32_t rC) {
+        if (rB != 0){
+                stash_program(mem);
+                note_program_changed(mem);
+                Program_image *image = image_for_segment(mem, rB);
+                uint32_t length = image->length;
+                if (map_program(mem, image)) {
+                        mem->program_image = image->id;
+                        mem->program_counter = rC;
+                        return;
                 }
-        }       
-        Seq_free(&(mem->segment_sequence));
-        Seq_free(&(mem->free_segments));
-        free(mem);
+                /* Replace the contents of segment 0 with the elements in the
+                   original */
+                reserve_program(mem, length);
+                memcpy(mem->program, image->words, 
+                       (size_t)length * sizeof(uint32_t));
+                /* Replace every decoded word of the old program */
+                uint32_t stale = mem->program_length > length ?
+                                 mem->program_length : length;
+                if (image->decoded != NULL) {
+                        memcpy(mem->decoded, image->decoded, 
+                               (size_t)length * sizeof(Predecoded));
+                        memset(mem->decoded + length, 0, 
+                               (stale - length) * sizeof(Predecoded));
+                } else {
+                        memset(mem->decoded, 0, stale * sizeof(Predecoded));
+                }
+                mem->program_length = length;
+                mem->program_image = image->id;
+        }
+        mem->program_counter = rC;
 }
 
-
 /*
-    instructions_complete
+    program_image
     ***************************************************************************
     Input: 
         Memory mem : Memory struct that holds the segments, free sequences, 
                         and program counter
     Returns:
-        True if the program counter is less than the number of instructions 
-        in segment0, False otherwise. 
+        id of the program image segment0 was last loaded from, or 0
     Effects:
-        None 
+        None. An id is never reused, and one whose image segment0 was 
+        modified from is retired when segment0 is swapped out, so state 
+        an engine derived from segment0 may be kept under the id and 
+        reused when a later load_program_helper installs the same id.
     Expects: 
         Memory struct pointer is not NULL
     ***************************************************************************
 */
-bool instructions_complete(Memory mem) {
-        return mem->program_counter < 
-                        Seq_length((Seq_T)(Seq_get(mem->segment_sequence, 0)));
+uint64_t program_image(Memory mem) {
+        assert(mem != NULL);
+        return mem->program_image;
+}
+
+/*
+    program_version, note_program_changed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        program_version: a number that changes whenever segment0 is 
+        stored to, grown or replaced, and that no other machine in the 
+        process has ever had
+    Effects:
+        note_program_changed gives segment0 a new version, from a counter
+        shared by every machine (machines of a batch run on several
+        threads, so it is updated atomically). An engine that stores to 
+        segment0 through program_words calls it before it returns.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint64_t program_version(Memory mem) {
+        assert(mem != NULL);
+        return mem->program_version;
+}
+
+void note_program_changed(Memory mem) {
+        mem->program_version = __atomic_add_fetch(&last_program_version, 1,
+                                                  __ATOMIC_RELAXED);
+}
+
+
+/*
+    value_in_segment
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t indexB : value in $r[B] representing the segmentID
+        uint32_t indexC : value in $r[C] representing the address in segment 
+    Returns:
+        value in segment[indexB][indexC]
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL; the segment is mapped and the
+        address is inside it (a checked runtime error otherwise, for
+        segment 0 as for the others)
+    ***************************************************************************
+*/
+uint32_t value_in_segment(Memory mem, uint32_t indexB, uint32_t indexC){
+        if (indexB == 0) {
+                assert(indexC < mem->program_length);
+                return mem->program[indexC];
+        }
+        assert(indexB < mem->segment_count);
+        const uint32_t *segment = mem->segments[indexB];
+        assert(segment != NULL && indexC < segment_words_length(segment));
+        return segment[indexC];
+}
+
+
+/*
+    store_in_segment
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t value  : value in $r[C]
+        uint32_t indexA : value in $r[A] representing the segmentID
+        uint32_t indexB : value in $r[B] representing the address in segment 
+    Returns:
+        None
+    Effects:
+        Stores 'value' in segment[indexA][indexB]. A store to segment0 
+        also discards the predecoded form of the word and of the
+        PREDECODE_SPAN - 1 words before it.
+    Expects: 
+        Memory struct pointer is not NULL; the segment is mapped and the
+        address is inside it (a checked runtime error otherwise, for
+        segment 0 as for the others)
+    ***************************************************************************
+*/
+void store_in_segment(Memory mem, uint32_t value, uint32_t indexA, 
+                        uint32_t indexB){
+        if (indexA == 0) {
+                assert(indexB < mem->program_length);
+                mem->program[indexB] = value;
+                uint32_t first = indexB >= PREDECODE_SPAN - 1 ? 
+                                 indexB - (PREDECODE_SPAN - 1) : 0;
+                for (uint32_t i = first; i <= indexB; i++) {
+                        mem->decoded[i].handler = NULL;
+                }
+                note_program_changed(mem);
+                return;
+        }
+        assert(indexA < mem->segment_count);
+        uint32_t *segment = mem->segments[indexA];
+        assert(segment != NULL && indexB < segment_words_length(segment));
+        segment[indexB] = value;
+        if (indexA < mem->segment_image_length) {
+                mem->segment_image[indexA] = 0;
+        }
+}
+
+
+/*
+    instruction
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        32-bit instruction located at program_counter in segment0. 
+    Effects:
+        Extracts the 32-bit word from segment0 and increments the program 
+        counter by 1, indicating that the instruction is processed. 
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint32_t instruction(Memory mem) {
+        uint32_t word = mem->program[mem->program_counter];
+        mem->program_counter += 1;
+        return word;
+}
+
+
+/*
+    free_segments 
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        None
+    Effects:
+        Frees all segments, free_sequences, and the sequence that holds the 
+        segments. All allocated memory is deallocated in this function,
+        including the Memory struct. Buffered output is written first; with
+        --async-output this waits until the writer thread has written it.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void free_segments(Memory mem) {
+        for (uint32_t i = 0; i < mem->segment_count; i++){
+                free_segment(mem, mem->segments[i]);
+        }       
+        free(mem->segments);
+        slab_free(&mem->slab);
+        free(mem->free_ids);
+        for (int i = 0; i < PROGRAM_IMAGES; i++) {
+                release_image(&mem->images[i]);
+        }
+        free(mem->segment_image);
+        release_program(mem);
+        free(mem->decoded);
+        flush_output(mem);
+        if (writer_running()) {
+                writer_drain();
+        } else {
+                free(mem->output_buffer);
+        }
+        free(mem->input_buffer);
+        if (mem->input_map != NULL) {
+                munmap(mem->input_map, mem->input_map_bytes);
+        }
+        free(mem);
+}
+
+
+/*
+    instructions_complete
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        True if the program counter is less than the number of instructions 
+        in segment0, False otherwise. 
+    Effects:
+        None 
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+bool instructions_complete(Memory mem) {
+        return mem->program_counter < (long)mem->program_length;
+}
+
+/*
+    program_counter
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        index in segment0 of the next instruction to execute
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint32_t program_counter(Memory mem) {
+        return (uint32_t)mem->program_counter;
+}
+
+/*
+    set_program_counter
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t counter: index in segment0 of the next instruction
+    Returns:
+        None
+    Effects:
+        Sets the program counter to counter
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_program_counter(Memory mem, uint32_t counter) {
+        mem->program_counter = counter;
+}
+
+/*
+    segment_length
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t id : segment id
+    Returns:
+        number of words in segment[id]
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL and segment[id] is mapped
+    ***************************************************************************
+*/
+uint32_t segment_length(Memory mem, uint32_t id) {
+        if (id == 0) {
+                return mem->program_length;
+        }
+        assert(id < mem->segment_count && mem->segments[id] != NULL);
+        return segment_words_length(mem->segments[id]);
+}
+
+/*
+    segment_fingerprint
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t id : segment id
+    Returns:
+        64-bit FNV-1a hash of the length and contents of segment[id]
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL and segment[id] is mapped
+    ***************************************************************************
+*/
+uint64_t segment_fingerprint(Memory mem, uint32_t id) {
+        uint32_t length = segment_length(mem, id);
+        const uint32_t *words = id == 0 ? mem->program : mem->segments[id];
+        uint64_t hash = fnv_word(0xcbf29ce484222325ull, length);
+        for (uint32_t i = 0; i < length; i++) {
+                hash = fnv_word(hash, words[i]);
+        }
+        return hash;
+}
+
+/*
+    write_memory
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream the memory image is written to
+    Returns:
+        true if every write succeeded, false otherwise
+    Effects:
+        Writes the program counter, the free id stack (bottom first) and
+        every entry of the segment table to fp as host-order 32-bit words:
+            program_counter, segment count, free count, free ids...,
+            then per segment its length (UNMAPPED_SEGMENT if it is unmapped)
+            followed by its words
+    Expects: 
+        Memory struct pointer is not NULL, fp is open for writing
+    ***************************************************************************
+*/
+bool write_memory(Memory mem, FILE *fp) {
+        assert(mem != NULL && fp != NULL);
+        uint32_t seq_length = mem->segment_count;
+        uint32_t free_length = mem->free_count;
+        uint32_t header[3] = { (uint32_t)mem->program_counter, 
+                               seq_length, free_length };
+        bool ok = fwrite(header, sizeof(uint32_t), 3, fp) == 3 &&
+                  (free_length == 0 || 
+                   fwrite(mem->free_ids, sizeof(uint32_t), free_length, fp) 
+                                                              == free_length);
+
+        /* Each segment's header is its length, so a mapped segment is 
+           written with a single fwrite straight from the table */
+        for (uint32_t i = 0; ok && i < seq_length; i++) {
+                const uint32_t *segment = i == 0 ? mem->program : 
+                                                   mem->segments[i];
+                if (segment == NULL) {
+                        uint32_t length = UNMAPPED_SEGMENT;
+                        ok = fwrite(&length, sizeof(length), 1, fp) == 1;
+                } else if (i == 0) {
+                        uint32_t length = mem->program_length;
+                        ok = fwrite(&length, sizeof(length), 1, fp) == 1 &&
+                             fwrite(segment, sizeof(uint32_t), length, fp) 
+                                                                    == length;
+                } else {
+                        size_t words = (size_t)segment_words_length(segment)
+                                       + 1;
+                        ok = fwrite(segment - 1, sizeof(uint32_t), words, fp)
+                                                                    == words;
+                }
+        }
+        return ok;
+}
+
+/*
+    read_memory
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: memory image in the format of write_memory
+        size_t count: number of words available in the image
+        size_t *used: set to the number of words the image occupied
+    Returns:
+        a new Memory struct holding the segments, free list and program
+        counter described by the image, or NULL if the image is truncated
+        or inconsistent
+    Effects:
+        Allocates the Memory struct and all of its segments
+    Expects: 
+        words is not NULL unless count is 0, used is not NULL
+    ***************************************************************************
+*/
+Memory read_memory(const uint32_t *words, size_t count, size_t *used) {
+        assert(used != NULL);
+        if (count < 3) {
+                return NULL;
+        }
+        uint32_t seq_length = words[1];
+        uint32_t free_length = words[2];
+        size_t at = 3;
+        if (seq_length == 0 || count - at < free_length) {
+                return NULL;
+        }
+
+        Memory mem = malloc(sizeof(struct Memory));
+        assert(mem != NULL);
+        mem->program_counter = words[0];
+        init_machine(mem);
+
+        for (uint32_t i = 0; i < free_length; i++) {
+                push_free_id(mem, words[at++]);
+        }
+        for (uint32_t i = 0; i < seq_length; i++) {
+                if (at == count) {
+                        free_segments(mem);
+                        return NULL;
+                }
+                uint32_t length = words[at++];
+                if (length == UNMAPPED_SEGMENT) {
+                        add_segment(mem, NULL);
+                        continue;
+                }
+                if (count - at < length) {
+                        free_segments(mem);
+                        return NULL;
+                }
+                if (i == 0) {
+                        add_segment(mem, NULL);
+                        reserve_program(mem, length > 0 ? length : 1);
+                        memcpy(mem->program, words + at, 
+                               length * sizeof(uint32_t));
+                        mem->program_length = length;
+                        at += length;
+                        continue;
+                }
+                uint32_t *segment = new_segment(mem, length);
+                if (segment == NULL) {
+                        free_segments(mem);
+                        return NULL;
+                }
+                memcpy(segment, words + at, length * sizeof(uint32_t));
+                at += length;
+                add_segment(mem, segment);
+        }
+
+        /* Segment 0 must exist and every free id must name an unmapped 
+           segment */
+        bool consistent = mem->program != NULL;
+        for (uint32_t i = 0; consistent && i < free_length; i++) {
+                uint32_t id = mem->free_ids[i];
+                consistent = id != 0 && id < seq_length && 
+                             mem->segments[id] == NULL;
+        }
+        if (!consistent) {
+                free_segments(mem);
+                return NULL;
+        }
+        *used = at;
+        return mem;
+}
+
+/*
+    program_words
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t *length : set to the number of words in segment0
+    Returns:
+        pointer to the words of segment0
+    Effects:
+        None. The pointer stays valid until segment0 is replaced or grown
+        (load_program_helper, append_segment0, append_segment0_words); 
+        words stored through it are stored in segment0.
+    Expects: 
+        Memory struct pointer is not NULL, length is not NULL
+    ***************************************************************************
+*/
+uint32_t *program_words(Memory mem, uint32_t *length) {
+        *length = mem->program_length;
+        return mem->program;
+}
+
+/*
+    program_decoded
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        pointer to the predecoded entries for segment0, one per word
+    Effects:
+        None. The pointer is valid exactly as long as the one returned by
+        program_words. An engine that stores to segment0 through 
+        program_words must clear the handlers of the same entries as 
+        store_in_segment.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Predecoded *program_decoded(Memory mem) {
+        return mem->decoded;
+}
+
+/*
+    segment_table
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        where mem keeps its segment table (see Segment_table)
+    Effects:
+        None. Code that loads or stores through the table must check the
+        id against count, the segment against NULL and the address 
+        against the length header, and leave anything else to 
+        value_in_segment and store_in_segment.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Segment_table segment_table(Memory mem) {
+        assert(mem != NULL);
+        Segment_table table = {
+                .segments = &mem->segments,
+                .count = &mem->segment_count,
+                .images = &mem->segment_image,
+                .image_count = &mem->segment_image_length
+        };
+        return table;
+}
+
+/*
+    machine_registers
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        pointer to the machine's eight registers
+    Effects:
+        None. The registers belong to mem, so each machine has its own; 
+        they start at 0 and live as long as mem.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint32_t *machine_registers(Memory mem) {
+        assert(mem != NULL);
+        return mem->registers;
+}
+
+/*
+    set_machine_io
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        Input_fn input: callback for the input instruction, or NULL
+        Output_fn output: callback for the output instruction, or NULL
+        void *context: passed to both callbacks
+    Returns:
+        none
+    Effects:
+        Routes the machine's input and output through the callbacks. A NULL
+        callback means standard input or standard output.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_machine_io(Memory mem, Input_fn input, Output_fn output, 
+                    void *context) {
+        assert(mem != NULL);
+        mem->input = input;
+        mem->output = output;
+        mem->io_context = context;
+}
+
+/*
+    refill_input
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        true if the input cursor has bytes again, false at end of input
+    Effects:
+        The first time, maps standard input if it is a regular file and
+        serves it from its current offset to its end straight from the
+        mapping, leaving the offset at the end. Otherwise, or once the
+        mapping is used up, reads up to INPUT_BUFFER_BYTES into the
+        machine's input buffer: a read returns what a pipe or terminal has
+        ready, so an interactive program never waits for a full buffer.
+        End of input (or a read error) is final, as it is for stdio.
+    ***************************************************************************
+*/
+static bool refill_input(Memory mem) {
+        if (mem->input_map != NULL) {
+                munmap(mem->input_map, mem->input_map_bytes);
+                mem->input_map = NULL;
+        } else if (!mem->input_probed) {
+                mem->input_probed = true;
+                struct stat status;
+                off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+                if (fstat(STDIN_FILENO, &status) == 0 &&
+                    S_ISREG(status.st_mode) && offset >= 0 &&
+                    status.st_size > offset) {
+                        size_t bytes = (size_t)status.st_size;
+                        uint8_t *map = mmap(NULL, bytes, PROT_READ,
+                                            MAP_PRIVATE, STDIN_FILENO, 0);
+                        if (map != MAP_FAILED) {
+                                madvise(map, bytes, MADV_SEQUENTIAL);
+                                lseek(STDIN_FILENO, status.st_size,
+                                      SEEK_SET);
+                                mem->input_map = map;
+                                mem->input_map_bytes = bytes;
+                                mem->input_at = map + offset;
+                                mem->input_end = map + bytes;
+                                return true;
+                        }
+                }
+        }
+        if (mem->input_ended) {
+                return false;
+        }
+        if (mem->input_buffer == NULL) {
+                mem->input_buffer = malloc(INPUT_BUFFER_BYTES);
+                assert(mem->input_buffer != NULL);
+        }
+        ssize_t got;
+        do {
+                got = read(STDIN_FILENO, mem->input_buffer,
+                           INPUT_BUFFER_BYTES);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0) {
+                mem->input_ended = true;
+                mem->input_at = mem->input_end = NULL;
+                return false;
+        }
+        mem->input_at = mem->input_buffer;
+        mem->input_end = mem->input_buffer + got;
+        return true;
+}
+
+/*
+    machine_input
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        the next input byte, EOF, or UM_INPUT_WAIT
+    Effects:
+        Takes the byte from the input callback or, without one, from the
+        machine's cursor into standard input. Buffered output is flushed
+        first whenever the program might wait for its input, so that a
+        prompt is seen before it waits for the answer: before every call
+        to the callback, and before refill_input when the cursor runs out.
+        A byte already read ahead is served without a flush.
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+int machine_input(Memory mem) {
+        if (__builtin_expect(mem->input_at == mem->input_end, 0)) {
+                if (mem->output_length > 0) {
+                        flush_output(mem);
+                }
+                if (mem->input != NULL) {
+                        return mem->input(mem->io_context);
+                }
+                if (!refill_input(mem)) {
+                        return EOF;
+                }
+        }
+        return *mem->input_at++;
+}
+
+/*
+    claim_output
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Gives the machine an output buffer of up to OUTPUT_BUFFER_BYTES: the
+        free space at the head of the writer's ring if the writer thread is
+        running (waiting for room if the ring is full), and otherwise a
+        buffer of its own, kept until free_segments
+    ***************************************************************************
+*/
+static void claim_output(Memory mem) {
+        if (writer_running()) {
+                uint32_t bytes;
+                mem->output_buffer = writer_space(&bytes);
+                mem->output_space = bytes < OUTPUT_BUFFER_BYTES ?
+                                    bytes : OUTPUT_BUFFER_BYTES;
+                return;
+        }
+        mem->output_buffer = malloc(OUTPUT_BUFFER_BYTES);
+        assert(mem->output_buffer != NULL);
+        mem->output_space = OUTPUT_BUFFER_BYTES;
+}
+
+/*
+    machine_output
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint8_t byte: byte the program outputs
+    Returns:
+        none
+    Effects:
+        Passes byte to the output callback, or if there is none adds it to
+        the machine's output buffer (its own, or space in the writer's
+        ring with --async-output), which is flushed to stdout when it
+        fills and, with flush_at_newline, at every newline
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void machine_output(Memory mem, uint8_t byte) {
+        if (mem->output != NULL) {
+                mem->output(byte, mem->io_context);
+                return;
+        }
+        if (__builtin_expect(mem->output_buffer == NULL, 0)) {
+                claim_output(mem);
+        }
+        mem->output_buffer[mem->output_length++] = byte;
+        if (mem->output_length == mem->output_space ||
+            (byte == '\n' && flush_at_newline)) {
+                flush_output(mem);
+        }
+}
+
+/*
+    flush_output
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Writes the machine's buffered output to standard output and empties
+        the buffer; output that cannot be written is dropped, as stdio
+        would. With the writer thread running, the buffer is instead
+        committed to its ring, to be written with writev while the machine
+        runs on, and the next output claims new space. Besides
+        machine_output and machine_input, execute_until calls this
+        whenever the machine stops for anything but its budget, and
+        free_segments before it frees the buffer (or waits for the writer
+        to drain).
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void flush_output(Memory mem) {
+        assert(mem != NULL);
+        if (writer_running()) {
+                if (mem->output_length > 0) {
+                        writer_commit(mem->output_length);
+                        mem->output_buffer = NULL;
+                        mem->output_length = 0;
+                }
+                return;
+        }
+        uint32_t done = 0;
+        while (done < mem->output_length) {
+                ssize_t written = write(STDOUT_FILENO, 
+                                        mem->output_buffer + done, 
+                                        mem->output_length - done);
+                if (written < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (written <= 0) {
+                        break;
+                }
+                done += (uint32_t)written;
+        }
+        mem->output_length = 0;
+}
+
+/*
+    count_executed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t count: instructions an engine has just executed
+    Returns:
+        none
+    Effects:
+        Adds count to the machine's instruction count. Each engine calls 
+        this as it returns, so the count is only current between runs.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void count_executed(Memory mem, uint64_t count) {
+        mem->executed += count;
+}
+
+/*
+    instructions_executed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        the number of instructions the machine has executed since it was
+        created, loaded or restored
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint64_t instructions_executed(Memory mem) {
+        return mem->executed;
+}
+
+/*
+    report_allocation
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how many segments of each size class the machine has mapped
+        and what fraction of them reused a block an earlier unmap freed
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_allocation(Memory mem, FILE *fp) {
+        assert(mem != NULL);
+        slab_report(mem->slab, fp);
+}
+
+/*
+    set_memory_quota
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t words: most words the segments other than segment 0 may
+                        hold at once, 0 for no limit
+    Returns:
+        none
+    Effects:
+        From now on, a map that would take the machine's mapped words over
+        words fails (see map_segment_helper). Segments already mapped are
+        kept even if they are over it.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_memory_quota(Memory mem, uint64_t words) {
+        assert(mem != NULL);
+        mem->quota_words = words == 0 ? UINT64_MAX : words;
+}
+
+/*
+    memory_stats
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        Memory_stats *stats: set to the machine's counters
+    Returns:
+        none
+    Effects:
+        Fills in stats; reading the counters costs nothing but the clock
+        read for the machine's age, so it can be called at any time
+    Expects: 
+        Memory struct pointer and stats are not NULL
+    ***************************************************************************
+*/
+void memory_stats(Memory mem, Memory_stats *stats) {
+        assert(mem != NULL && stats != NULL);
+        /* Entry 0 of the table is segment 0, which is always mapped */
+        stats->live_segments = mem->segment_count > 0 ?
+                               mem->segment_count - 1 - mem->free_count : 0;
+        stats->free_ids = mem->free_count;
+        stats->program_words = mem->program_length;
+        stats->mapped_words = mem->mapped_words;
+        stats->peak_words = mem->peak_words;
+        stats->maps = mem->maps;
+        stats->unmaps = mem->unmaps;
+        stats->failed_maps = mem->failed_maps;
+        stats->quota_words = mem->quota_words == UINT64_MAX ? 
+                             0 : mem->quota_words;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats->seconds = (now.tv_sec - mem->created.tv_sec) +
+                         (now.tv_nsec - mem->created.tv_nsec) / 1e9;
+}
+
+/*
+    report_memory_stats
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints the machine's memory counters (memory_stats): live segments
+        and free ids, mapped and peak words, maps and unmaps with their
+        rates over the machine's life, failed maps and the quota
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_memory_stats(Memory mem, FILE *fp) {
+        Memory_stats stats;
+        memory_stats(mem, &stats);
+        double seconds = stats.seconds > 0 ? stats.seconds : 1e-9;
+        fprintf(fp, "segments: %u live, %u free ids, segment 0 %u words\n",
+                stats.live_segments, stats.free_ids, stats.program_words);
+        fprintf(fp, "words: %llu mapped, %llu at peak (%.1f MB)\n",
+                (unsigned long long)stats.mapped_words,
+                (unsigned long long)stats.peak_words,
+                stats.peak_words * 4.0 / (1 << 20));
+        fprintf(fp, "maps: %llu (%.1f K/s), unmaps: %llu (%.1f K/s), "
+                    "%llu failed, over %.3f s\n",
+                (unsigned long long)stats.maps, stats.maps / seconds / 1e3,
+                (unsigned long long)stats.unmaps, 
+                stats.unmaps / seconds / 1e3,
+                (unsigned long long)stats.failed_maps, stats.seconds);
+        if (stats.quota_words != 0) {
+                fprintf(fp, "quota: %llu words, %.1f%% used at peak\n",
+                        (unsigned long long)stats.quota_words,
+                        100.0 * stats.peak_words / stats.quota_words);
+        }
+}
+
+/*
+    report_map_failure
+    ***************************************************************************
+    Input: 
+        Memory mem : a machine an engine stopped with STOP_MAP_FAILED
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints which map was refused, at which address, and whether it was
+        over the machine's quota or the host was out of memory
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_map_failure(Memory mem, FILE *fp) {
+        assert(mem != NULL);
+        fprintf(fp, "um: map of %u words at %u failed: ", mem->failed_length,
+                program_counter(mem));
+        if (mem->mapped_words + mem->failed_length > mem->quota_words) {
+                fprintf(fp, "over the memory quota of %llu words "
+                            "(%llu mapped)\n",
+                        (unsigned long long)mem->quota_words,
+                        (unsigned long long)mem->mapped_words);
+        } else {
+                fprintf(fp, "out of memory (%llu words mapped)\n",
+                        (unsigned long long)mem->mapped_words);
+        }
+}
+
+/*
+    page_sum
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: a page's words
+        size_t size: number of words in the page
+    Returns:
+        the page's digest: 0 for a page of zeros, and otherwise an FNV-1a
+        hash taken a word at a time (so that any one changed word changes
+        it), or 1 if that hash is 0
+    ***************************************************************************
+*/
+static uint64_t page_sum(const uint32_t *words, size_t size) {
+        uint64_t hash = UINT64_C(0xcbf29ce484222325);
+        uint32_t any = 0;
+        for (size_t i = 0; i < size; i++) {
+                hash = (hash ^ words[i]) * UINT64_C(0x100000001b3);
+                any |= words[i];
+        }
+        if (any == 0) {
+                return 0;
+        }
+        return hash != 0 ? hash : 1;
+}
+
+/*
+    new_sums
+    ***************************************************************************
+    Input: 
+        const uint32_t *lengths: count segment lengths (UNMAPPED_SEGMENT for
+                                 an unmapped id)
+        uint32_t count: number of segment ids
+    Returns:
+        digests of count segments with those lengths, whose sums are not
+        yet filled in, or NULL if they do not fit in memory
+    ***************************************************************************
+*/
+static Memory_sums new_sums(const uint32_t *lengths, uint32_t count) {
+        Memory_sums sums = calloc(1, sizeof(*sums));
+        if (sums == NULL) {
+                return NULL;
+        }
+        sums->count = count;
+        sums->lengths = malloc(((size_t)count + 1) * sizeof(uint32_t));
+        sums->first = malloc(((size_t)count + 1) * sizeof(size_t));
+        size_t total = 0;
+        for (uint32_t id = 0; sums->first != NULL && id < count; id++) {
+                sums->first[id] = total;
+                if (lengths[id] != UNMAPPED_SEGMENT) {
+                        total += page_count(lengths[id]);
+                }
+        }
+        if (sums->first != NULL) {
+                sums->first[count] = total;
+        }
+        sums->sums = malloc((total + 1) * sizeof(uint64_t));
+        if (sums->lengths == NULL || sums->first == NULL || 
+            sums->sums == NULL) {
+                free_memory_sums(&sums);
+                return NULL;
+        }
+        memcpy(sums->lengths, lengths, (size_t)count * sizeof(uint32_t));
+        return sums;
+}
+
+/*
+    memory_sums
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        the length of every segment id of mem and a digest (page_sum) of
+        each CHECKPOINT_PAGE_WORDS page of the mapped ones, which
+        write_memory_changes compares with the digests of an earlier state
+        to find what changed since; the caller frees it with
+        free_memory_sums
+    Effects:
+        Reads every mapped word, so that the machine pays nothing for
+        checkpoints as it runs. A checkpoint calls this in the process
+        it forks to write the record.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Memory_sums memory_sums(Memory mem) {
+        assert(mem != NULL);
+        uint32_t count = mem->segment_count;
+        uint32_t *lengths = calloc((size_t)count + 1, sizeof(uint32_t));
+        assert(lengths != NULL);
+        for (uint32_t id = 0; id < count; id++) {
+                const uint32_t *words = id == 0 ? mem->program 
+                                                : mem->segments[id];
+                lengths[id] = id == 0 ? mem->program_length :
+                              words != NULL ? segment_words_length(words)
+                                            : UNMAPPED_SEGMENT;
+        }
+        Memory_sums sums = new_sums(lengths, count);
+        free(lengths);
+        assert(sums != NULL);
+        for (uint32_t id = 0; id < count; id++) {
+                uint32_t length = sums->lengths[id];
+                if (length == UNMAPPED_SEGMENT) {
+                        continue;
+                }
+                const uint32_t *words = id == 0 ? mem->program 
+                                                : mem->segments[id];
+                for (uint32_t page = 0; page < page_count(length); page++) {
+                        size_t first = (size_t)page * CHECKPOINT_PAGE_WORDS;
+                        size_t size = length - first < CHECKPOINT_PAGE_WORDS ?
+                                      length - first : CHECKPOINT_PAGE_WORDS;
+                        sums->sums[sums->first[id] + page] = 
+                                page_sum(words + first, size);
+                }
+        }
+        return sums;
+}
+
+/*
+    write_memory_sums
+    ***************************************************************************
+    Input: 
+        Memory_sums sums: digests made by memory_sums
+        FILE *fp: stream the digests are written to
+    Returns:
+        true if every write succeeded, false otherwise
+    Effects:
+        Writes, in host order, the number of segment ids, the length of
+        each, then every page's 64-bit digest
+    Expects: 
+        sums and fp are not NULL
+    ***************************************************************************
+*/
+bool write_memory_sums(Memory_sums sums, FILE *fp) {
+        assert(sums != NULL && fp != NULL);
+        size_t total = sums->first[sums->count];
+        return fwrite(&sums->count, sizeof(uint32_t), 1, fp) == 1 &&
+               fwrite(sums->lengths, sizeof(uint32_t), sums->count, fp) 
+                                                        == sums->count &&
+               fwrite(sums->sums, sizeof(uint64_t), total, fp) == total;
+}
+
+/*
+    read_memory_sums
+    ***************************************************************************
+    Input: 
+        FILE *fp: stream written by write_memory_sums
+    Returns:
+        the digests read, or NULL if fp does not hold exactly one set of
+        them; the caller frees them with free_memory_sums
+    Expects: 
+        fp is not NULL
+    ***************************************************************************
+*/
+Memory_sums read_memory_sums(FILE *fp) {
+        assert(fp != NULL);
+        uint32_t count;
+        if (fread(&count, sizeof(count), 1, fp) != 1) {
+                return NULL;
+        }
+        uint32_t *lengths = malloc(((size_t)count + 1) * sizeof(uint32_t));
+        if (lengths == NULL || 
+            fread(lengths, sizeof(uint32_t), count, fp) != count) {
+                free(lengths);
+                return NULL;
+        }
+        Memory_sums sums = new_sums(lengths, count);
+        free(lengths);
+        if (sums == NULL) {
+                return NULL;
+        }
+        size_t total = sums->first[count];
+        if (fread(sums->sums, sizeof(uint64_t), total, fp) != total ||
+            fgetc(fp) != EOF) {
+                free_memory_sums(&sums);
+        }
+        return sums;
+}
+
+/*
+    free_memory_sums
+    ***************************************************************************
+    Input: 
+        Memory_sums *sums: digests to free, or a pointer to NULL
+    Returns:
+        none
+    Effects:
+        Frees the digests and sets *sums to NULL
+    Expects: 
+        sums is not NULL
+    ***************************************************************************
+*/
+void free_memory_sums(Memory_sums *sums) {
+        assert(sums != NULL);
+        if (*sums == NULL) {
+                return;
+        }
+        free((*sums)->lengths);
+        free((*sums)->first);
+        free((*sums)->sums);
+        free(*sums);
+        *sums = NULL;
+}
+
+/*
+    write_pages
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: a segment's words
+        uint32_t length: number of words in the segment
+        const uint64_t *old: the digests its pages had, or NULL if it was
+                             all zeros
+        const uint64_t *now: the digests its pages have
+        FILE *fp: stream to write to
+    Returns:
+        true if every write succeeded
+    Effects:
+        Writes the number of pages whose digests differ, then each of them
+        as its index followed by its words (the last page of the segment 
+        may be short)
+    ***************************************************************************
+*/
+static bool write_pages(const uint32_t *words, uint32_t length, 
+                        const uint64_t *old, const uint64_t *now, FILE *fp) {
+        uint32_t pages = page_count(length);
+        uint32_t count = 0;
+        for (uint32_t page = 0; page < pages; page++) {
+                count += now[page] != (old != NULL ? old[page] : 0);
+        }
+        bool ok = fwrite(&count, sizeof(count), 1, fp) == 1;
+        for (uint32_t page = 0; ok && page < pages; page++) {
+                if (now[page] == (old != NULL ? old[page] : 0)) {
+                        continue;
+                }
+                size_t first = (size_t)page * CHECKPOINT_PAGE_WORDS;
+                size_t size = length - first < CHECKPOINT_PAGE_WORDS ?
+                              length - first : CHECKPOINT_PAGE_WORDS;
+                ok = fwrite(&page, sizeof(page), 1, fp) == 1 &&
+                     fwrite(words + first, sizeof(uint32_t), size, fp) 
+                                                                == size;
+        }
+        return ok;
+}
+
+/*
+    segment_changed
+    ***************************************************************************
+    Input: 
+        Memory_sums old: digests of the earlier state
+        Memory_sums now: digests of the current state
+        uint32_t id: segment id below now->count
+        bool *fresh: set to whether the segment must be rebuilt from zeros
+    Returns:
+        whether segment id differs between the two states: it was mapped
+        or unmapped, its length changed (both fresh), or a page's digest
+        changed
+    ***************************************************************************
+*/
+static bool segment_changed(Memory_sums old, Memory_sums now, uint32_t id,
+                            bool *fresh) {
+        uint32_t was = id < old->count ? old->lengths[id] : UNMAPPED_SEGMENT;
+        uint32_t length = now->lengths[id];
+        *fresh = was != length;
+        if (*fresh || length == UNMAPPED_SEGMENT) {
+                return *fresh;
+        }
+        return memcmp(old->sums + old->first[id], now->sums + now->first[id],
+                      (size_t)page_count(length) * sizeof(uint64_t)) != 0;
+}
+
+/*
+    write_memory_changes
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct the digests now were made of
+        Memory_sums old: digests of an earlier state of mem
+        Memory_sums now: digests of mem as it is (memory_sums)
+        FILE *fp: stream the changes are written to
+    Returns:
+        true if every write succeeded, false otherwise (or if old has more
+        segment ids than now, which no earlier state of mem has)
+    Effects:
+        Writes what changed since the state old was made of as host-order
+        32-bit words:
+            program_counter, segment count, free count, changed count,
+            free ids..., then per changed segment its id, its length
+            (UNMAPPED_SEGMENT if it is unmapped), 1 if it is fresh (its
+            old contents are gone and its other words are 0) or 0, and
+            the pages of it that must be saved (see write_pages)
+        A segment is changed if it was mapped, unmapped or resized, or if
+        the digest of one of its pages differs, and only those pages
+        (or, for a fresh segment, its pages that are not all zeros) are
+        saved. Two different pages with the same 64-bit digest would be
+        taken as unchanged.
+    Expects: 
+        Memory struct pointer, old, now and fp are not NULL, now is of mem
+        as it is, fp is open for writing
+    ***************************************************************************
+*/
+bool write_memory_changes(Memory mem, Memory_sums old, Memory_sums now,
+                          FILE *fp) {
+        assert(mem != NULL && old != NULL && now != NULL && fp != NULL);
+        assert(now->count == mem->segment_count);
+        if (old->count > now->count) {
+                return false;
+        }
+        uint32_t changed = 0;
+        bool fresh;
+        for (uint32_t id = 0; id < now->count; id++) {
+                changed += segment_changed(old, now, id, &fresh);
+        }
+        uint32_t header[4] = { (uint32_t)mem->program_counter, 
+                               mem->segment_count, mem->free_count,
+                               changed };
+        bool ok = fwrite(header, sizeof(uint32_t), 4, fp) == 4 &&
+                  (mem->free_count == 0 ||
+                   fwrite(mem->free_ids, sizeof(uint32_t), mem->free_count,
+                          fp) == mem->free_count);
+        for (uint32_t id = 0; ok && id < now->count; id++) {
+                if (!segment_changed(old, now, id, &fresh)) {
+                        continue;
+                }
+                uint32_t length = now->lengths[id];
+                uint32_t fields[3] = { id, length, fresh };
+                ok = fwrite(fields, sizeof(uint32_t), 3, fp) == 3;
+                if (!ok) {
+                        break;
+                }
+                if (length == UNMAPPED_SEGMENT) {
+                        uint32_t none = 0;
+                        ok = fwrite(&none, sizeof(none), 1, fp) == 1;
+                        continue;
+                }
+                const uint32_t *words = id == 0 ? mem->program 
+                                                : mem->segments[id];
+                ok = write_pages(words, length, 
+                                 fresh ? NULL : old->sums + old->first[id],
+                                 now->sums + now->first[id], fp);
+        }
+        return ok;
+}
+
+/*
+    apply_memory_changes
+    ***************************************************************************
+    Input: 
+        Memory mem : machine rebuilt by read_memory (and any changes applied
+                     to it since), not yet run
+        const uint32_t *words: changes in the format of write_memory_changes
+        size_t count: number of words available
+        size_t *used: set to the number of words the changes occupied
+    Returns:
+        true if the changes were applied, false if they are truncated or do
+        not fit the machine, which may then be left half-changed
+    Effects:
+        Brings mem to the state the changes were written in: grows the
+        segment table, unmaps, remaps and replaces the changed segments,
+        copies in their saved pages and replaces the free id stack and the
+        program counter
+    Expects: 
+        Memory struct pointer and used are not NULL
+    ***************************************************************************
+*/
+bool apply_memory_changes(Memory mem, const uint32_t *words, size_t count,
+                          size_t *used) {
+        assert(mem != NULL && used != NULL);
+        if (count < 4) {
+                return false;
+        }
+        uint32_t segment_count = words[1];
+        uint32_t free_length = words[2];
+        uint32_t changed = words[3];
+        size_t at = 4;
+        if (segment_count < mem->segment_count || 
+            count - at < free_length) {
+                return false;
+        }
+        const uint32_t *free_ids = words + at;
+        at += free_length;
+        note_program_changed(mem);
+        /* Every new id has a change record of at least 4 words, so a bad
+           count is caught before the table grows to it */
+        if (changed > (count - at) / 4 ||
+            segment_count - mem->segment_count > changed) {
+                return false;
+        }
+        while (mem->segment_count < segment_count) {
+                add_segment(mem, NULL);
+        }
+
+        for (uint32_t i = 0; i < changed; i++) {
+                if (count - at < 4) {
+                        return false;
+                }
+                uint32_t id = words[at];
+                uint32_t length = words[at + 1];
+                bool fresh = words[at + 2] != 0;
+                uint32_t pages = words[at + 3];
+                at += 4;
+                if (id >= segment_count) {
+                        return false;
+                }
+                uint32_t *segment = id == 0 ? mem->program 
+                                            : mem->segments[id];
+                if (length == UNMAPPED_SEGMENT) {
+                        if (id == 0 || pages != 0) {
+                                return false;
+                        }
+                        free_segment(mem, segment);
+                        mem->segments[id] = NULL;
+                        continue;
+                }
+                if (fresh && id == 0) {
+                        uint32_t stale = mem->program_length > length ?
+                                         mem->program_length : length;
+                        reserve_program(mem, length > 0 ? length : 1);
+                        memset(mem->program, 0, 
+                               (size_t)length * sizeof(uint32_t));
+                        memset(mem->decoded, 0, 
+                               (size_t)stale * sizeof(Predecoded));
+                        mem->program_length = length;
+                        segment = mem->program;
+                } else if (fresh) {
+                        free_segment(mem, segment);
+                        segment = new_segment(mem, length);
+                        mem->segments[id] = segment;
+                        if (segment == NULL) {
+                                return false;
+                        }
+                } else if (segment == NULL || 
+                           length != (id == 0 ? mem->program_length :
+                                      segment_words_length(segment))) {
+                        return false;
+                }
+                for (uint32_t j = 0; j < pages; j++) {
+                        if (at == count) {
+                                return false;
+                        }
+                        uint32_t page = words[at++];
+                        if (page >= page_count(length)) {
+                                return false;
+                        }
+                        size_t first = (size_t)page * CHECKPOINT_PAGE_WORDS;
+                        size_t size = length - first < CHECKPOINT_PAGE_WORDS ?
+                                      length - first : CHECKPOINT_PAGE_WORDS;
+                        if (count - at < size) {
+                                return false;
+                        }
+                        memcpy(segment + first, words + at, 
+                               size * sizeof(uint32_t));
+                        at += size;
+                        if (id == 0) {
+                                /* The page and the superinstructions
+                                   that may run into it from the words
+                                   before (PREDECODE_SPAN) */
+                                size_t from = first >= PREDECODE_SPAN - 1 ?
+                                              first - (PREDECODE_SPAN - 1) :
+                                              0;
+                                memset(mem->decoded + from, 0, 
+                                       (first + size - from) * 
+                                       sizeof(Predecoded));
+                        }
+                }
+        }
+
+        mem->free_count = 0;
+        for (uint32_t i = 0; i < free_length; i++) {
+                uint32_t id = free_ids[i];
+                if (id == 0 || id >= segment_count || 
+                    mem->segments[id] != NULL) {
+                        return false;
+                }
+                push_free_id(mem, id);
+        }
+        mem->program_counter = words[0];
+        *used = at;
+        return true;
 }
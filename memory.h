@@ -13,10 +13,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <assert.h>
-#include <seq.h>
-#include <bitpack.h>
 #include <byteswap.h>
-#include <uarray.h>
 #include <stdbool.h>
 
 #ifndef MEMORY_H
@@ -25,6 +22,86 @@
 
 typedef struct Memory *Memory; 
 
+/* Digests of the pages of a machine's segments (see memory_sums) */
+typedef struct Memory_sums *Memory_sums;
+
+/* Decoded form of one segment 0 word, cached for the execution engines.
+   handler is the engine's code for the word, or NULL if the word has not
+   been decoded since it was last written. a, b and c are the register
+   fields, and value is the loadval immediate (with its register in a). */
+typedef struct Predecoded {
+        const void *handler;
+        uint8_t a, b, c;
+        uint32_t value;
+} Predecoded;
+
+/* Number of words a predecoded entry may depend on, starting with its own:
+   an engine may fuse a word with the one after it. A store to segment 0 
+   therefore discards the entries of the PREDECODE_SPAN - 1 words before the
+   stored word as well as its own. */
+#define PREDECODE_SPAN 2
+
+/* Number of segments load_program keeps copies of, so that swapping the
+   same code back into segment 0 neither reads the segment again nor 
+   decodes it again */
+#define PROGRAM_IMAGES 8
+
+/* Returned by an input callback that has no byte for the machine yet; the
+   engine stops in front of the input instruction (STOP_INPUT) */
+#define UM_INPUT_WAIT (-2)
+
+/* Machine input and output callbacks (see set_machine_io). An input 
+   callback returns a byte, EOF at end of input, or UM_INPUT_WAIT. */
+typedef int (*Input_fn)(void *context);
+typedef void (*Output_fn)(uint8_t byte, void *context);
+
+/* Length written by write_memory in place of an unmapped segment */
+#define UNMAPPED_SEGMENT UINT32_MAX
+
+/* Words in a page of a segment as far as checkpoints go: memory_sums
+   digests whole pages, and write_memory_changes saves whole pages */
+#define CHECKPOINT_PAGE_WORDS 1024
+
+/* Bytes of output a machine buffers before writing them to stdout */
+#define OUTPUT_BUFFER_BYTES 65536
+
+/* Most bytes a machine reads from standard input at once when it is not a
+   regular file (see machine_input) */
+#define INPUT_BUFFER_BYTES 65536
+
+/* Whether buffered output is also flushed at every newline (--flush=line,
+   the default when standard output is a terminal) */
+extern bool flush_at_newline;
+
+/* A machine's memory counters (see memory_stats). Words are counted in the
+   segments other than segment 0, without their length headers. */
+typedef struct Memory_stats {
+        uint32_t live_segments;
+        uint32_t free_ids;      /* unmapped ids waiting to be reused */
+        uint32_t program_words; /* length of segment 0 */
+        uint64_t mapped_words;
+        uint64_t peak_words;
+        uint64_t maps;
+        uint64_t unmaps;
+        uint64_t failed_maps;
+        uint64_t quota_words;   /* 0 for no quota */
+        double seconds;         /* since the machine was created */
+} Memory_stats;
+
+/* Where a machine keeps its segment table, for an engine that generates
+   code to load and store segments other than segment 0 inline (see
+   segment_table). segments[id] is NULL for an unmapped id, or else the
+   words of the segment, after a header word holding its length. A store
+   to segment id sets images[id] to 0 if id < image_count. The pointers
+   stay valid for the machine's lifetime; what they point to changes as
+   segments are mapped and unmapped. */
+typedef struct Segment_table {
+        uint32_t ***segments;
+        const uint32_t *count;          /* number of ids in segments */
+        uint64_t **images;
+        const uint32_t *image_count;
+} Segment_table;
+
 /*
     create_segment0
     ***************************************************************************
@@ -57,6 +134,44 @@ Memory create_segment0();
 */
 void append_segment0(Memory mem, uint32_t word);
 
+/*
+    append_segment0_words
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        const uint32_t *words: host-order words to append
+        size_t count: number of words in the words array
+    Returns:
+        none
+    Effects:
+        Adds all count words to the end of segment0, in order
+    Expects: 
+        words is not NULL unless count is 0
+    ***************************************************************************
+*/
+void append_segment0_words(Memory mem, const uint32_t *words, size_t count);
+
+/*
+    extend_segment0
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        size_t count: number of words to add
+    Returns:
+        address of the count words now at the end of segment0, for the
+        caller to fill in place
+    Effects:
+        Grows segment0 by count words whose contents are unspecified until
+        the caller writes them, so that a loader can convert an image
+        straight into segment0's storage instead of copying it there
+    Expects: 
+        The caller writes all count words before segment0 is used
+    ***************************************************************************
+*/
+uint32_t *extend_segment0(Memory mem, size_t count);
+
 /*
     map_segment_helper
     ***************************************************************************
@@ -65,9 +180,16 @@ void append_segment0(Memory mem, uint32_t word);
                         and program counter
         uint32_t num_words: number of words the sequenc will hold
     Returns:
-        uint32_t holding the index of the mapped segment
+        uint32_t holding the index of the mapped segment, or 0 if the map
+        was refused
     Effects:
         Creates a new memory segment and adds it to the sequence of segments.
+        If there is a free (unmapped) index, the segment is placed at the
+        one unmapped most recently; otherwise, the segment is added to the
+        end of the table. A map that would take the mapped words over the
+        machine's quota, or that the host has no memory for, maps nothing
+        and is counted as failed; the engines then stop in front of it
+        (STOP_MAP_FAILED).
     Expects: 
         memory struct pointer is not NULL
     ***************************************************************************
@@ -85,9 +207,10 @@ uint32_t map_segment_helper(Memory mem, uint32_t num_words);
         none
     Effects:
         Replaces the segment at the specified index with a NULL pointer 
-        and appends the (now free) index to the free_segments sequence
+        and pushes the (now free) index onto the free id stack
     Expects: 
-        memory struct pointer is not NULL
+        memory struct pointer is not NULL, rC is a mapped segment other 
+        than segment 0
     ***************************************************************************
 */
 void unmap_segment_helper(Memory mem, uint32_t rC);
@@ -105,13 +228,59 @@ void unmap_segment_helper(Memory mem, uint32_t rC);
     Returns:
         none
     Effects:
-        
+        Replaces segment 0 with a duplicate of segment[rB] unless rB is 0,
+        then sets the program counter to rC. The duplicate comes from a 
+        cache of the last PROGRAM_IMAGES segments loaded: a segment loaded
+        before and not stored to since is not read again, and one whose 
+        contents match a cached image takes over that image's predecoded
+        words from the last time it was segment 0.
     Expects: 
         memory struct pointer is not NULL
     ***************************************************************************
 */
 void load_program_helper(Memory mem, uint32_t rB, uint32_t rC);
 
+/*
+    program_image
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        id of the program image segment0 was last loaded from, or 0
+    Effects:
+        None. An id is never reused, and one whose image segment0 was 
+        modified from is retired when segment0 is swapped out, so state 
+        an engine derived from segment0 may be kept under the id and 
+        reused when a later load_program_helper installs the same id.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint64_t program_image(Memory mem);
+
+/*
+    program_version, note_program_changed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        program_version: a number that changes whenever segment0 is 
+        stored to, grown or replaced, and that no other machine in the 
+        process has ever had
+    Effects:
+        note_program_changed gives segment0 a new version, from a counter
+        shared by every machine (machines of a batch run on several
+        threads, so it is updated atomically). An engine that stores to 
+        segment0 through program_words calls it before it returns.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint64_t program_version(Memory mem);
+void note_program_changed(Memory mem);
+
 /*
     value_in_segment
     ***************************************************************************
@@ -125,7 +294,9 @@ void load_program_helper(Memory mem, uint32_t rB, uint32_t rC);
     Effects:
         None
     Expects: 
-        Memory struct pointer is not NULL
+        Memory struct pointer is not NULL; the segment is mapped and the
+        address is inside it (a checked runtime error otherwise, for
+        segment 0 as for the others)
     ***************************************************************************
 */
 uint32_t value_in_segment(Memory mem, uint32_t indexB, uint32_t indexC);
@@ -142,9 +313,13 @@ uint32_t value_in_segment(Memory mem, uint32_t indexB, uint32_t indexC);
     Returns:
         None
     Effects:
-        Stores 'value' in segment[indexA][indexB]
+        Stores 'value' in segment[indexA][indexB]. A store to segment0 
+        also discards the predecoded form of the word and of the
+        PREDECODE_SPAN - 1 words before it.
     Expects: 
-        Memory struct pointer is not NULL
+        Memory struct pointer is not NULL; the segment is mapped and the
+        address is inside it (a checked runtime error otherwise, for
+        segment 0 as for the others)
     ***************************************************************************
 */
 void store_in_segment(Memory mem, uint32_t value, uint32_t indexA, 
@@ -178,7 +353,8 @@ uint32_t instruction(Memory mem);
     Effects:
         Frees all segments, free_sequences, and the sequence that holds the 
         segments. All allocated memory is deallocated in this function,
-        including the Memory struct
+        including the Memory struct. Buffered output is written first; with
+        --async-output this waits until the writer thread has written it.
     Expects: 
         Memory struct pointer is not NULL
     ***************************************************************************
@@ -203,5 +379,521 @@ void free_segments(Memory mem);
 */
 bool instructions_complete(Memory mem);
 
+/*
+    program_counter
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        index in segment0 of the next instruction to execute
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint32_t program_counter(Memory mem);
+
+/*
+    set_program_counter
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t counter: index in segment0 of the next instruction
+    Returns:
+        None
+    Effects:
+        Sets the program counter to counter
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_program_counter(Memory mem, uint32_t counter);
+
+/*
+    segment_length
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t id : segment id
+    Returns:
+        number of words in segment[id]
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL and segment[id] is mapped
+    ***************************************************************************
+*/
+uint32_t segment_length(Memory mem, uint32_t id);
+
+/*
+    segment_fingerprint
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t id : segment id
+    Returns:
+        64-bit FNV-1a hash of the length and contents of segment[id]
+    Effects:
+        None
+    Expects: 
+        Memory struct pointer is not NULL and segment[id] is mapped
+    ***************************************************************************
+*/
+uint64_t segment_fingerprint(Memory mem, uint32_t id);
+
+/*
+    write_memory
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream the memory image is written to
+    Returns:
+        true if every write succeeded, false otherwise
+    Effects:
+        Writes the program counter, the free id stack (bottom first) and
+        every entry of the segment table to fp as host-order 32-bit words:
+            program_counter, segment count, free count, free ids...,
+            then per segment its length (UNMAPPED_SEGMENT if it is unmapped)
+            followed by its words
+    Expects: 
+        Memory struct pointer is not NULL, fp is open for writing
+    ***************************************************************************
+*/
+bool write_memory(Memory mem, FILE *fp);
+
+/*
+    read_memory
+    ***************************************************************************
+    Input: 
+        const uint32_t *words: memory image in the format of write_memory
+        size_t count: number of words available in the image
+        size_t *used: set to the number of words the image occupied
+    Returns:
+        a new Memory struct holding the segments, free list and program
+        counter described by the image, or NULL if the image is truncated
+        or inconsistent
+    Effects:
+        Allocates the Memory struct and all of its segments
+    Expects: 
+        words is not NULL unless count is 0, used is not NULL
+    ***************************************************************************
+*/
+Memory read_memory(const uint32_t *words, size_t count, size_t *used);
+
+/*
+    program_words
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint32_t *length : set to the number of words in segment0
+    Returns:
+        pointer to the words of segment0
+    Effects:
+        None. The pointer stays valid until segment0 is replaced or grown
+        (load_program_helper, append_segment0, append_segment0_words); 
+        words stored through it are stored in segment0.
+    Expects: 
+        Memory struct pointer is not NULL, length is not NULL
+    ***************************************************************************
+*/
+uint32_t *program_words(Memory mem, uint32_t *length);
+
+/*
+    program_decoded
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        pointer to the predecoded entries for segment0, one per word
+    Effects:
+        None. The pointer is valid exactly as long as the one returned by
+        program_words. An engine that stores to segment0 through 
+        program_words must clear the handlers of the same entries as 
+        store_in_segment.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Predecoded *program_decoded(Memory mem);
+
+/*
+    segment_table
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        where mem keeps its segment table (see Segment_table)
+    Effects:
+        None. Code that loads or stores through the table must check the
+        id against count, the segment against NULL and the address 
+        against the length header, and leave anything else to 
+        value_in_segment and store_in_segment.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Segment_table segment_table(Memory mem);
+
+
+/*
+    machine_registers
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        pointer to the machine's eight registers
+    Effects:
+        None. The registers belong to mem, so each machine has its own; 
+        they start at 0 and live as long as mem.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint32_t *machine_registers(Memory mem);
+
+/*
+    set_machine_io
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        Input_fn input: callback for the input instruction, or NULL
+        Output_fn output: callback for the output instruction, or NULL
+        void *context: passed to both callbacks
+    Returns:
+        none
+    Effects:
+        Routes the machine's input and output through the callbacks. A NULL
+        callback means standard input or standard output.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_machine_io(Memory mem, Input_fn input, Output_fn output, 
+                    void *context);
+
+/*
+    machine_input
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        the next input byte, EOF, or UM_INPUT_WAIT
+    Effects:
+        Takes the byte from the input callback or, without one, from the
+        machine's cursor into standard input. Buffered output is flushed
+        first whenever the program might wait for its input, so that a
+        prompt is seen before it waits for the answer: before every call
+        to the callback, and before refill_input when the cursor runs out.
+        A byte already read ahead is served without a flush.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+int machine_input(Memory mem);
+
+/*
+    machine_output
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint8_t byte: byte the program outputs
+    Returns:
+        none
+    Effects:
+        Passes byte to the output callback, or if there is none adds it to
+        the machine's output buffer (its own, or space in the writer's
+        ring with --async-output), which is flushed to stdout when it
+        fills and, with flush_at_newline, at every newline
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void machine_output(Memory mem, uint8_t byte);
+
+/*
+    flush_output
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        none
+    Effects:
+        Writes the machine's buffered output to standard output and empties
+        the buffer; output that cannot be written is dropped, as stdio
+        would. With the writer thread running, the buffer is instead
+        committed to its ring, to be written with writev while the machine
+        runs on, and the next output claims new space. Besides
+        machine_output and machine_input, execute_until calls this
+        whenever the machine stops for anything but its budget, and
+        free_segments before it frees the buffer (or waits for the writer
+        to drain).
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void flush_output(Memory mem);
+
+/*
+    count_executed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t count: instructions an engine has just executed
+    Returns:
+        none
+    Effects:
+        Adds count to the machine's instruction count. Each engine calls 
+        this as it returns, so the count is only current between runs.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void count_executed(Memory mem, uint64_t count);
+
+/*
+    instructions_executed
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        the number of instructions the machine has executed since it was
+        created, loaded or restored
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+uint64_t instructions_executed(Memory mem);
+
+/*
+    report_allocation
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how many segments of each size class the machine has mapped
+        and what fraction of them reused a block an earlier unmap freed
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_allocation(Memory mem, FILE *fp);
+
+/*
+    set_memory_quota
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t words: most words the segments other than segment 0 may
+                        hold at once, 0 for no limit
+    Returns:
+        none
+    Effects:
+        From now on, a map that would take the machine's mapped words over
+        words fails (see map_segment_helper). Segments already mapped are
+        kept even if they are over it.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void set_memory_quota(Memory mem, uint64_t words);
+
+/*
+    memory_stats
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        Memory_stats *stats: set to the machine's counters
+    Returns:
+        none
+    Effects:
+        Fills in stats; reading the counters costs nothing but the clock
+        read for the machine's age, so it can be called at any time
+    Expects: 
+        Memory struct pointer and stats are not NULL
+    ***************************************************************************
+*/
+void memory_stats(Memory mem, Memory_stats *stats);
+
+/*
+    report_memory_stats
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints the machine's memory counters (memory_stats): live segments
+        and free ids, mapped and peak words, maps and unmaps with their
+        rates over the machine's life, failed maps and the quota
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_memory_stats(Memory mem, FILE *fp);
+
+/*
+    report_map_failure
+    ***************************************************************************
+    Input: 
+        Memory mem : a machine an engine stopped with STOP_MAP_FAILED
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints which map was refused, at which address, and whether it was
+        over the machine's quota or the host was out of memory
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+void report_map_failure(Memory mem, FILE *fp);
+
+/*
+    memory_sums
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        the length of every segment id of mem and a digest (page_sum) of
+        each CHECKPOINT_PAGE_WORDS page of the mapped ones, which
+        write_memory_changes compares with the digests of an earlier state
+        to find what changed since; the caller frees it with
+        free_memory_sums
+    Effects:
+        Reads every mapped word, so that the machine pays nothing for
+        checkpoints as it runs. A checkpoint calls this in the process
+        it forks to write the record.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Memory_sums memory_sums(Memory mem);
+
+/*
+    write_memory_sums
+    ***************************************************************************
+    Input: 
+        Memory_sums sums: digests made by memory_sums
+        FILE *fp: stream the digests are written to
+    Returns:
+        true if every write succeeded, false otherwise
+    Effects:
+        Writes, in host order, the number of segment ids, the length of
+        each, then every page's 64-bit digest
+    Expects: 
+        sums and fp are not NULL
+    ***************************************************************************
+*/
+bool write_memory_sums(Memory_sums sums, FILE *fp);
+
+/*
+    read_memory_sums
+    ***************************************************************************
+    Input: 
+        FILE *fp: stream written by write_memory_sums
+    Returns:
+        the digests read, or NULL if fp does not hold exactly one set of
+        them; the caller frees them with free_memory_sums
+    Expects: 
+        fp is not NULL
+    ***************************************************************************
+*/
+Memory_sums read_memory_sums(FILE *fp);
+
+/*
+    free_memory_sums
+    ***************************************************************************
+    Input: 
+        Memory_sums *sums: digests to free, or a pointer to NULL
+    Returns:
+        none
+    Effects:
+        Frees the digests and sets *sums to NULL
+    Expects: 
+        sums is not NULL
+    ***************************************************************************
+*/
+void free_memory_sums(Memory_sums *sums);
+
+/*
+    write_memory_changes
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct the digests now were made of
+        Memory_sums old: digests of an earlier state of mem
+        Memory_sums now: digests of mem as it is (memory_sums)
+        FILE *fp: stream the changes are written to
+    Returns:
+        true if every write succeeded, false otherwise (or if old has more
+        segment ids than now, which no earlier state of mem has)
+    Effects:
+        Writes what changed since the state old was made of as host-order
+        32-bit words:
+            program_counter, segment count, free count, changed count,
+            free ids..., then per changed segment its id, its length
+            (UNMAPPED_SEGMENT if it is unmapped), 1 if it is fresh (its
+            old contents are gone and its other words are 0) or 0, and
+            the pages of it that must be saved (see write_pages)
+        A segment is changed if it was mapped, unmapped or resized, or if
+        the digest of one of its pages differs, and only those pages
+        (or, for a fresh segment, its pages that are not all zeros) are
+        saved. Two different pages with the same 64-bit digest would be
+        taken as unchanged.
+    Expects: 
+        Memory struct pointer, old, now and fp are not NULL, now is of mem
+        as it is, fp is open for writing
+    ***************************************************************************
+*/
+bool write_memory_changes(Memory mem, Memory_sums old, Memory_sums now,
+                          FILE *fp);
+
+/*
+    apply_memory_changes
+    ***************************************************************************
+    Input: 
+        Memory mem : machine rebuilt by read_memory (and any changes applied
+                     to it since), not yet run
+        const uint32_t *words: changes in the format of write_memory_changes
+        size_t count: number of words available
+        size_t *used: set to the number of words the changes occupied
+    Returns:
+        true if the changes were applied, false if they are truncated or do
+        not fit the machine, which may then be left half-changed
+    Effects:
+        Brings mem to the state the changes were written in: grows the
+        segment table, unmaps, remaps and replaces the changed segments,
+        copies in their saved pages and replaces the free id stack and the
+        program counter
+    Expects: 
+        Memory struct pointer and used are not NULL
+    ***************************************************************************
+*/
+bool apply_memory_changes(Memory mem, const uint32_t *words, size_t count,
+                          size_t *used);
 
 #endif
\ No newline at end of file
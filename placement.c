@@ -0,0 +1,304 @@
+/**************************************************************
+ *
+ *                     placement.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the memory placement options. Once the
+ *     interpreter is fast, images with large working sets are
+ *     bound by TLB misses, so --huge-pages backs segment 0 and
+ *     large segments with 2 MB pages, and --numa keeps a
+ *     machine's memory on the node of the thread running it.
+ *     NUMA binding uses the raw system calls, so no libnuma is
+ *     needed.
+ *
+ **************************************************************/
+/* For sched_setaffinity and the CPU_* macros */
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#endif
+#include "placement.h"
+
+bool huge_pages = false;
+bool numa_binding = false;
+
+/* Process-wide counters; machines on batch threads update them at once */
+static uint64_t advised_bytes;
+static uint64_t peak_huge_kb;
+static uint64_t bound_threads;
+
+/* NUMA nodes a binding mask can name */
+#define MAX_NODES 1024
+
+/*
+    advise_range
+    ***************************************************************************
+    Input:
+        void *addr: start of a region
+        size_t bytes: size of the region
+    Returns:
+        none
+    Effects:
+        madvises the whole pages inside the region MADV_HUGEPAGE and adds
+        them to advised_bytes
+    ***************************************************************************
+*/
+static void advise_range(void *addr, size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        uintptr_t start = ((uintptr_t)addr + page - 1) / page * page;
+        uintptr_t end = ((uintptr_t)addr + bytes) / page * page;
+        if (end > start &&
+            madvise((void *)start, end - start, MADV_HUGEPAGE) == 0) {
+                __atomic_add_fetch(&advised_bytes, end - start,
+                                   __ATOMIC_RELAXED);
+        }
+#else
+        (void)addr;
+        (void)bytes;
+#endif
+}
+
+/*
+    placement_advise
+    ***************************************************************************
+    Input:
+        void *addr: start of a region
+        size_t bytes: size of the region
+    Returns:
+        none
+    Effects:
+        With huge_pages, asks the kernel to back the whole pages of a
+        region of HUGE_PAGE_BYTES or more with huge pages (MADV_HUGEPAGE)
+        and counts them as advised. Only 2 MB-aligned parts can get them.
+    ***************************************************************************
+*/
+void placement_advise(void *addr, size_t bytes)
+{
+        if (huge_pages && bytes >= HUGE_PAGE_BYTES) {
+                advise_range(addr, bytes);
+        }
+}
+
+/*
+    placement_map
+    ***************************************************************************
+    Input:
+        size_t bytes: size of the mapping, a whole number of pages
+    Returns:
+        a new private anonymous mapping of bytes, or MAP_FAILED
+    Effects:
+        With huge_pages and a mapping of HUGE_PAGE_BYTES or more, maps a
+        little more, trims it to start on a 2 MB boundary and advises it,
+        so that every 2 MB of it can be a huge page. The result is always
+        released with munmap(addr, bytes).
+    ***************************************************************************
+*/
+void *placement_map(size_t bytes)
+{
+        if (!huge_pages || bytes < HUGE_PAGE_BYTES) {
+                return mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        size_t span = bytes + HUGE_PAGE_BYTES;
+        char *base = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+                return MAP_FAILED;
+        }
+        /* Give back the parts before the first 2 MB boundary and after
+           the mapping */
+        char *aligned = (char *)(((uintptr_t)base + HUGE_PAGE_BYTES - 1) &
+                                 ~(uintptr_t)(HUGE_PAGE_BYTES - 1));
+        if (aligned > base) {
+                munmap(base, aligned - base);
+        }
+        size_t tail = (size_t)((base + span) - (aligned + bytes));
+        if (tail > 0) {
+                munmap(aligned + bytes, tail);
+        }
+        advise_range(aligned, bytes);
+        return aligned;
+}
+
+/*
+    node_cpus
+    ***************************************************************************
+    Input:
+        unsigned node: NUMA node
+        cpu_set_t *cpus: set to the node's CPUs
+    Returns:
+        true if the node's CPU list could be read
+    Effects:
+        parses /sys/devices/system/node/nodeN/cpulist ("0-3,8-11")
+    ***************************************************************************
+*/
+static bool node_cpus(unsigned node, cpu_set_t *cpus)
+{
+        char path[64];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%u/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+                return false;
+        }
+        CPU_ZERO(cpus);
+        unsigned first, last;
+        while (fscanf(fp, "%u", &first) == 1) {
+                last = first;
+                int c = fgetc(fp);
+                if (c == '-') {
+                        if (fscanf(fp, "%u", &last) != 1) {
+                                break;
+                        }
+                        c = fgetc(fp);
+                }
+                for (unsigned cpu = first; cpu <= last && cpu < CPU_SETSIZE;
+                     cpu++) {
+                        CPU_SET(cpu, cpus);
+                }
+                if (c != ',') {
+                        break;
+                }
+        }
+        fclose(fp);
+        return CPU_COUNT(cpus) > 0;
+}
+
+/*
+    placement_bind_thread
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        true if binding is off or succeeded, false if it failed
+    Effects:
+        With numa_binding, pins the calling thread to the CPUs of the NUMA
+        node it is running on and binds the memory it allocates from now
+        on to that node (set_mempolicy MPOL_BIND). Call it on the thread
+        that creates and runs a machine, before creating it.
+    ***************************************************************************
+*/
+bool placement_bind_thread(void)
+{
+        if (!numa_binding) {
+                return true;
+        }
+#if defined(__linux__) && defined(SYS_getcpu) && defined(SYS_set_mempolicy)
+        unsigned cpu, node;
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 ||
+            node >= MAX_NODES) {
+                return false;
+        }
+        cpu_set_t cpus;
+        if (node_cpus(node, &cpus)) {
+                sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+        unsigned long mask[MAX_NODES / (sizeof(unsigned long) * CHAR_BIT)];
+        memset(mask, 0, sizeof(mask));
+        mask[node / (sizeof(unsigned long) * CHAR_BIT)] |=
+                1ul << (node % (sizeof(unsigned long) * CHAR_BIT));
+        /* The kernel reads maxnode - 1 bits */
+        if (syscall(SYS_set_mempolicy, MPOL_BIND, mask,
+                    (unsigned long)MAX_NODES + 1) != 0) {
+                return false;
+        }
+        __atomic_add_fetch(&bound_threads, 1, __ATOMIC_RELAXED);
+        return true;
+#else
+        return false;
+#endif
+}
+
+/*
+    placement_sample
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        the KB of advised memory currently backed by huge pages
+    Effects:
+        Reads /proc/self/smaps and remembers the largest figure seen so far
+        for placement_report. Slow (it reads every mapping's entry); call
+        it once a run, before its machine is freed.
+    ***************************************************************************
+*/
+size_t placement_sample(void)
+{
+        FILE *fp = fopen("/proc/self/smaps", "r");
+        if (fp == NULL) {
+                return 0;
+        }
+        /* A mapping's VmFlags line comes after its other fields and has
+           "hg" if it was advised */
+        char line[512];
+        size_t huge = 0, mapping_huge = 0;
+        while (fgets(line, sizeof(line), fp) != NULL) {
+                size_t kb;
+                if (sscanf(line, "AnonHugePages: %zu kB", &kb) == 1 ||
+                    sscanf(line, "ShmemPmdMapped: %zu kB", &kb) == 1) {
+                        mapping_huge += kb;
+                } else if (strncmp(line, "VmFlags:", 8) == 0) {
+                        if (strstr(line, " hg") != NULL) {
+                                huge += mapping_huge;
+                        }
+                        mapping_huge = 0;
+                }
+        }
+        fclose(fp);
+
+        uint64_t peak = __atomic_load_n(&peak_huge_kb, __ATOMIC_RELAXED);
+        while (huge > peak &&
+               !__atomic_compare_exchange_n(&peak_huge_kb, &peak, huge,
+                                            false, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+        }
+        return huge;
+}
+
+/*
+    placement_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how much memory was advised to use huge pages (counting a
+        region each time it is advised), the most of it placement_sample
+        found backed by huge pages, and how many threads were bound to a
+        NUMA node
+    ***************************************************************************
+*/
+void placement_report(FILE *fp)
+{
+        if (huge_pages) {
+                uint64_t advised = __atomic_load_n(&advised_bytes,
+                                                   __ATOMIC_RELAXED) >> 10;
+                uint64_t huge = __atomic_load_n(&peak_huge_kb,
+                                                __ATOMIC_RELAXED);
+                fprintf(fp, "huge pages: %llu KB advised in all, at most "
+                            "%llu KB backed by huge pages at once\n",
+                        (unsigned long long)advised,
+                        (unsigned long long)huge);
+        }
+        if (numa_binding) {
+                fprintf(fp, "numa: %llu threads bound to their node\n",
+                        (unsigned long long)__atomic_load_n(&bound_threads,
+                                                          __ATOMIC_RELAXED));
+        }
+}
@@ -0,0 +1,111 @@
+/**************************************************************
+ *
+ *                     placement.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     placement.h holds the definitions of the functions used
+ *     in placement.c, which decides where the memory of large
+ *     segments lives: on transparent huge pages and on the NUMA
+ *     node of the thread running the machine
+ *
+ **************************************************************/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+/* Size of a huge page; smaller regions are never advised */
+#define HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+/* Whether segment 0 and large segments ask for huge pages (--huge-pages) */
+extern bool huge_pages;
+
+/* Whether each machine's memory is bound to the NUMA node of the thread
+   running it (--numa) */
+extern bool numa_binding;
+
+/*
+    placement_advise
+    ***************************************************************************
+    Input:
+        void *addr: start of a region
+        size_t bytes: size of the region
+    Returns:
+        none
+    Effects:
+        With huge_pages, asks the kernel to back the whole pages of a
+        region of HUGE_PAGE_BYTES or more with huge pages (MADV_HUGEPAGE)
+        and counts them as advised. Only 2 MB-aligned parts can get them.
+    ***************************************************************************
+*/
+void placement_advise(void *addr, size_t bytes);
+
+/*
+    placement_map
+    ***************************************************************************
+    Input:
+        size_t bytes: size of the mapping, a whole number of pages
+    Returns:
+        a new private anonymous mapping of bytes, or MAP_FAILED
+    Effects:
+        With huge_pages and a mapping of HUGE_PAGE_BYTES or more, maps a
+        little more, trims it to start on a 2 MB boundary and advises it,
+        so that every 2 MB of it can be a huge page. The result is always
+        released with munmap(addr, bytes).
+    ***************************************************************************
+*/
+void *placement_map(size_t bytes);
+
+/*
+    placement_bind_thread
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        true if binding is off or succeeded, false if it failed
+    Effects:
+        With numa_binding, pins the calling thread to the CPUs of the NUMA
+        node it is running on and binds the memory it allocates from now
+        on to that node (set_mempolicy MPOL_BIND). Call it on the thread
+        that creates and runs a machine, before creating it.
+    ***************************************************************************
+*/
+bool placement_bind_thread(void);
+
+/*
+    placement_sample
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        the KB of advised memory currently backed by huge pages
+    Effects:
+        Reads /proc/self/smaps and remembers the largest figure seen so far
+        for placement_report. Slow (it reads every mapping's entry); call
+        it once a run, before its machine is freed.
+    ***************************************************************************
+*/
+size_t placement_sample(void);
+
+/*
+    placement_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints how much memory was advised to use huge pages (counting a
+        region each time it is advised), the most of it placement_sample
+        found backed by huge pages, and how many threads were bound to a
+        NUMA node
+    ***************************************************************************
+*/
+void placement_report(FILE *fp);
+
+#endif
@@ -0,0 +1,160 @@
+/**************************************************************
+ *
+ *                     profile.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the instruction n-gram profiler. Each
+ *     instruction is reduced to a 4-bit class, so the counts for
+ *     every sequence of up to three classes fit in flat tables.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+/* Class of a nand with B == C, which computes a bitwise not */
+#define CLASS_NOT 14
+/* Class of the unused opcodes 14 and 15 */
+#define CLASS_BAD 15
+
+bool profiling = false;
+
+static const char *const CLASS_NAMES[16] = {
+        "CMOV", "SLOAD", "SSTORE", "ADD", "MUL", "DIV", "NAND", "HALT",
+        "MAP", "UNMAP", "OUT", "IN", "LOADP", "LV", "NOT", "BAD"
+};
+
+static uint64_t unigrams[16];
+static uint64_t bigrams[16 * 16];
+static uint64_t trigrams[16 * 16 * 16];
+
+/* Classes of the last two instructions, most recent in the low bits */
+static uint32_t history = 0;
+static uint64_t recorded = 0;
+
+/*
+    profile_record
+    ***************************************************************************
+    Input:
+        uint32_t word: instruction word about to be executed
+    Returns:
+        none
+    Effects:
+        Counts the instruction and the 2- and 3-instruction sequences it
+        ends. Instructions are classified by opcode, except that a nand
+        whose B and C registers are the same is counted as NOT.
+    ***************************************************************************
+*/
+void profile_record(uint32_t word)
+{
+        uint32_t class = word >> 28;
+        if (class == 6 && ((word >> 3) & 7) == (word & 7))
+        {
+                class = CLASS_NOT;
+        }
+        else if (class > 13)
+        {
+                class = CLASS_BAD;
+        }
+
+        unigrams[class]++;
+        if (recorded >= 1)
+        {
+                bigrams[((history & 0xf) << 4) | class]++;
+        }
+        if (recorded >= 2)
+        {
+                trigrams[(history << 4) | class]++;
+        }
+        history = ((history << 4) | class) & 0xff;
+        recorded++;
+}
+
+/*
+    report_ngrams
+    ***************************************************************************
+    Input:
+        FILE *fp: stream the report is written to
+        const uint64_t *counts: count for each sequence, indexed by its
+                                classes as base-16 digits
+        int length: number of instructions per sequence
+        int top: number of sequences to list
+    Returns:
+        none
+    Effects:
+        Prints the top most frequent sequences of the given length
+    ***************************************************************************
+*/
+static void report_ngrams(FILE *fp, const uint64_t *counts, int length,
+                          int top)
+{
+        int size = 1 << (4 * length);
+        bool *listed = calloc(size, sizeof(bool));
+        if (listed == NULL)
+        {
+                return;
+        }
+        fprintf(fp, "  %d-instruction sequences:\n", length);
+        for (int rank = 0; rank < top; rank++)
+        {
+                int best = -1;
+                for (int i = 0; i < size; i++)
+                {
+                        if (!listed[i] && counts[i] > 0 &&
+                            (best < 0 || counts[i] > counts[best]))
+                        {
+                                best = i;
+                        }
+                }
+                if (best < 0)
+                {
+                        break;
+                }
+                listed[best] = true;
+
+                char name[32] = "";
+                for (int k = length - 1; k >= 0; k--)
+                {
+                        strcat(name, CLASS_NAMES[(best >> (4 * k)) & 0xf]);
+                        if (k > 0)
+                        {
+                                strcat(name, ";");
+                        }
+                }
+                fprintf(fp, "    %-22s %14llu  %5.2f%%\n", name,
+                        (unsigned long long)counts[best],
+                        100.0 * (double)counts[best] / (double)recorded);
+        }
+        free(listed);
+}
+
+/*
+    profile_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream the report is written to
+        int top: number of sequences listed for each length
+    Returns:
+        none
+    Effects:
+        Prints the most frequent 1-, 2- and 3-instruction sequences, with
+        their counts and share of all executed instructions
+    ***************************************************************************
+*/
+void profile_report(FILE *fp, int top)
+{
+        fprintf(fp, "um: profile of %llu instructions\n",
+                (unsigned long long)recorded);
+        if (recorded == 0)
+        {
+                return;
+        }
+        report_ngrams(fp, unigrams, 1, top);
+        report_ngrams(fp, bigrams, 2, top);
+        report_ngrams(fp, trigrams, 3, top);
+}
@@ -0,0 +1,54 @@
+/**************************************************************
+ *
+ *                     profile.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     profile.h holds the definitions of the functions
+ *     used in profile.c, which count how often each sequence
+ *     of one, two and three instructions is executed
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Whether execute_until records every instruction it executes */
+extern bool profiling;
+
+/*
+    profile_record
+    ***************************************************************************
+    Input: 
+        uint32_t word: instruction word about to be executed
+    Returns:
+        none
+    Effects:
+        Counts the instruction and the 2- and 3-instruction sequences it 
+        ends. Instructions are classified by opcode, except that a nand 
+        whose B and C registers are the same is counted as NOT.
+    ***************************************************************************
+*/
+void profile_record(uint32_t word);
+
+/*
+    profile_report
+    ***************************************************************************
+    Input: 
+        FILE *fp: stream the report is written to
+        int top: number of sequences listed for each length
+    Returns:
+        none
+    Effects:
+        Prints the most frequent 1-, 2- and 3-instruction sequences, with
+        their counts and share of all executed instructions
+    ***************************************************************************
+*/
+void profile_report(FILE *fp, int top);
+
+#endif
@@ -0,0 +1,147 @@
+/**************************************************************
+ *
+ *                     segbench.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains a stress benchmark for the segment
+ *     table. It grows one machine to tens of millions of live
+ *     segments and, each time the live count doubles, measures
+ *     how fast it maps new segments and how fast it churns
+ *     (unmaps and remaps random batches of) the ones it has.
+ *     Usage: segbench [MAX_MILLIONS]   (default 32)
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "memory.h"
+
+/* Segments unmapped and then remapped together during churn */
+#define CHURN_BATCH 64
+
+/* Unmap/map pairs timed at each live count */
+#define CHURN_PAIRS (4u << 20)
+
+/*
+    seconds_since
+    ***************************************************************************
+    Input:
+        const struct timespec *start: when the interval started
+    Returns:
+        the seconds elapsed since start
+    ***************************************************************************
+*/
+static double seconds_since(const struct timespec *start)
+{
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - start->tv_sec) +
+               (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+    next_random
+    ***************************************************************************
+    Input:
+        uint64_t *state: xorshift state, not 0
+    Returns:
+        the next pseudo-random number
+    ***************************************************************************
+*/
+static uint64_t next_random(uint64_t *state)
+{
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        return *state;
+}
+
+/*
+    churn
+    ***************************************************************************
+    Input:
+        Memory mem : machine whose ids 1..live are all mapped
+        uint32_t live: number of live segments
+        uint64_t *state: random state
+    Returns:
+        none
+    Effects:
+        Performs CHURN_PAIRS unmaps and as many maps: each round unmaps
+        CHURN_BATCH random live segments and maps as many new ones, which
+        must get exactly those ids back
+    ***************************************************************************
+*/
+static void churn(Memory mem, uint32_t live, uint64_t *state)
+{
+        uint32_t ids[CHURN_BATCH];
+        for (uint32_t done = 0; done < CHURN_PAIRS; done += CHURN_BATCH) {
+                int count = 0;
+                for (int i = 0; i < CHURN_BATCH; i++) {
+                        uint32_t id = 1 + next_random(state) % live;
+                        /* Skip an id this round already unmapped */
+                        int j = 0;
+                        while (j < count && ids[j] != id) {
+                                j++;
+                        }
+                        if (j == count) {
+                                unmap_segment_helper(mem, id);
+                                ids[count++] = id;
+                        }
+                }
+                for (int i = 0; i < count; i++) {
+                        uint32_t length = 1 + next_random(state) % 8;
+                        uint32_t id = map_segment_helper(mem, length);
+                        if (id == 0 || id > live) {
+                                fprintf(stderr, "segbench: map returned "
+                                                "%u with %u live\n", id,
+                                        live);
+                                exit(EXIT_FAILURE);
+                        }
+                }
+        }
+}
+
+int main(int argc, char *argv[])
+{
+        unsigned long max_millions = 32;
+        if (argc > 2 || (argc == 2 &&
+                         (max_millions = strtoul(argv[1], NULL, 10)) == 0)) {
+                fprintf(stderr, "Usage: %s [MAX_MILLIONS]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+        uint64_t max_live = (uint64_t)max_millions << 20;
+        if (max_live >= UINT32_MAX) {
+                fprintf(stderr, "%s: at most 4095 million segments\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        Memory mem = create_segment0(1);
+        uint64_t state = 0x9e3779b97f4a7c15ull;
+        uint32_t live = 0;
+        printf("%12s %16s %16s\n", "live", "map M/s", "churn M pairs/s");
+        for (uint64_t target = 1u << 20; target <= max_live; target *= 2) {
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                uint32_t added = (uint32_t)target - live;
+                while (live < target) {
+                        map_segment_helper(mem, 1 + next_random(&state) % 8);
+                        live++;
+                }
+                double map_seconds = seconds_since(&start);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                churn(mem, live, &state);
+                double churn_seconds = seconds_since(&start);
+                printf("%12u %16.1f %16.1f\n", live,
+                       added / map_seconds / 1e6,
+                       CHURN_PAIRS / churn_seconds / 1e6);
+                fflush(stdout);
+        }
+        free_segments(mem);
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,409 @@
+/**************************************************************
+ *
+ *                     slab.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the size-class allocator for mapped
+ *     segments. Programs like sandmark map and unmap huge
+ *     numbers of small segments, so a released block goes on
+ *     a free list for its power-of-two class and the next map
+ *     of that class takes it back without calling malloc or
+ *     free. New blocks are carved from 64K chunks. Blocks of
+ *     SLAB_MMAP_WORDS or more are anonymous mappings, whose pages
+ *     cost nothing until they are touched, and the last few that
+ *     were released are kept (emptied) for the next map of the
+ *     same size.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "slab.h"
+#include "placement.h"
+
+/* Words in each chunk blocks are carved from */
+#define CHUNK_WORDS 16384
+
+/* Released mappings kept for reuse */
+#define MAPPING_CACHE 8
+
+/* A chunk of blocks, linked so that slab_free can find them all */
+typedef struct Chunk {
+        struct Chunk *next;
+        uint32_t words[];
+} Chunk;
+
+/* A size class: its free list (linked through the first 8 bytes of each
+   free block), the unused end of its current chunk and its counters */
+typedef struct Slab_class {
+        uint32_t *free_list;
+        uint32_t *carve;
+        uint32_t *carve_end;
+        uint64_t allocations;
+        uint64_t hits;
+} Slab_class;
+
+/* A released mapping, its pages already given back */
+typedef struct Mapping {
+        uint32_t *block;
+        size_t bytes;
+} Mapping;
+
+struct Slab {
+        Slab_class classes[SLAB_CLASSES];
+        Chunk *chunks;
+        size_t chunk_bytes;
+        uint64_t large_allocations;
+        uint64_t large_live;
+        Mapping mappings[MAPPING_CACHE];
+        int mapping_count;
+        uint64_t mapped_allocations;
+        uint64_t mapped_hits;
+};
+
+/*
+    size_class
+    ***************************************************************************
+    Input:
+        size_t words: number of words requested
+    Returns:
+        the smallest class k whose blocks of 2 << k words hold words, or
+        SLAB_CLASSES if words is more than SLAB_MAX_WORDS
+    ***************************************************************************
+*/
+static inline unsigned size_class(size_t words)
+{
+        if (words > SLAB_MAX_WORDS) {
+                return SLAB_CLASSES;
+        }
+        if (words <= 2) {
+                return 0;
+        }
+        /* Bits needed for words - 1, less the one every class has */
+        return (unsigned)(64 - __builtin_clzll((unsigned long long)words - 1))
+               - 1;
+}
+
+/*
+    next_free, set_next_free
+    ***************************************************************************
+    Input:
+        uint32_t *block: a block on a free list
+        uint32_t *next: the block after it on the list
+    Returns:
+        next_free: the block after block on its free list
+    Effects:
+        set_next_free links block to next. The link is copied rather than
+        stored through a cast so that the words are never read as a
+        pointer type.
+    ***************************************************************************
+*/
+static inline uint32_t *next_free(uint32_t *block)
+{
+        uint32_t *next;
+        memcpy(&next, block, sizeof(next));
+        return next;
+}
+
+static inline void set_next_free(uint32_t *block, uint32_t *next)
+{
+        memcpy(block, &next, sizeof(next));
+}
+
+/*
+    mapping_bytes
+    ***************************************************************************
+    Input:
+        size_t words: number of words in a mapped block
+    Returns:
+        the size of its mapping, words rounded up to whole pages
+    ***************************************************************************
+*/
+static size_t mapping_bytes(size_t words)
+{
+        static size_t page;
+        if (page == 0) {
+                page = (size_t)sysconf(_SC_PAGESIZE);
+        }
+        return (words * sizeof(uint32_t) + page - 1) / page * page;
+}
+
+/*
+    map_block, unmap_block
+    ***************************************************************************
+    Input:
+        Slab slab: slab the block belongs to
+        size_t words: number of words in the block
+        uint32_t *block: block from map_block
+    Returns:
+        map_block: a zero-filled block of words words, or NULL if it could
+        not be mapped
+    Effects:
+        map_block reuses a cached mapping of exactly the right size if
+        there is one, and otherwise maps new anonymous memory; either way
+        no page is touched. With --huge-pages a block of 2 MB or more is
+        aligned and advised to use huge pages (placement_map). unmap_block
+        gives the block's pages back to the system; on Linux it keeps the
+        now empty mapping, which reads as zeros again, in the cache if
+        there is room, and otherwise unmaps it.
+    ***************************************************************************
+*/
+static uint32_t *map_block(Slab slab, size_t words)
+{
+        size_t bytes = mapping_bytes(words);
+        slab->mapped_allocations++;
+        for (int i = 0; i < slab->mapping_count; i++) {
+                if (slab->mappings[i].bytes == bytes) {
+                        uint32_t *block = slab->mappings[i].block;
+                        slab->mappings[i] =
+                                slab->mappings[--slab->mapping_count];
+                        slab->mapped_hits++;
+                        return block;
+                }
+        }
+        void *block = placement_map(bytes);
+        return block == MAP_FAILED ? NULL : block;
+}
+
+static void unmap_block(Slab slab, uint32_t *block, size_t words)
+{
+        size_t bytes = mapping_bytes(words);
+#ifdef __linux__
+        /* Linux refills a private anonymous mapping with zero pages after
+           MADV_DONTNEED, so a cached mapping is as good as a new one */
+        if (slab->mapping_count < MAPPING_CACHE &&
+            madvise(block, bytes, MADV_DONTNEED) == 0) {
+                Mapping *cached = &slab->mappings[slab->mapping_count++];
+                cached->block = block;
+                cached->bytes = bytes;
+                return;
+        }
+#else
+        (void)slab;
+#endif
+        munmap(block, bytes);
+}
+
+/*
+    slab_new
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        a new, empty slab
+    Effects:
+        Allocates the slab; no blocks are allocated until slab_alloc
+    ***************************************************************************
+*/
+Slab slab_new(void)
+{
+        Slab slab = calloc(1, sizeof(struct Slab));
+        assert(slab != NULL);
+        return slab;
+}
+
+/*
+    slab_free
+    ***************************************************************************
+    Input:
+        Slab *slab: slab to free
+    Returns:
+        none
+    Effects:
+        Frees every chunk the slab carved blocks from and every mapping it
+        kept for reuse, then the slab itself, and sets *slab to NULL.
+        Blocks bigger than SLAB_MAX_WORDS must have been released already.
+    Expects:
+        slab and *slab are not NULL
+    ***************************************************************************
+*/
+void slab_free(Slab *slab)
+{
+        assert(slab != NULL && *slab != NULL);
+        assert((*slab)->large_live == 0);
+        for (int i = 0; i < (*slab)->mapping_count; i++) {
+                munmap((*slab)->mappings[i].block,
+                       (*slab)->mappings[i].bytes);
+        }
+        Chunk *chunk = (*slab)->chunks;
+        while (chunk != NULL) {
+                Chunk *next = chunk->next;
+                free(chunk);
+                chunk = next;
+        }
+        free(*slab);
+        *slab = NULL;
+}
+
+/*
+    new_chunk
+    ***************************************************************************
+    Input:
+        Slab slab: slab to add the chunk to
+        Slab_class *class: class that has used up its current chunk
+    Returns:
+        none
+    Effects:
+        Allocates a zeroed chunk and makes it the class's current one
+    ***************************************************************************
+*/
+static void new_chunk(Slab slab, Slab_class *class)
+{
+        size_t bytes = sizeof(Chunk) + CHUNK_WORDS * sizeof(uint32_t);
+        Chunk *chunk = calloc(1, bytes);
+        assert(chunk != NULL);
+        chunk->next = slab->chunks;
+        slab->chunks = chunk;
+        slab->chunk_bytes += bytes;
+        class->carve = chunk->words;
+        class->carve_end = chunk->words + CHUNK_WORDS;
+}
+
+/*
+    slab_alloc
+    ***************************************************************************
+    Input:
+        Slab slab: slab to allocate from
+        size_t words: number of words needed, at least 1
+    Returns:
+        a block of at least words zeroed 32-bit words, aligned for a
+        pointer, or NULL if a block of more than SLAB_MAX_WORDS words
+        could not be had from the system
+    Effects:
+        Takes the block from the free list of its size class if it has one
+        (a hit), otherwise carves it from the class's current chunk,
+        allocating a new chunk when that one is used up. A block of
+        SLAB_MMAP_WORDS or more is an anonymous mapping, new or released
+        earlier with the same size, none of whose pages are touched, so
+        its cost does not depend on its size.
+    ***************************************************************************
+*/
+uint32_t *slab_alloc(Slab slab, size_t words)
+{
+        assert(slab != NULL && words > 0);
+        unsigned k = size_class(words);
+        if (k == SLAB_CLASSES) {
+                uint32_t *block;
+                if (words >= SLAB_MMAP_WORDS) {
+                        block = map_block(slab, words);
+                } else {
+                        block = calloc(words, sizeof(uint32_t));
+                        slab->large_allocations++;
+                }
+                if (block != NULL) {
+                        slab->large_live++;
+                }
+                return block;
+        }
+
+        Slab_class *class = &slab->classes[k];
+        class->allocations++;
+        uint32_t *block = class->free_list;
+        if (block != NULL) {
+                class->hits++;
+                class->free_list = next_free(block);
+                /* Blocks here are small, and a loop beats calling memset */
+                for (size_t i = 0; i < words; i++) {
+                        block[i] = 0;
+                }
+                return block;
+        }
+        size_t size = (size_t)2 << k;
+        if (class->carve == NULL ||
+            (size_t)(class->carve_end - class->carve) < size) {
+                new_chunk(slab, class);
+        }
+        /* Chunks are zeroed and a block is carved only once */
+        block = class->carve;
+        class->carve += size;
+        return block;
+}
+
+/*
+    slab_release
+    ***************************************************************************
+    Input:
+        Slab slab: slab the block came from
+        uint32_t *block: block from slab_alloc
+        size_t words: the words it was allocated with
+    Returns:
+        none
+    Effects:
+        Pushes the block onto the free list of its size class; the memory
+        is kept for the next slab_alloc of that class, not returned to
+        malloc. A mapped block's pages are returned to the system at once
+        and the empty mapping may be kept for reuse.
+    ***************************************************************************
+*/
+void slab_release(Slab slab, uint32_t *block, size_t words)
+{
+        assert(slab != NULL && block != NULL);
+        unsigned k = size_class(words);
+        if (k == SLAB_CLASSES) {
+                slab->large_live--;
+                if (words >= SLAB_MMAP_WORDS) {
+                        unmap_block(slab, block, words);
+                } else {
+                        free(block);
+                }
+                return;
+        }
+        Slab_class *class = &slab->classes[k];
+        set_next_free(block, class->free_list);
+        class->free_list = block;
+}
+
+/*
+    slab_report
+    ***************************************************************************
+    Input:
+        Slab slab: slab to report on
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints, for every size class that was used, its block size, the
+        number of allocations, how many of them were served from the free
+        list and that hit rate, then the same for the oversized blocks
+        (calloc'd, and mapped with their reuse rate) and the total chunk
+        memory
+    ***************************************************************************
+*/
+void slab_report(Slab slab, FILE *fp)
+{
+        assert(slab != NULL && fp != NULL);
+        fprintf(fp, "%10s %14s %14s %9s\n", "words", "allocations",
+                "reused", "hit rate");
+        for (unsigned k = 0; k < SLAB_CLASSES; k++) {
+                const Slab_class *class = &slab->classes[k];
+                if (class->allocations == 0) {
+                        continue;
+                }
+                fprintf(fp, "%10zu %14llu %14llu %8.2f%%\n", (size_t)2 << k,
+                        (unsigned long long)class->allocations,
+                        (unsigned long long)class->hits,
+                        100.0 * class->hits / class->allocations);
+        }
+        char oversized[16];
+        snprintf(oversized, sizeof(oversized), ">%u", SLAB_MAX_WORDS);
+        fprintf(fp, "%10s %14llu %14s %9s\n", oversized,
+                (unsigned long long)slab->large_allocations, "-", "calloc");
+        if (slab->mapped_allocations > 0) {
+                snprintf(oversized, sizeof(oversized), ">=%u",
+                         SLAB_MMAP_WORDS);
+                fprintf(fp, "%10s %14llu %14llu %8.2f%% (mmap)\n",
+                        oversized,
+                        (unsigned long long)slab->mapped_allocations,
+                        (unsigned long long)slab->mapped_hits,
+                        100.0 * slab->mapped_hits /
+                        slab->mapped_allocations);
+        }
+        fprintf(fp, "chunks: %zu KB\n", slab->chunk_bytes / 1024);
+}
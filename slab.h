@@ -0,0 +1,117 @@
+/**************************************************************
+ *
+ *                     slab.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     slab.h holds the definitions of the functions used in
+ *     slab.c, the size-class allocator that memory.c takes
+ *     mapped segments from
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+
+#ifndef SLAB_H
+#define SLAB_H
+
+/* Number of size classes; class k holds blocks of 2 << k words, so the
+   largest block a slab hands out is SLAB_MAX_WORDS words. Bigger requests
+   go straight to calloc and free, or from SLAB_MMAP_WORDS (128K) up, to
+   anonymous mmap and munmap */
+#define SLAB_CLASSES 12
+#define SLAB_MAX_WORDS (2u << (SLAB_CLASSES - 1))
+#define SLAB_MMAP_WORDS 32768u
+
+typedef struct Slab *Slab;
+
+/*
+    slab_new
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        a new, empty slab
+    Effects:
+        Allocates the slab; no blocks are allocated until slab_alloc
+    ***************************************************************************
+*/
+Slab slab_new(void);
+
+/*
+    slab_free
+    ***************************************************************************
+    Input:
+        Slab *slab: slab to free
+    Returns:
+        none
+    Effects:
+        Frees every chunk the slab carved blocks from and every mapping it
+        kept for reuse, then the slab itself, and sets *slab to NULL. 
+        Blocks bigger than SLAB_MAX_WORDS must have been released already.
+    Expects:
+        slab and *slab are not NULL
+    ***************************************************************************
+*/
+void slab_free(Slab *slab);
+
+/*
+    slab_alloc
+    ***************************************************************************
+    Input:
+        Slab slab: slab to allocate from
+        size_t words: number of words needed, at least 1
+    Returns:
+        a block of at least words zeroed 32-bit words, aligned for a
+        pointer, or NULL if a block of more than SLAB_MAX_WORDS words
+        could not be had from the system
+    Effects:
+        Takes the block from the free list of its size class if it has one
+        (a hit), otherwise carves it from the class's current chunk,
+        allocating a new chunk when that one is used up. A block of
+        SLAB_MMAP_WORDS or more is an anonymous mapping, new or released
+        earlier with the same size, none of whose pages are touched, so
+        its cost does not depend on its size.
+    ***************************************************************************
+*/
+uint32_t *slab_alloc(Slab slab, size_t words);
+
+/*
+    slab_release
+    ***************************************************************************
+    Input:
+        Slab slab: slab the block came from
+        uint32_t *block: block from slab_alloc
+        size_t words: the words it was allocated with
+    Returns:
+        none
+    Effects:
+        Pushes the block onto the free list of its size class; the memory
+        is kept for the next slab_alloc of that class, not returned to
+        malloc. A mapped block's pages are returned to the system at once
+        and the empty mapping may be kept for reuse.
+    ***************************************************************************
+*/
+void slab_release(Slab slab, uint32_t *block, size_t words);
+
+/*
+    slab_report
+    ***************************************************************************
+    Input:
+        Slab slab: slab to report on
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Prints, for every size class that was used, its block size, the
+        number of allocations, how many of them were served from the free
+        list and that hit rate, then the same for the oversized blocks
+        (calloc'd, and mapped with their reuse rate) and the total chunk
+        memory
+    ***************************************************************************
+*/
+void slab_report(Slab slab, FILE *fp);
+
+#endif
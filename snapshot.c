@@ -0,0 +1,376 @@
+/**************************************************************
+ *
+ *                     snapshot.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the functions to save the whole machine
+ *     to a snapshot file and to restore it. A snapshot is a
+ *     sequence of host-order 32-bit words:
+ *         SNAPSHOT_MAGIC, SNAPSHOT_VERSION, registers[0..7],
+ *         followed by the memory image from write_memory
+ *     A keyed snapshot is preceded by SNAPSHOT_KEYED_MAGIC, the
+ *     number of words in its key and the key.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "instructions.h"
+#include "memory.h"
+
+/* Words before the memory image: magic, version and the registers */
+#define SNAPSHOT_HEADER 10
+
+const char *snapshot_path = NULL;
+uint64_t snapshot_at = UINT64_MAX;
+volatile sig_atomic_t snapshot_requested = 0;
+
+/* Set with snapshot_requested by SIGUSR1, which the checkpoint timer
+   also sets snapshot_requested for */
+static volatile sig_atomic_t snapshot_signalled = 0;
+
+/*
+    request_snapshot
+    ***************************************************************************
+    Input:
+        int signo: signal number (unused)
+    Returns:
+        none
+    Effects:
+        Asks execute to take a snapshot before its next instruction
+    ***************************************************************************
+*/
+static void request_snapshot(int signo)
+{
+        (void) signo;
+        snapshot_signalled = 1;
+        snapshot_requested = 1;
+}
+
+/*
+    snapshot_install_signal
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Installs a SIGUSR1 handler that sets snapshot_requested
+    Expects:
+        snapshot_path is not NULL
+    ***************************************************************************
+*/
+void snapshot_install_signal(void)
+{
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_snapshot;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, NULL);
+}
+
+/*
+    write_snapshot
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        FILE *fp: stream the snapshot is written to
+    Returns:
+        true if every write succeeded, false otherwise
+    Effects:
+        Writes the snapshot header, the registers and the memory image
+    ***************************************************************************
+*/
+static bool write_snapshot(Memory mem, FILE *fp)
+{
+        uint32_t header[SNAPSHOT_HEADER] = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION };
+        memcpy(header + 2, machine_registers(mem), 8 * sizeof(uint32_t));
+
+        bool ok = fwrite(header, sizeof(uint32_t), SNAPSHOT_HEADER, fp) ==
+                  SNAPSHOT_HEADER;
+        return ok && write_memory(mem, fp);
+}
+
+/*
+    read_snapshot
+    ***************************************************************************
+    Input:
+        int fd: open file holding a snapshot
+        const uint32_t *key: key the snapshot must be saved under, or NULL
+                             for a snapshot without a key
+        uint32_t key_words: number of words in key
+    Returns:
+        Memory struct rebuilt from the snapshot, or NULL if the file cannot
+        be read, is not a valid snapshot or is not saved under key
+    ***************************************************************************
+*/
+static Memory read_snapshot(int fd, const uint32_t *key, uint32_t key_words)
+{
+        struct stat file_status;
+        if (fstat(fd, &file_status) != 0 ||
+            file_status.st_size < SNAPSHOT_HEADER * (off_t)sizeof(uint32_t))
+        {
+                return NULL;
+        }
+        size_t size = file_status.st_size;
+        const uint32_t *words = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd,
+                                     0);
+        if (words == MAP_FAILED)
+        {
+                return NULL;
+        }
+        madvise((void *)words, size, MADV_SEQUENTIAL);
+
+        Memory mem = NULL;
+        size_t count = size / sizeof(uint32_t);
+        size_t used = 0;
+        const uint32_t *snapshot = words;
+        if (key != NULL)
+        {
+                /* The key is compared in full: a match stands for the
+                   whole of what the snapshot was taken from */
+                size_t skip = 2 + (size_t)key_words;
+                bool keyed = words[0] == SNAPSHOT_KEYED_MAGIC &&
+                             words[1] == key_words &&
+                             count >= skip + SNAPSHOT_HEADER &&
+                             memcmp(words + 2, key, 
+                                    key_words * sizeof(uint32_t)) == 0;
+                snapshot = keyed ? words + skip : NULL;
+                count -= keyed ? skip : 0;
+        }
+        if (snapshot != NULL && snapshot[0] == SNAPSHOT_MAGIC && 
+            snapshot[1] == SNAPSHOT_VERSION)
+        {
+                mem = read_memory(snapshot + SNAPSHOT_HEADER,
+                                  count - SNAPSHOT_HEADER, &used);
+        }
+        if (mem != NULL)
+        {
+                memcpy(machine_registers(mem), snapshot + 2, 
+                       8 * sizeof(uint32_t));
+        }
+        munmap((void *)words, size);
+        return mem;
+}
+
+/*
+    snapshot_save
+    ***************************************************************************
+    Input:
+        const char *path: file the snapshot is written to
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        true if the snapshot was written, false otherwise
+    Effects:
+        Writes the snapshot header, the registers and the memory image (see
+        write_memory) to a temporary file and renames it over path, so an
+        existing snapshot is never left half-written
+    Expects:
+        path and mem are not NULL
+    ***************************************************************************
+*/
+bool snapshot_save(const char *path, Memory mem)
+{
+        return snapshot_save_keyed(path, NULL, 0, mem);
+}
+
+/*
+    snapshot_save_keyed
+    ***************************************************************************
+    Input:
+        const char *path: file the snapshot is written to
+        const uint32_t *key: words to save the snapshot under, or NULL
+        uint32_t key_words: number of words in key
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        true if the snapshot was written, false otherwise
+    Effects:
+        Like snapshot_save, but unless key is NULL the snapshot is preceded
+        by the key, which snapshot_restore_keyed compares before restoring
+    Expects:
+        path and mem are not NULL
+    ***************************************************************************
+*/
+bool snapshot_save_keyed(const char *path, const uint32_t *key, 
+                         uint32_t key_words, Memory mem)
+{
+        assert(path != NULL && mem != NULL);
+        /* The temporary name is per-process so that two machines saving to
+           the same path cannot interleave their writes */
+        size_t length = strlen(path) + sizeof(".4294967295.tmp");
+        char *temporary = malloc(length);
+        assert(temporary != NULL);
+        snprintf(temporary, length, "%s.%u.tmp", path, (unsigned)getpid());
+
+        FILE *fp = fopen(temporary, "wb");
+        if (fp == NULL)
+        {
+                free(temporary);
+                return false;
+        }
+        bool ok = true;
+        if (key != NULL)
+        {
+                uint32_t header[2] = { SNAPSHOT_KEYED_MAGIC, key_words };
+                ok = fwrite(header, sizeof(uint32_t), 2, fp) == 2 &&
+                     fwrite(key, sizeof(uint32_t), key_words, fp) == 
+                     key_words;
+        }
+        ok = ok && write_snapshot(mem, fp);
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(temporary, path) == 0;
+        if (!ok)
+        {
+                remove(temporary);
+        }
+        free(temporary);
+        return ok;
+}
+
+/*
+    snapshot_restore
+    ***************************************************************************
+    Input:
+        const char *path: snapshot file written by snapshot_save
+    Returns:
+        Memory struct rebuilt from the snapshot, or NULL if the file cannot
+        be read or is not a valid snapshot
+    Effects:
+        Maps the file and, if it is valid, rebuilds the saved registers,
+        every segment, the free list and the program counter
+    Expects:
+        path is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_restore(const char *path)
+{
+        return snapshot_restore_keyed(path, NULL, 0);
+}
+
+/*
+    snapshot_restore_keyed
+    ***************************************************************************
+    Input:
+        const char *path: snapshot file written by snapshot_save_keyed
+        const uint32_t *key: key the snapshot must be saved under, or NULL
+        uint32_t key_words: number of words in key
+    Returns:
+        Memory struct rebuilt from the snapshot, or NULL if the file cannot
+        be read, is not a valid snapshot or was not saved under exactly
+        key (or, for a NULL key, was saved under one)
+    Effects:
+        As snapshot_restore
+    Expects:
+        path is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_restore_keyed(const char *path, const uint32_t *key,
+                              uint32_t key_words)
+{
+        assert(path != NULL);
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+        {
+                return NULL;
+        }
+        Memory mem = read_snapshot(fd, key, key_words);
+        close(fd);
+        return mem;
+}
+
+/*
+    snapshot_copy
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        an independent copy of the machine (registers, every segment, the
+        free list and the program counter), or NULL if it could not be made
+    Effects:
+        Writes a snapshot of mem to an anonymous temporary file and 
+        restores it from there. The copy reads stdin and writes stdout.
+    Expects:
+        mem is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_copy(Memory mem)
+{
+        assert(mem != NULL);
+        FILE *fp = tmpfile();
+        if (fp == NULL)
+        {
+                return NULL;
+        }
+        Memory copy = NULL;
+        if (write_snapshot(mem, fp) && fflush(fp) == 0)
+        {
+                copy = read_snapshot(fileno(fp), NULL, 0);
+        }
+        fclose(fp);
+        return copy;
+}
+
+/*
+    snapshot_take
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t executed: number of instructions executed so far
+    Returns:
+        none
+    Effects:
+        Clears snapshot_requested, flushes the machine's buffered output
+        (see flush_output), writes a checkpoint if checkpoint_due is
+        set, and saves a snapshot to snapshot_path if SIGUSR1 asked for one
+        or executed is snapshot_at, reporting the result on stderr
+    Expects:
+        mem is not NULL
+    ***************************************************************************
+*/
+void snapshot_take(Memory mem, uint64_t executed)
+{
+        snapshot_requested = 0;
+        /* What the program printed before the snapshot must not be lost
+           if it is restored */
+        flush_output(mem);
+        if (checkpoint_due)
+        {
+                checkpoint_take(mem);
+                if (!snapshot_signalled && executed != snapshot_at)
+                {
+                        return;
+                }
+        }
+        snapshot_signalled = 0;
+        if (snapshot_path == NULL)
+        {
+                return;
+        }
+        if (snapshot_save(snapshot_path, mem))
+        {
+                fprintf(stderr, "um: snapshot written to %s after %llu "
+                                "instructions\n", snapshot_path,
+                        (unsigned long long)executed);
+        }
+        else
+        {
+                perror(snapshot_path);
+        }
+}
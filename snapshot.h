@@ -0,0 +1,171 @@
+/**************************************************************
+ *
+ *                     snapshot.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     snapshot.h holds the definitions of the functions
+ *     used in snapshot.c, which save the whole machine (registers
+ *     and memory) to a file and restore it later
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <signal.h>
+#include "memory.h"
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* First two words of every snapshot file */
+#define SNAPSHOT_MAGIC   0x554d5353u
+#define SNAPSHOT_VERSION 1u
+
+/* First word of a snapshot saved under a key (snapshot_save_keyed) */
+#define SNAPSHOT_KEYED_MAGIC 0x554d534bu
+
+/* File a snapshot is written to when one is triggered; NULL disables them */
+extern const char *snapshot_path;
+
+/* Number of instructions after which execute takes a snapshot, or 
+   UINT64_MAX for never */
+extern uint64_t snapshot_at;
+
+/* Set by the SIGUSR1 handler; execute takes a snapshot before its next 
+   instruction when this is nonzero */
+extern volatile sig_atomic_t snapshot_requested;
+
+/*
+    snapshot_install_signal
+    ***************************************************************************
+    Input: 
+        none
+    Returns:
+        none
+    Effects:
+        Installs a SIGUSR1 handler that sets snapshot_requested
+    Expects: 
+        snapshot_path is not NULL
+    ***************************************************************************
+*/
+void snapshot_install_signal(void);
+
+/*
+    snapshot_save
+    ***************************************************************************
+    Input: 
+        const char *path: file the snapshot is written to
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        true if the snapshot was written, false otherwise
+    Effects:
+        Writes the snapshot header, the registers and the memory image (see
+        write_memory) to a temporary file and renames it over path, so an
+        existing snapshot is never left half-written
+    Expects: 
+        path and mem are not NULL
+    ***************************************************************************
+*/
+bool snapshot_save(const char *path, Memory mem);
+
+/*
+    snapshot_restore
+    ***************************************************************************
+    Input: 
+        const char *path: snapshot file written by snapshot_save
+    Returns:
+        Memory struct rebuilt from the snapshot, or NULL if the file cannot
+        be read or is not a valid snapshot
+    Effects:
+        Maps the file and, if it is valid, rebuilds the saved registers,
+        every segment, the free list and the program counter
+    Expects: 
+        path is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_restore(const char *path);
+
+/*
+    snapshot_save_keyed
+    ***************************************************************************
+    Input: 
+        const char *path: file the snapshot is written to
+        const uint32_t *key: words to save the snapshot under, or NULL
+        uint32_t key_words: number of words in key
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+    Returns:
+        true if the snapshot was written, false otherwise
+    Effects:
+        Like snapshot_save, but unless key is NULL the snapshot is preceded
+        by the key, which snapshot_restore_keyed compares before restoring
+    Expects: 
+        path and mem are not NULL
+    ***************************************************************************
+*/
+bool snapshot_save_keyed(const char *path, const uint32_t *key, 
+                         uint32_t key_words, Memory mem);
+
+/*
+    snapshot_restore_keyed
+    ***************************************************************************
+    Input: 
+        const char *path: snapshot file written by snapshot_save_keyed
+        const uint32_t *key: key the snapshot must be saved under, or NULL
+        uint32_t key_words: number of words in key
+    Returns:
+        Memory struct rebuilt from the snapshot, or NULL if the file cannot
+        be read, is not a valid snapshot or was not saved under exactly
+        key (or, for a NULL key, was saved under one)
+    Effects:
+        As snapshot_restore
+    Expects: 
+        path is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_restore_keyed(const char *path, const uint32_t *key,
+                              uint32_t key_words);
+
+/*
+    snapshot_copy
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+    Returns:
+        an independent copy of the machine (registers, every segment, the
+        free list and the program counter), or NULL if it could not be made
+    Effects:
+        Writes a snapshot of mem to an anonymous temporary file and 
+        restores it from there. The copy reads stdin and writes stdout.
+    Expects:
+        mem is not NULL
+    ***************************************************************************
+*/
+Memory snapshot_copy(Memory mem);
+
+/*
+    snapshot_take
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t executed: number of instructions executed so far
+    Returns:
+        none
+    Effects:
+        Clears snapshot_requested, flushes the machine's buffered output
+        (see flush_output), writes a checkpoint if checkpoint_due is
+        set, and saves a snapshot to snapshot_path if SIGUSR1 asked for one
+        or executed is snapshot_at, reporting the result on stderr
+    Expects: 
+        mem is not NULL
+    ***************************************************************************
+*/
+void snapshot_take(Memory mem, uint64_t executed);
+
+#endif
@@ -0,0 +1,387 @@
+/**************************************************************
+ *
+ *                     threaded.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the direct-threaded execution engine.
+ *     Each handler ends by fetching the next word's predecoded
+ *     entry and jumping straight to its handler, so there is no
+ *     central switch, no call per instruction, and a word in a
+ *     loop is decoded only the first time it runs.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "threaded.h"
+#include "instructions.h"
+#include "snapshot.h"
+#include "imagecache.h"
+#include "memory.h"
+
+/* Label addresses and computed goto are GNU C extensions */
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+bool fusion = true;
+
+/* Superinstructions, chosen from --profile runs of midmark and sandmark, 
+   where a loadval precedes about half of all instructions. Each is the
+   handler of the first word it covers; the second word keeps its own
+   entry, so a jump straight to it still works. */
+enum Fused {
+        FUSED_NOT = 0,          /* nand a, b, b */
+        FUSED_LV_SLOAD,         /* loadval then segmented load */
+        FUSED_LV_SSTORE,        /* loadval then segmented store */
+        FUSED_LV_LV,            /* two loadvals */
+        FUSED_LV_CMOV,          /* loadval then conditional move */
+        FUSED_LV_LOADP,         /* loadval then load program (a jump) */
+        FUSED_COUNT
+};
+
+/*
+    decode_fields
+    ***************************************************************************
+    Input:
+        Predecoded *entry: predecoded entry for word
+        uint32_t word: segment 0 word to decode
+    Returns:
+        none
+    Effects:
+        Fills in entry's operand fields from word
+    ***************************************************************************
+*/
+static inline void decode_fields(Predecoded *entry, uint32_t word)
+{
+        if (word >> 28 == 13) {
+                entry->a = (word >> 25) & 7;
+                entry->value = word & 0x1ffffff;
+        } else {
+                entry->a = (word >> 6) & 7;
+                entry->b = (word >> 3) & 7;
+                entry->c = word & 7;
+        }
+}
+
+/*
+    decode
+    ***************************************************************************
+    Input:
+        Predecoded *decoded: predecoded entries of segment 0
+        const uint32_t *program: words of segment 0
+        uint32_t length: number of words in segment 0
+        uint32_t at: index of the word to decode
+        const void *const *dispatch: handler for each opcode
+        const void *const *fused: handler for each superinstruction
+    Returns:
+        none
+    Effects:
+        Fills in the handler and operand fields of entry at. If fusion is
+        on and the word starts a superinstruction, the handler is the
+        superinstruction's and the fields of the following word are
+        filled in as well.
+    ***************************************************************************
+*/
+static inline void decode(Predecoded *decoded, const uint32_t *program,
+                          uint32_t length, uint32_t at,
+                          const void *const *dispatch,
+                          const void *const *fused)
+{
+        Predecoded *entry = &decoded[at];
+        uint32_t word = program[at];
+        uint32_t opcode = word >> 28;
+        decode_fields(entry, word);
+        entry->handler = dispatch[opcode];
+        if (!fusion) {
+                return;
+        }
+
+        if (opcode == 6 && entry->b == entry->c) {
+                entry->handler = fused[FUSED_NOT];
+        } else if (opcode == 13 && at + 1 < length) {
+                int kind;
+                switch (program[at + 1] >> 28) {
+                case 1:  kind = FUSED_LV_SLOAD;  break;
+                case 2:  kind = FUSED_LV_SSTORE; break;
+                case 13: kind = FUSED_LV_LV;     break;
+                case 0:  kind = FUSED_LV_CMOV;   break;
+                case 12: kind = FUSED_LV_LOADP;  break;
+                default: return;
+                }
+                decode_fields(&decoded[at + 1], program[at + 1]);
+                entry->handler = fused[kind];
+        }
+}
+
+/*
+    execute_threaded
+    ***************************************************************************
+    Input:
+        Memory mem : Memory struct that holds the segments, free sequences,
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped, exactly as for execute_until
+    Effects:
+        Executes the program with the same semantics as the switch loop in
+        execute_until, but dispatches through a table of label addresses
+        (computed goto), keeps the registers, the program counter and the
+        segment 0 base pointer in locals, and runs each word from its
+        predecoded entry (see program_decoded), decoding it with inline
+        shifts the first time and fusing it with the next word when the
+        pair is a common one. The machine registers and program counter
+        are brought up to date whenever control leaves the engine.
+    Expects:
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_threaded(Memory mem, uint64_t budget, bool pause_at_io)
+{
+        assert(mem != NULL);
+        static const void *const dispatch[16] = {
+                &&op_cmov, &&op_sload, &&op_sstore, &&op_add, &&op_mul,
+                &&op_div, &&op_nand, &&op_halt, &&op_map, &&op_unmap,
+                &&op_out, &&op_in, &&op_loadp, &&op_lv, &&op_bad, &&op_bad
+        };
+        static const void *const fused[FUSED_COUNT] = {
+                [FUSED_NOT] = &&op_not,
+                [FUSED_LV_SLOAD] = &&op_lv_sload,
+                [FUSED_LV_SSTORE] = &&op_lv_sstore,
+                [FUSED_LV_LV] = &&op_lv_lv,
+                [FUSED_LV_CMOV] = &&op_lv_cmov,
+                [FUSED_LV_LOADP] = &&op_lv_loadp
+        };
+
+        uint32_t *registers = machine_registers(mem);
+        uint32_t r[8];
+        int input;
+        for (int i = 0; i < 8; i++) {
+                r[i] = registers[i];
+        }
+        uint32_t length;
+        uint32_t *program = program_words(mem, &length);
+        Predecoded *decoded = program_decoded(mem);
+        uint32_t pc = program_counter(mem);
+        const Predecoded *d;
+        uint32_t word;
+        uint64_t executed = 0;
+        /* The next instruction count at which the engine must stop to
+           check its budget or take a snapshot */
+        uint64_t next_event = snapshot_at < budget ? snapshot_at : budget;
+        Stop_reason reason;
+        /* Whether segment 0 was stored to, for note_program_changed */
+        bool stored_program = false;
+
+/* Fields of the current word */
+#define A  (d->a)
+#define B  (d->b)
+#define C  (d->c)
+
+/* Copy the local machine state out to registers[] and mem, and back */
+#define SYNC_OUT() do {                                         \
+                for (int i_ = 0; i_ < 8; i_++) {                \
+                        registers[i_] = r[i_];                  \
+                }                                               \
+                set_program_counter(mem, pc);                   \
+        } while (0)
+#define SYNC_IN() do {                                          \
+                program = program_words(mem, &length);          \
+                decoded = program_decoded(mem);                 \
+                pc = program_counter(mem);                      \
+        } while (0)
+
+#define DISPATCH() do {                                                 \
+                if (__builtin_expect(pc >= length ||                    \
+                                     executed == next_event, 0)) {      \
+                        goto event;                                     \
+                }                                                       \
+                executed++;                                             \
+                d = &decoded[pc];                                       \
+                if (__builtin_expect(d->handler == NULL, 0)) {          \
+                        decode(decoded, program, length, pc, dispatch,  \
+                               fused);                                  \
+                }                                                       \
+                pc++;                                                   \
+                goto *d->handler;                                       \
+        } while (0)
+
+        DISPATCH();
+
+op_cmov:
+        if (r[C] != 0) {
+                r[A] = r[B];
+        }
+        DISPATCH();
+op_sload:
+        if (r[B] == 0) {
+                assert(r[C] < length);
+                r[A] = program[r[C]];
+        } else {
+                r[A] = value_in_segment(mem, r[B], r[C]);
+        }
+        DISPATCH();
+op_sstore:
+        if (r[A] == 0) {
+                assert(r[B] < length);
+                program[r[B]] = r[C];
+                /* Also drops a superinstruction that began one word 
+                   earlier (PREDECODE_SPAN) */
+                decoded[r[B]].handler = NULL;
+                if (r[B] > 0) {
+                        decoded[r[B] - 1].handler = NULL;
+                }
+                stored_program = true;
+        } else {
+                store_in_segment(mem, r[C], r[A], r[B]);
+        }
+        DISPATCH();
+op_add:
+        r[A] = r[B] + r[C];
+        DISPATCH();
+op_mul:
+        r[A] = r[B] * r[C];
+        DISPATCH();
+op_div:
+        r[A] = r[B] / r[C];
+        DISPATCH();
+op_nand:
+        r[A] = ~(r[B] & r[C]);
+        DISPATCH();
+op_halt:
+        pc--;
+        reason = STOP_HALT;
+        goto leave;
+op_map:
+        word = map_segment_helper(mem, r[C]);
+        if (__builtin_expect(word == 0, 0)) {
+                pc--;
+                reason = STOP_MAP_FAILED;
+                goto leave;
+        }
+        r[B] = word;
+        DISPATCH();
+op_unmap:
+        unmap_segment_helper(mem, r[C]);
+        DISPATCH();
+op_out:
+        assert(r[C] <= 255);
+        machine_output(mem, (uint8_t)r[C]);
+        if (image_cache_pending != NULL) {
+                image_cache_disarm();
+        }
+        DISPATCH();
+op_in:
+        if (pause_at_io) {
+                pc--;
+                reason = STOP_INPUT;
+                goto leave;
+        }
+        input = machine_input(mem);
+        if (input == UM_INPUT_WAIT) {
+                pc--;
+                reason = STOP_INPUT;
+                goto leave;
+        }
+        /* EOF (-1) becomes the all-ones word */
+        r[C] = (uint32_t)input;
+        if (image_cache_pending != NULL) {
+                image_cache_disarm();
+        }
+        DISPATCH();
+op_loadp:
+        /* d dies with the old segment 0, so read the target first */
+        word = r[C];
+        if (r[B] != 0) {
+                load_program_helper(mem, r[B], word);
+                program = program_words(mem, &length);
+                decoded = program_decoded(mem);
+                if (image_cache_pending != NULL) {
+                        SYNC_OUT();
+                        image_cache_store(mem);
+                }
+        }
+        pc = word;
+        /* Every loop goes through a load_program, so checking for a
+           snapshot signal here is enough to notice it promptly */
+        if (__builtin_expect(snapshot_requested, 0)) {
+                SYNC_OUT();
+                snapshot_take(mem, executed);
+        }
+        DISPATCH();
+op_lv:
+        r[A] = d->value;
+        DISPATCH();
+op_bad:
+        /* Opcodes 14 and 15 do nothing, as in execute_until */
+        DISPATCH();
+
+op_not:
+        r[A] = ~r[B];
+        DISPATCH();
+
+/* A loadval superinstruction runs the loadval, steps onto the second
+   word's entry and jumps directly to that word's handler. If the
+   instruction budget only allows one more instruction, it runs just the
+   loadval. */
+#define LOADVAL_THEN(second) do {                                       \
+                r[A] = d->value;                                        \
+                if (__builtin_expect(executed == next_event, 0)) {      \
+                        DISPATCH();                                     \
+                }                                                       \
+                executed++;                                             \
+                d++;                                                    \
+                pc++;                                                   \
+                goto second;                                            \
+        } while (0)
+
+op_lv_sload:
+        LOADVAL_THEN(op_sload);
+op_lv_sstore:
+        LOADVAL_THEN(op_sstore);
+op_lv_lv:
+        LOADVAL_THEN(op_lv);
+op_lv_cmov:
+        LOADVAL_THEN(op_cmov);
+op_lv_loadp:
+        LOADVAL_THEN(op_loadp);
+#undef LOADVAL_THEN
+
+event:
+        if (pc >= length) {
+                reason = STOP_END;
+                goto leave;
+        }
+        if (executed == budget) {
+                reason = STOP_BUDGET;
+                goto leave;
+        }
+        /* executed == snapshot_at */
+        SYNC_OUT();
+        snapshot_take(mem, executed);
+        SYNC_IN();
+        next_event = budget;
+        DISPATCH();
+
+leave:
+        SYNC_OUT();
+        if (stored_program) {
+                note_program_changed(mem);
+        }
+        /* A halt, input or map that stopped the engine was counted but
+           not run */
+        count_executed(mem, executed - (reason == STOP_HALT ||
+                                        reason == STOP_INPUT ||
+                                        reason == STOP_MAP_FAILED));
+        return reason;
+
+#undef A
+#undef B
+#undef C
+#undef SYNC_OUT
+#undef SYNC_IN
+#undef DISPATCH
+}
@@ -0,0 +1,50 @@
+/**************************************************************
+ *
+ *                     threaded.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ * 
+ *     threaded.h holds the definition of the direct-threaded
+ *     execution engine in threaded.c
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "lilum.h"
+
+#ifndef THREADED_H
+#define THREADED_H
+
+/* Whether execute_threaded fuses common instruction pairs into
+   superinstructions when it decodes segment 0 */
+extern bool fusion;
+
+/*
+    execute_threaded
+    ***************************************************************************
+    Input: 
+        Memory mem : Memory struct that holds the segments, free sequences, 
+                        and program counter
+        uint64_t budget: maximum number of instructions to execute
+        bool pause_at_io: whether to stop in front of input
+    Returns:
+        why execution stopped, exactly as for execute_until
+    Effects:
+        Executes the program with the same semantics as the switch loop in
+        execute_until, but dispatches through a table of label addresses
+        (computed goto), keeps the registers, the program counter and the
+        segment 0 base pointer in locals, and runs each word from its
+        predecoded entry (see program_decoded), decoding it with inline
+        shifts the first time and fusing it with the next word when the
+        pair is a common one. The machine registers and program counter
+        are brought up to date whenever control leaves the engine.
+    Expects: 
+        Memory struct pointer is not NULL
+    ***************************************************************************
+*/
+Stop_reason execute_threaded(Memory mem, uint64_t budget, bool pause_at_io);
+
+#endif
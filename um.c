@@ -14,11 +14,126 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
+#include <stdbool.h>
 #include <seq.h>
 #include <bitpack.h>
-#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "memory.h"
 #include "lilum.h"
+#include "instructions.h"
+#include "snapshot.h"
+#include "checkpoint.h"
+#include "imagecache.h"
+#include "forkserver.h"
+#include "profile.h"
+#include "threaded.h"
+#include "batch.h"
+#include "engine.h"
+#include "placement.h"
+#include "writer.h"
+
+/*
+    usage
+    ***************************************************************************
+    Input: 
+        char *progname: name the program was invoked as
+    Returns: 
+        none
+    Effects: 
+        Prints the command line usage to stderr and exits with failure
+    ***************************************************************************
+*/
+static void usage(char *progname)
+{
+        fprintf(stderr, "Usage: %s [--engine={threaded|jit|switch}] "
+                        "[--no-fusion] [--profile]\n"
+                        "          [--compare=ENGINE,ENGINE]\n"
+                        "          [--load-stats] [--alloc-stats] "
+                        "[--snapshot=FILE [--snapshot-at=N]]\n"
+                        "          [--checkpoint=FILE "
+                        "[--checkpoint-every=SECONDS]]\n"
+                        "          [--huge-pages] [--numa] [--stats] "
+                        "[--quota=WORDS]\n"
+                        "          [--flush={line|full}] [--async-output] "
+                        "[--input=FILE]\n"
+                        "          [--cache-dir=DIR | --no-cache]\n"
+                        "          [--fork-server=SOCKET [--warm-at=N]]\n"
+                        "          {program.um | - | --fd=N | "
+                        "--restore=FILE}\n"
+                        "       %s batch [--engine={threaded|jit|switch}] "
+                        "[--no-fusion]\n"
+                        "          [--huge-pages] [--numa] [--stats] "
+                        "[--quota=WORDS]\n"
+                        "          [--threads=N] MANIFEST\n", progname,
+                        progname);
+        exit(EXIT_FAILURE);
+}
+
+/*
+    report_profile
+    ***************************************************************************
+    Input: 
+        none
+    Returns: 
+        none
+    Effects: 
+        Prints the instruction profile to stderr; registered with atexit 
+        because the program ends inside halt
+    ***************************************************************************
+*/
+static void report_profile(void)
+{
+        profile_report(stderr, 20);
+}
+
+/*
+    parse_count
+    ***************************************************************************
+    Input: 
+        char *text: decimal number taken from a command line option
+        char *progname: name the program was invoked as
+    Returns: 
+        the value of text
+    Effects: 
+        Prints the usage and exits if text is not a non-negative number
+    ***************************************************************************
+*/
+static unsigned long long parse_count(char *text, char *progname)
+{
+        char *end;
+        unsigned long long n = strtoull(text, &end, 10);
+        if (*end != '\0' || end == text || *text == '-') {
+                usage(progname);
+        }
+        return n;
+}
+
+/*
+    parse_engines
+    ***************************************************************************
+    Input: 
+        char *text: "A,B" from --compare=A,B; the comma is overwritten
+        const Engine *pair[2]: set to engines A and B
+        char *progname: name the program was invoked as
+    Effects: 
+        Prints the usage and exits unless A and B both name engines
+    ***************************************************************************
+*/
+static void parse_engines(char *text, const Engine *pair[2], char *progname)
+{
+        char *comma = strchr(text, ',');
+        if (comma == NULL) {
+                usage(progname);
+        }
+        *comma = '\0';
+        pair[0] = find_engine(text);
+        pair[1] = find_engine(comma + 1);
+        if (pair[0] == NULL || pair[1] == NULL) {
+                usage(progname);
+        }
+}
 
 /*
     main 
@@ -29,8 +144,49 @@
     Returns: 
         TODO
     Effects: 
-        Read and execute instructions from .um file passed into the
-        command line or standard input
+        Read and execute instructions from the .um file passed into the
+        command line. The image may also come from standard input ("-") or
+        an inherited descriptor (--fd=N), such as a pipe from a
+        decompressor. With --load-stats, the time taken to load the image
+        and the load throughput are printed to stderr.
+        With --snapshot=FILE, SIGUSR1 (or executing --snapshot-at=N
+        instructions) saves the whole machine to FILE; --restore=FILE 
+        resumes such a snapshot in place of loading a program.
+        With --checkpoint=FILE, the machine is saved to FILE every
+        --checkpoint-every=SECONDS (default 60): the first time whole and
+        then only what changed since, by a forked child while the program
+        runs on. --restore=FILE resumes from the last complete checkpoint.
+        With --cache-dir=DIR (or $UM_CACHE_DIR, see
+        image_cache_default_dir) and without --no-cache, a
+        self-decompressing image is saved to that image cache after it
+        loads its decompressed code, and later runs of the same image
+        start from that point.
+        --engine picks the direct-threaded engine (the default), the
+        x86-64 basic-block compiler or the reference switch loop; 
+        --no-fusion turns off the threaded engine's superinstructions.
+        --profile runs the switch loop and prints the most frequent 
+        instruction sequences at exit.
+        With --fork-server=SOCKET, the program runs up to its first input
+        (or --warm-at=N instructions) and then each connection to SOCKET
+        runs as a job in a forked copy of that machine.
+        "um batch MANIFEST" runs every job in MANIFEST on --threads=N
+        worker threads (one per core by default); see run_batch.
+        --compare=A,B runs the program on engine A and then on engine B,
+        with the same input, and reports their speeds (compare_engines).
+        --stats prints the machine's memory counters (live segments,
+        mapped and peak words, map and unmap rates) at halt, and
+        --quota=WORDS caps the words its segments may hold: a map over it
+        stops the program with an error rather than growing without bound.
+        Both apply to each job of a batch.
+        Output is buffered (OUTPUT_BUFFER_BYTES) and written when the
+        buffer fills, before an input that must wait and when the program
+        stops; --flush=line also writes it at every newline, the default
+        when stdout is a terminal, and --flush=full does not.
+        --async-output hands each write to a writer thread instead
+        (writer_start), so the program runs on while its output drains.
+        --input=FILE makes FILE the program's standard input once the
+        image is loaded, so that it can be read from a mapping of the file
+        (see machine_input) even when the image itself came from stdin.
     Expects:
         argc > 0 
         argv is not NULL
@@ -39,13 +195,214 @@
     ***************************************************************************
 */
 int main(int argc, char *argv[]){
-        (void) argc;
-        FILE *input_file = open_file(argv[1]);
-        struct stat file_status;
-        stat(argv[1], &file_status);
-        long hint = file_status.st_size / 4;
+        char *filename = NULL;
+        char *restore = NULL;
+        const char *cache_dir = image_cache_default_dir();
+        const char *server_socket = NULL;
+        uint64_t warm_at = UINT64_MAX;
+        int fd = -1;
+        bool load_stats = false;
+        bool alloc_stats = false;
+        bool stats = false;
+        uint64_t quota = 0;
+        bool checkpoint_every = false;
+        bool flush_given = false;
+        const char *input_path = NULL;
+        bool batch = argc > 1 && strcmp(argv[1], "batch") == 0;
+        unsigned threads = 0;
+        const Engine *compare[2] = { NULL, NULL };
+        for (int i = batch ? 2 : 1; i < argc; i++) {
+                bool have_program = filename != NULL || fd >= 0 || 
+                                    restore != NULL;
+                if (strncmp(argv[i], "--engine=", 9) == 0) {
+                        engine = find_engine(argv[i] + 9);
+                        if (engine == NULL) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "--no-fusion") == 0) {
+                        fusion = false;
+                } else if (strcmp(argv[i], "--huge-pages") == 0) {
+                        huge_pages = true;
+                } else if (strcmp(argv[i], "--numa") == 0) {
+                        numa_binding = true;
+                } else if (strcmp(argv[i], "--stats") == 0) {
+                        stats = true;
+                } else if (strncmp(argv[i], "--quota=", 8) == 0) {
+                        quota = parse_count(argv[i] + 8, argv[0]);
+                } else if (batch && strncmp(argv[i], "--threads=", 10) == 0) {
+                        threads = parse_count(argv[i] + 10, argv[0]);
+                } else if (batch && argv[i][0] == '-') {
+                        usage(argv[0]);
+                } else if (strncmp(argv[i], "--compare=", 10) == 0) {
+                        parse_engines(argv[i] + 10, compare, argv[0]);
+                } else if (strcmp(argv[i], "--profile") == 0) {
+                        profiling = true;
+                } else if (strcmp(argv[i], "--load-stats") == 0) {
+                        load_stats = true;
+                } else if (strcmp(argv[i], "--alloc-stats") == 0) {
+                        alloc_stats = true;
+                } else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+                        snapshot_path = argv[i] + 11;
+                } else if (strncmp(argv[i], "--snapshot-at=", 14) == 0) {
+                        snapshot_at = parse_count(argv[i] + 14, argv[0]);
+                } else if (strncmp(argv[i], "--checkpoint=", 13) == 0) {
+                        checkpoint_path = argv[i] + 13;
+                } else if (strncmp(argv[i], "--checkpoint-every=", 19) ==
+                           0) {
+                        uint64_t seconds = parse_count(argv[i] + 19,
+                                                       argv[0]);
+                        if (seconds == 0 || seconds > UINT32_MAX) {
+                                usage(argv[0]);
+                        }
+                        checkpoint_interval = (unsigned)seconds;
+                        checkpoint_every = true;
+                } else if (strcmp(argv[i], "--flush=line") == 0) {
+                        flush_at_newline = true;
+                        flush_given = true;
+                } else if (strcmp(argv[i], "--flush=full") == 0) {
+                        flush_at_newline = false;
+                        flush_given = true;
+                } else if (strcmp(argv[i], "--async-output") == 0) {
+                        async_output = true;
+                } else if (strncmp(argv[i], "--input=", 8) == 0) {
+                        input_path = argv[i] + 8;
+                } else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+                        cache_dir = argv[i] + 12;
+                } else if (strcmp(argv[i], "--no-cache") == 0) {
+                        cache_dir = NULL;
+                } else if (strncmp(argv[i], "--fork-server=", 14) == 0) {
+                        server_socket = argv[i] + 14;
+                } else if (strncmp(argv[i], "--warm-at=", 10) == 0) {
+                        warm_at = parse_count(argv[i] + 10, argv[0]);
+                } else if (strncmp(argv[i], "--restore=", 10) == 0 &&
+                           !have_program) {
+                        restore = argv[i] + 10;
+                } else if (strncmp(argv[i], "--fd=", 5) == 0 &&
+                           !have_program) {
+                        fd = (int)parse_count(argv[i] + 5, argv[0]);
+                } else if (!have_program) {
+                        filename = argv[i];
+                } else {
+                        usage(argv[0]);
+                }
+        }
+        if (filename == NULL && fd < 0 && restore == NULL) {
+                usage(argv[0]);
+        }
+        if (batch) {
+                return run_batch(filename, threads, quota, stats);
+        }
+        if (snapshot_path == NULL && snapshot_at != UINT64_MAX) {
+                usage(argv[0]);
+        }
+        if (server_socket == NULL && warm_at != UINT64_MAX) {
+                usage(argv[0]);
+        }
+        if ((checkpoint_path == NULL && checkpoint_every) ||
+            (checkpoint_path != NULL && server_socket != NULL) ||
+            (input_path != NULL && server_socket != NULL) ||
+            (async_output && server_socket != NULL)) {
+                usage(argv[0]);
+        }
+        int input_fd = -1;
+        if (input_path != NULL) {
+                input_fd = open(input_path, O_RDONLY);
+                if (input_fd < 0) {
+                        perror(input_path);
+                        exit(EXIT_FAILURE);
+                }
+        }
+        if (compare[0] != NULL) {
+                /* Both runs must start from the same machine and do nothing
+                   but run it */
+                if (snapshot_path != NULL || checkpoint_path != NULL ||
+                    server_socket != NULL || profiling) {
+                        usage(argv[0]);
+                }
+                cache_dir = NULL;
+        }
+        if (!flush_given) {
+                flush_at_newline = isatty(STDOUT_FILENO);
+        }
+        if (snapshot_path != NULL) {
+                snapshot_install_signal();
+        }
+        if (profiling) {
+                /* Only the reference loop records profiles */
+                engine = find_engine("switch");
+                atexit(report_profile);
+        }
+
+        if (!placement_bind_thread()) {
+                fprintf(stderr, "%s: cannot bind to a NUMA node\n", argv[0]);
+        }
 
-        Memory mem = create_segment0(hint);
-        read_instructions(input_file, mem);
-        execute(mem);
+        Memory mem;
+        if (restore != NULL) {
+                mem = checkpoint_restore(restore);
+                if (mem == NULL) {
+                        fprintf(stderr, "%s: not a valid UM snapshot or "
+                                        "checkpoint\n", restore);
+                        exit(EXIT_FAILURE);
+                }
+        } else {
+                mem = create_segment0(0);
+                if (fd >= 0) {
+                        load_instructions_fd(fd, mem, load_stats);
+                        close(fd);
+                } else {
+                        load_instructions(filename, mem, load_stats);
+                }
+                Memory cached = NULL;
+                if (cache_dir != NULL) {
+                        cached = image_cache_open(cache_dir, mem, load_stats);
+                }
+                if (cached != NULL) {
+                        free_segments(mem);
+                        mem = cached;
+                }
+        }
+        set_memory_quota(mem, quota);
+        if (input_fd >= 0 && input_fd != STDIN_FILENO) {
+                dup2(input_fd, STDIN_FILENO);
+                close(input_fd);
+        }
+        if (compare[0] != NULL) {
+                return compare_engines(mem, compare[0], compare[1]);
+        }
+        engine->init();
+        if (server_socket != NULL) {
+                fork_server(server_socket, mem, warm_at);
+        }
+        if (checkpoint_path != NULL) {
+                checkpoint_start(mem);
+        }
+        if (async_output && !writer_start(STDOUT_FILENO)) {
+                fprintf(stderr, "%s: cannot start the output writer\n",
+                        argv[0]);
+        }
+        Stop_reason reason = execute(mem);
+        engine->teardown();
+        if (stats) {
+                report_memory_stats(mem, stderr);
+                if (checkpoint_path != NULL) {
+                        checkpoint_report(stderr);
+                }
+                if (writer_running()) {
+                        writer_report(stderr);
+                }
+        }
+        if (alloc_stats) {
+                report_allocation(mem, stderr);
+        }
+        if (huge_pages || numa_binding) {
+                placement_sample();
+                placement_report(stderr);
+        }
+        if (reason == STOP_MAP_FAILED) {
+                report_map_failure(mem, stderr);
+                free_segments(mem);
+                exit(EXIT_FAILURE);
+        }
+        halt(mem);
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+/**************************************************************
+ *
+ *                     um2c.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     um2c translates a .um image's segment 0 into a C program
+ *     to be linked against libum.a. Every address gets a label,
+ *     and a load program of segment 0 becomes a computed goto
+ *     through a table of those labels (one table per chunk of
+ *     CHUNK words, with main moving between chunks). Stores to
+ *     segment 0, load programs of any other segment and jumps
+ *     past the end hand the machine to the interpreter
+ *     (aot_fallback), so the compiled program behaves exactly
+ *     like um running the image.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "memory.h"
+#include "lilum.h"
+
+/* Words per generated function. Larger chunks keep more jumps local but
+   the compiler's time grows quickly with the number of label addresses
+   in one function. */
+#define CHUNK 256
+
+/*
+    emit_instruction
+    ***************************************************************************
+    Input: 
+        FILE *out: where the C goes
+        uint32_t word: the instruction
+        uint32_t at: its address
+    Effects:
+        writes the label for address at and the C for word, which runs
+        into the next address unless it jumps, halts or falls back
+    ***************************************************************************
+*/
+static void emit_instruction(FILE *out, uint32_t word, uint32_t at)
+{
+        unsigned opcode = word >> 28;
+        unsigned a = (word >> 6) & 7, b = (word >> 3) & 7, c = word & 7;
+
+        fprintf(out, "L%u:\n", at);
+        switch (opcode) {
+        case 0:
+                fprintf(out, "\tif (r[%u] != 0) r[%u] = r[%u];\n", c, a, b);
+                break;
+        case 1:
+                fprintf(out, "\tr[%u] = value_in_segment(mem, r[%u], r[%u]);"
+                             "\n", a, b, c);
+                break;
+        case 2:
+                /* Segment 0 no longer matches the compiled code */
+                fprintf(out, "\tstore_in_segment(mem, r[%u], r[%u], r[%u]);\n"
+                             "\tif (r[%u] == 0) aot_fallback(mem, r, %u);\n",
+                        c, a, b, a, at + 1);
+                break;
+        case 3:
+                fprintf(out, "\tr[%u] = r[%u] + r[%u];\n", a, b, c);
+                break;
+        case 4:
+                fprintf(out, "\tr[%u] = r[%u] * r[%u];\n", a, b, c);
+                break;
+        case 5:
+                fprintf(out, "\tr[%u] = r[%u] / r[%u];\n", a, b, c);
+                break;
+        case 6:
+                fprintf(out, "\tr[%u] = ~(r[%u] & r[%u]);\n", a, b, c);
+                break;
+        case 7:
+                fprintf(out, "\thalt(mem);\n");
+                break;
+        case 8:
+                /* A refused map leaves the registers alone and is
+                   retried, and reported, by the interpreter */
+                fprintf(out, "\t{\n"
+                             "\t\tuint32_t id = map_segment_helper(mem, "
+                             "r[%u]);\n"
+                             "\t\tif (id == 0) aot_fallback(mem, r, %u);\n"
+                             "\t\tr[%u] = id;\n"
+                             "\t}\n", c, at, b);
+                break;
+        case 9:
+                fprintf(out, "\tunmap_segment_helper(mem, r[%u]);\n", c);
+                break;
+        case 10:
+                fprintf(out, "\tassert(r[%u] <= 255);\n"
+                             "\tmachine_output(mem, (uint8_t)r[%u]);\n", c, c);
+                break;
+        case 11:
+                /* EOF (-1) becomes the all-ones word, as in input */
+                fprintf(out, "\tr[%u] = (uint32_t)machine_input(mem);\n", c);
+                break;
+        case 12:
+                fprintf(out, "\tif (r[%u] != 0) {\n"
+                             "\t\tload_program_helper(mem, r[%u], r[%u]);\n"
+                             "\t\taot_fallback(mem, r, r[%u]);\n"
+                             "\t}\n"
+                             "\ttarget = r[%u];\n"
+                             "\tgoto dispatch;\n",
+                        b, b, c, c, c);
+                break;
+        case 13:
+                fprintf(out, "\tr[%u] = %u;\n", (word >> 25) & 7,
+                        word & 0x1ffffff);
+                break;
+        default:
+                /* Opcodes 14 and 15 do nothing, as in execute_until */
+                break;
+        }
+}
+
+/*
+    emit_chunk
+    ***************************************************************************
+    Input: 
+        FILE *out: where the C goes
+        const uint32_t *words: segment 0, host order
+        uint32_t first: address of the chunk's first word
+        uint32_t count: number of words in the chunk
+    Effects:
+        writes chunk_<first / CHUNK>, a function that runs the program from
+        target while it stays inside the chunk. It works on a local copy of
+        the registers and returns the address it left the chunk for.
+    ***************************************************************************
+*/
+static void emit_chunk(FILE *out, const uint32_t *words, uint32_t first,
+                       uint32_t count)
+{
+        fprintf(out, "static uint32_t chunk_%u(Memory mem, uint32_t "
+                     "*registers, uint32_t target)\n{\n"
+                     "\tstatic const void *const labels[%u] = {",
+                first / CHUNK, count);
+        for (uint32_t i = 0; i < count; i++) {
+                fprintf(out, "%s&&L%u,", i % 6 == 0 ? "\n\t\t" : " ",
+                        first + i);
+        }
+        fprintf(out, "\n\t};\n"
+                     "\tuint32_t r[8];\n"
+                     "\tmemcpy(r, registers, sizeof(r));\n"
+                     "\t(void)mem;\n"
+                     "\tgoto dispatch;\n\n");
+
+        for (uint32_t i = 0; i < count; i++) {
+                emit_instruction(out, words[first + i], first + i);
+        }
+        fprintf(out, "\tLEAVE(%u);\n\n"
+                     "dispatch:\n"
+                     "\tif (target - %u >= %u) LEAVE(target);\n"
+                     "\tgoto *labels[target - %u];\n}\n\n",
+                first + count, first, count, first);
+}
+
+/*
+    translate
+    ***************************************************************************
+    Input: 
+        FILE *out: where the C goes
+        const char *name: the image's file name, for the header comment
+        const uint32_t *words: segment 0, host order
+        uint32_t length: number of words
+    Effects:
+        writes a complete C program that runs the image: the image itself,
+        one function per CHUNK words, and a main that calls the chunk
+        holding the next address until the program leaves segment 0
+    ***************************************************************************
+*/
+static void translate(FILE *out, const char *name, const uint32_t *words,
+                      uint32_t length)
+{
+        fprintf(out, "/* Generated by um2c from %s; do not edit. */\n"
+                     "#include <stdint.h>\n"
+                     "#include <string.h>\n"
+                     "#include <assert.h>\n"
+                     "#include \"aot.h\"\n"
+                     "#include \"instructions.h\"\n\n"
+                     "/* Label addresses and computed goto are GNU C "
+                     "extensions */\n"
+                     "#pragma GCC diagnostic ignored \"-Wpedantic\"\n\n"
+                     "#define LEAVE(next) do { memcpy(registers, r, "
+                     "sizeof(r)); return (next); } while (0)\n\n",
+                name);
+
+        fprintf(out, "static const uint32_t image[%u] = {", 
+                length > 0 ? length : 1);
+        for (uint32_t i = 0; i < length; i++) {
+                fprintf(out, "%s0x%08x,", i % 6 == 0 ? "\n\t" : " ",
+                        words[i]);
+        }
+        fprintf(out, "%s\n};\n\n", length > 0 ? "" : "0");
+
+        uint32_t chunks = (length + CHUNK - 1) / CHUNK;
+        for (uint32_t i = 0; i < chunks; i++) {
+                uint32_t first = i * CHUNK;
+                emit_chunk(out, words, first, 
+                           length - first < CHUNK ? length - first : CHUNK);
+        }
+
+        fprintf(out, "static uint32_t (*const chunks[%u])(Memory, uint32_t *, "
+                     "uint32_t) = {", chunks > 0 ? chunks : 1);
+        for (uint32_t i = 0; i < chunks; i++) {
+                fprintf(out, "%schunk_%u,", i % 6 == 0 ? "\n\t" : " ", i);
+        }
+        fprintf(out, "%s\n};\n\n"
+                     "int main(void)\n{\n"
+                     "\tMemory mem = aot_load(image, %u);\n"
+                     "\tuint32_t r[8] = { 0 };\n"
+                     "\tuint32_t target = 0;\n"
+                     "\twhile (target < %u)\n"
+                     "\t\ttarget = chunks[target / %u](mem, r, target);\n"
+                     "\taot_fallback(mem, r, target);\n}\n",
+                chunks > 0 ? "" : "0", length, length, CHUNK);
+}
+
+/*
+    main
+    ***************************************************************************
+    Input:
+        int argc: number of arguments passed into command line
+        char *argv[]: character string of arguments passed into command line
+    Returns:
+        EXIT_SUCCESS, or EXIT_FAILURE if the output cannot be written
+    Effects:
+        um2c program.um [-o program.c] reads program.um and writes its
+        translation to program.c, or to stdout
+    ***************************************************************************
+*/
+int main(int argc, char *argv[])
+{
+        char *filename = NULL;
+        char *output = NULL;
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                        output = argv[++i];
+                } else if (filename == NULL) {
+                        filename = argv[i];
+                } else {
+                        filename = NULL;
+                        break;
+                }
+        }
+        if (filename == NULL) {
+                fprintf(stderr, "Usage: %s program.um [-o program.c]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        Memory mem = create_segment0(0);
+        load_instructions(filename, mem, false);
+        uint32_t length;
+        const uint32_t *words = program_words(mem, &length);
+
+        FILE *out = stdout;
+        if (output != NULL) {
+                out = fopen(output, "w");
+                if (out == NULL) {
+                        perror(output);
+                        return EXIT_FAILURE;
+                }
+        }
+        translate(out, filename, words, length);
+        free_segments(mem);
+        if (ferror(out) || fclose(out) != 0) {
+                perror(output != NULL ? output : "stdout");
+                return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+}
@@ -503,4 +503,198 @@ void build_load_program_test(Seq_T stream)
         append(stream, segmented_load(r6, r6, r6));
         append(stream, output(r6));
         append(stream, halt());
-}
\ No newline at end of file
+}
+
+/* A store over a word of segment 0 that has already run, so that the
+   engines have decoded (or translated) it: the first pass prints the 'A'
+   of word 0, the second pass the 'B' stored over it. The new word is kept
+   as data after the halt and read with a segmented load. */
+void build_store_executed_test(Seq_T stream)
+{
+        append(stream, loadval(r1, 'A'));       /* 0: replaced on pass 2 */
+        append(stream, output(r1));
+        append(stream, loadval(r3, 6));         /* first pass: go on at 6 */
+        append(stream, loadval(r7, 11));        /* second pass: halt */
+        append(stream, conditional_move(r3, r7, r6));
+        append(stream, load_program(r0, r3));
+        append(stream, loadval(r6, 1));         /* 6 */
+        append(stream, loadval(r5, 12));
+        append(stream, segmented_load(r4, r0, r5));
+        append(stream, segmented_store(r0, r0, r4)); /* [0][0] = word 12 */
+        append(stream, load_program(r0, r0));
+        append(stream, halt());                 /* 11 */
+        append(stream, loadval(r1, 'B'));       /* 12: data */
+}
+
+/* A store over the second word of a pair of loadvals, which the threaded
+   engine runs as one superinstruction: the first pass prints "AC", and the
+   second must print "AD" rather than running the pair it decoded before */
+void build_store_fused_test(Seq_T stream)
+{
+        append(stream, loadval(r1, 'A'));
+        append(stream, loadval(r2, 'C'));       /* 1: replaced on pass 2 */
+        append(stream, output(r1));
+        append(stream, output(r2));
+        append(stream, loadval(r3, 8));         /* first pass: go on at 8 */
+        append(stream, loadval(r7, 14));        /* second pass: halt */
+        append(stream, conditional_move(r3, r7, r6));
+        append(stream, load_program(r0, r3));
+        append(stream, loadval(r6, 1));         /* 8 */
+        append(stream, loadval(r5, 15));
+        append(stream, segmented_load(r4, r0, r5));
+        append(stream, loadval(r5, 1));
+        append(stream, segmented_store(r0, r5, r4)); /* [0][1] = word 15 */
+        append(stream, load_program(r0, r0));
+        append(stream, halt());                 /* 14 */
+        append(stream, loadval(r2, 'D'));       /* 15: data */
+}
+
+/* A store over a word further on in the same straight run of code, which
+   the JIT translates as one block before running any of it: the 'A' that
+   word 4 loads must be replaced by the 'B' stored over it */
+void build_store_ahead_test(Seq_T stream)
+{
+        append(stream, loadval(r5, 7));
+        append(stream, segmented_load(r4, r0, r5));
+        append(stream, loadval(r3, 4));
+        append(stream, segmented_store(r0, r3, r4)); /* [0][4] = word 7 */
+        append(stream, loadval(r1, 'A'));       /* 4: replaced */
+        append(stream, output(r1));
+        append(stream, halt());
+        append(stream, loadval(r1, 'B'));       /* 7: data */
+}
+
+/* The overlays of build_image_cache_test. Each is copied into a segment of
+   its own and then run as the program, in the order of a schedule kept in
+   the segment whose id is in r3: r5 is the index of the current entry and
+   r6 holds 1. A print overlay prints its character and loads the next
+   entry. A self-patch overlay prints its character, stores "print '!'"
+   over its own word 0 and runs it, which must not show the next time it
+   is loaded. A patch overlay stores its last word over word 0 of the
+   segment in the next entry, which must show from then on. */
+enum { PRINT, SELF_PATCH, PATCH, STOP };
+
+static struct overlay {
+        int kind;
+        char c;
+        uint32_t length;
+} overlays[] = {
+        { PRINT, 'a', 5 }, { PRINT, 'b', 5 }, { PRINT, 'c', 5 },
+        { PRINT, 'd', 5 }, { PRINT, 'e', 5 }, { PRINT, 'f', 5 },
+        { PRINT, 'g', 5 }, { PRINT, 'h', 5 }, { PRINT, 'i', 5 },
+        { PRINT, 'j', 5 },
+        { PRINT, 'c', 5 },              /* 10: the same words as 2 */
+        { PRINT, 'L', 16384 },          /* 11: large enough to be shared */
+        { SELF_PATCH, 'S', 17 },
+        { SELF_PATCH, 'T', 16384 },
+        { PATCH, 'A', 9 },              /* 14: patches 'a' to 'A' */
+        { STOP, 0, 1 },
+};
+
+/* Overlays in the order they run, the entry after a patch naming the
+   overlay it patches; prints "abccaLLS!S!T!T!AdefghijbALS!T!" */
+static const int schedule[] = {
+        0, 1, 2, 10, 0, 11, 11, 12, 12, 13, 13, 14, 0, 0,
+        3, 4, 5, 6, 7, 8, 9, 1, 0, 11, 12, 13, 15
+};
+
+#define SCHEDULE_LENGTH (sizeof(schedule) / sizeof(schedule[0]))
+#define OVERLAY_COUNT (sizeof(overlays) / sizeof(overlays[0]))
+
+static int overlay_words(struct overlay *overlay, Um_instruction *words)
+{
+        int n = 0;
+        switch (overlay->kind) {
+        case PRINT:
+                words[n++] = loadval(r1, overlay->c);
+                words[n++] = output(r1);
+                break;
+        case SELF_PATCH:
+                /* Goes on at the word that word 15 names: 5 at first,
+                   then 12 once word 0 is patched */
+                words[n++] = loadval(r1, overlay->c);
+                words[n++] = output(r1);
+                words[n++] = loadval(r7, 15);
+                words[n++] = segmented_load(r7, r0, r7);
+                words[n++] = load_program(r0, r7);
+                words[n++] = loadval(r7, 16);           /* 5 */
+                words[n++] = segmented_load(r4, r0, r7);
+                words[n++] = segmented_store(r0, r0, r4);
+                words[n++] = loadval(r7, 15);
+                words[n++] = loadval(r4, 12);
+                words[n++] = segmented_store(r0, r7, r4);
+                words[n++] = load_program(r0, r0);
+                break;
+        case PATCH:
+                words[n++] = add(r5, r5, r6);
+                words[n++] = segmented_load(r2, r3, r5);
+                words[n++] = loadval(r7, 8);
+                words[n++] = segmented_load(r4, r0, r7);
+                words[n++] = segmented_store(r2, r0, r4);
+                break;
+        case STOP:
+                words[n++] = halt();
+                return n;
+        }
+        words[n++] = add(r5, r5, r6);
+        words[n++] = segmented_load(r4, r3, r5);
+        words[n++] = load_program(r4, r0);
+        if (overlay->kind == SELF_PATCH) {
+                words[n++] = 5;                         /* 15 */
+                words[n++] = loadval(r1, '!');
+        } else if (overlay->kind == PATCH) {
+                words[n++] = loadval(r1, overlay->c);
+        }
+        return n;
+}
+
+/* Runs the overlays through the program image cache: loads of a segment
+   that was not stored to, of two segments with the same words, of more
+   distinct segments than the cache holds, of large segments, and of
+   segments modified before or after they were loaded. Segment 0 maps and
+   fills the schedule and the overlays, copying the overlays' words from
+   after its own code, and then loads the first overlay. */
+void build_image_cache_test(Seq_T stream)
+{
+        Um_instruction words[OVERLAY_COUNT][32];
+        int lengths[OVERLAY_COUNT];
+        uint32_t code = 6;
+        for (unsigned k = 0; k < OVERLAY_COUNT; k++) {
+                lengths[k] = overlay_words(&overlays[k], words[k]);
+                code += 2 + 4 * lengths[k];
+                for (unsigned j = 0; j < SCHEDULE_LENGTH; j++) {
+                        code += schedule[j] == (int)k ? 2 : 0;
+                }
+        }
+
+        append(stream, loadval(r6, 1));
+        append(stream, loadval(r7, SCHEDULE_LENGTH));
+        append(stream, map_segment(r3, r7));
+        uint32_t data = code;
+        for (unsigned k = 0; k < OVERLAY_COUNT; k++) {
+                append(stream, loadval(r7, overlays[k].length));
+                append(stream, map_segment(r2, r7));
+                for (int w = 0; w < lengths[k]; w++) {
+                        append(stream, loadval(r7, data + w));
+                        append(stream, segmented_load(r4, r0, r7));
+                        append(stream, loadval(r7, w));
+                        append(stream, segmented_store(r2, r7, r4));
+                }
+                data += lengths[k];
+                for (unsigned j = 0; j < SCHEDULE_LENGTH; j++) {
+                        if (schedule[j] == (int)k) {
+                                append(stream, loadval(r7, j));
+                                append(stream, segmented_store(r3, r7, r2));
+                        }
+                }
+        }
+        append(stream, loadval(r5, 0));
+        append(stream, segmented_load(r4, r3, r5));
+        append(stream, load_program(r4, r0));
+        assert((uint32_t)Seq_length(stream) == code);
+        for (unsigned k = 0; k < OVERLAY_COUNT; k++) {
+                for (int w = 0; w < lengths[k]; w++) {
+                        append(stream, words[k][w]);
+                }
+        }
+}
@@ -25,6 +25,10 @@ extern void build_multiply_test(Seq_T stream);
 extern void build_division_test(Seq_T stream);
 extern void build_nand_test(Seq_T stream);
 extern void build_load_program_test(Seq_T stream);
+extern void build_store_executed_test(Seq_T stream);
+extern void build_store_fused_test(Seq_T stream);
+extern void build_store_ahead_test(Seq_T stream);
+extern void build_image_cache_test(Seq_T stream);
 
 
 
@@ -54,6 +58,11 @@ static struct test_info {
         { "division",         NULL, "",  build_division_test },
         { "nand",         NULL, "",  build_nand_test },
         { "load-program",         NULL, "",  build_load_program_test },
+        { "store-executed",       NULL, "AB", build_store_executed_test },
+        { "store-fused",          NULL, "ACAD", build_store_fused_test },
+        { "store-ahead",          NULL, "B", build_store_ahead_test },
+        { "image-cache",          NULL, "abccaLLS!S!T!T!AdefghijbALS!T!",
+          build_image_cache_test },
 };
 
   
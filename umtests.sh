@@ -0,0 +1,95 @@
+#!/bin/sh
+#
+# umtests.sh: runs every unit test that has an expected output (name.um
+# and name.1, with name.0 as its input if there is one, at the top level
+# or in submit/) under each engine, then kills a sandmark run that is
+# taking checkpoints and checks that what it printed, followed by what
+# --restore prints, makes up what an uninterrupted run prints. Last, it
+# restores a snapshot of sandmark taken part-way through.
+#
+# Run from the directory um was built in ("make check"). ENGINES picks the
+# engines (default: switch threaded jit), KILL_AFTER the seconds the
+# checkpointed run is given before it is killed (default 3) and SNAPSHOT_AT
+# the instructions run before the snapshot (default 50000000).
+#
+
+ENGINES=${ENGINES:-"switch threaded jit"}
+KILL_AFTER=${KILL_AFTER:-3}
+SNAPSHOT_AT=${SNAPSHOT_AT:-50000000}
+UM=./um
+OUT=${TMPDIR:-/tmp}/umtests.$$
+failed=0
+
+trap 'rm -f "$OUT".*' EXIT
+
+for engine in $ENGINES; do
+        for expected in *.1 submit/*.1; do
+                test=${expected%.1}
+                [ -f "$test.um" ] || continue
+                input=/dev/null
+                [ -f "$test.0" ] && input=$test.0
+                "$UM" --engine="$engine" "$test.um" < "$input" \
+                      > "$OUT.out" 2> /dev/null
+                if ! cmp -s "$OUT.out" "$expected"; then
+                        echo "FAIL: $test under --engine=$engine"
+                        failed=1
+                fi
+        done
+done
+
+# A checkpoint flushes the output printed before it, so a run killed after
+# some checkpoints has printed at least what --restore does not print again.
+# It may have printed more: the checkpoint being written when it was killed
+# is not restored, and the run resumes from the one before. What it printed
+# must start the uninterrupted output, and what --restore prints end it.
+expected=umbin/sandmark.out
+total=$(wc -c < "$expected")
+for engine in $ENGINES; do
+        "$UM" --engine="$engine" --checkpoint="$OUT.ck" --checkpoint-every=1 \
+              umbin/sandmark.umz > "$OUT.before" &
+        pid=$!
+        sleep "$KILL_AFTER"
+        if kill -9 $pid 2> /dev/null; then
+                wait $pid 2> /dev/null
+                "$UM" --engine="$engine" --restore="$OUT.ck" \
+                      > "$OUT.after"
+        else
+                wait $pid
+                : > "$OUT.after"
+                echo "note: sandmark finished under --engine=$engine" \
+                     "before it was killed"
+        fi
+        before=$(wc -c < "$OUT.before")
+        after=$(wc -c < "$OUT.after")
+        if ! head -c "$before" "$expected" | cmp -s - "$OUT.before" ||
+           ! tail -c "$after" "$expected" | cmp -s - "$OUT.after" ||
+           [ $((before + after)) -lt "$total" ]
+        then
+                echo "FAIL: sandmark restored from a checkpoint under" \
+                     "--engine=$engine"
+                failed=1
+        fi
+        rm -f "$OUT.ck"
+done
+
+# A snapshot leaves the run going, so it still prints the whole output; the
+# snapshot, restored, must print the rest of it from where it was taken.
+for engine in $ENGINES; do
+        "$UM" --engine="$engine" --snapshot="$OUT.snap" \
+              --snapshot-at="$SNAPSHOT_AT" umbin/sandmark.umz \
+              > "$OUT.before" 2> /dev/null
+        "$UM" --engine="$engine" --restore="$OUT.snap" > "$OUT.after"
+        after=$(wc -c < "$OUT.after")
+        if ! cmp -s "$OUT.before" "$expected" ||
+           ! tail -c "$after" "$expected" | cmp -s - "$OUT.after" ||
+           [ "$after" -eq 0 ] || [ "$after" -ge "$total" ]
+        then
+                echo "FAIL: sandmark restored from a snapshot under" \
+                     "--engine=$engine"
+                failed=1
+        fi
+        rm -f "$OUT.snap"
+done
+
+[ $failed = 0 ] && echo "all tests passed"
+exit $failed
@@ -0,0 +1,359 @@
+/**************************************************************
+ *
+ *                     writer.c
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     this file contains the output writer thread. With
+ *     --async-output a machine prints into a ring of
+ *     WRITER_RING_BYTES instead of its own buffer, and where it
+ *     would have called write it only moves the ring's head; a
+ *     thread of its own moves the tail by writing what lies
+ *     between them to stdout with writev, so a slow terminal or
+ *     pipe no longer stops the machine. The machine is the only
+ *     thread that moves head and the writer the only one that
+ *     moves tail, so neither takes a lock to hand bytes over.
+ *     The lock and its two conditions are only used to sleep:
+ *     by the writer when the ring is empty, and by the machine
+ *     when it is full or must wait for it to drain.
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "writer.h"
+
+bool async_output = false;
+
+/* Bytes committed by the machine and bytes written by the thread since the
+   start; the ring holds head - tail bytes from tail % WRITER_RING_BYTES on.
+   They are kept on cache lines of their own, as each is written by only
+   one of the two threads. */
+static uint64_t head __attribute__((aligned(64)));
+static uint64_t tail __attribute__((aligned(64)));
+
+/* Set by each side just before it sleeps, so that the other only takes
+   the lock to wake it when it is asleep */
+static bool writer_idle;
+static bool machine_waiting;
+static bool stopping;
+
+static uint8_t *ring;
+static int output_fd = -1;
+static bool running = false;
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t room = PTHREAD_COND_INITIALIZER;
+
+/* Counters for writer_report */
+static uint64_t written_bytes, write_calls, machine_waits;
+
+/*
+    wait_for_head
+    ***************************************************************************
+    Input:
+        uint64_t at: bytes the writer thread has written
+    Returns:
+        true once the machine has committed more than at, false if it has
+        not and the writer is stopping
+    Effects:
+        Sleeps on ready until then. writer_idle is set (under the lock)
+        before head is checked again, and writer_commit moves head before
+        it checks writer_idle, so a commit can never be missed.
+    ***************************************************************************
+*/
+static bool wait_for_head(uint64_t at)
+{
+        pthread_mutex_lock(&lock);
+        __atomic_store_n(&writer_idle, true, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&head, __ATOMIC_SEQ_CST) == at &&
+               !__atomic_load_n(&stopping, __ATOMIC_SEQ_CST)) {
+                pthread_cond_wait(&ready, &lock);
+        }
+        __atomic_store_n(&writer_idle, false, __ATOMIC_RELAXED);
+        bool more = __atomic_load_n(&head, __ATOMIC_SEQ_CST) != at;
+        pthread_mutex_unlock(&lock);
+        return more;
+}
+
+/*
+    wait_for_tail
+    ***************************************************************************
+    Input:
+        uint64_t target: bytes that must have been written
+    Returns:
+        none
+    Effects:
+        Sleeps on room until the writer thread has written target bytes in
+        all, with the same protocol as wait_for_head
+    ***************************************************************************
+*/
+static void wait_for_tail(uint64_t target)
+{
+        if (__atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= target) {
+                return;
+        }
+        pthread_mutex_lock(&lock);
+        __atomic_store_n(&machine_waiting, true, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&tail, __ATOMIC_SEQ_CST) < target) {
+                pthread_cond_wait(&room, &lock);
+        }
+        __atomic_store_n(&machine_waiting, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&lock);
+}
+
+/*
+    drain_ring
+    ***************************************************************************
+    Input:
+        void *unused: thread argument (unused)
+    Returns:
+        NULL
+    Effects:
+        The writer thread: writes everything between tail and head with one
+        writev (two pieces when it wraps around the end of the ring), moves
+        tail past what was written and wakes the machine if it is waiting
+        for room, until the ring is empty and writer_stop has been called.
+        Output fd will not take is dropped, as flush_output drops it.
+    ***************************************************************************
+*/
+static void *drain_ring(void *unused)
+{
+        (void) unused;
+        uint64_t at = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        for (;;) {
+                uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+                if (end == at) {
+                        if (!wait_for_head(at)) {
+                                return NULL;
+                        }
+                        continue;
+                }
+                uint32_t from = (uint32_t)(at & (WRITER_RING_BYTES - 1));
+                uint64_t length = end - at;
+                struct iovec pieces[2];
+                int count = 1;
+                pieces[0].iov_base = ring + from;
+                pieces[0].iov_len = length;
+                if (from + length > WRITER_RING_BYTES) {
+                        pieces[0].iov_len = WRITER_RING_BYTES - from;
+                        pieces[1].iov_base = ring;
+                        pieces[1].iov_len = length - pieces[0].iov_len;
+                        count = 2;
+                }
+                ssize_t written = writev(output_fd, pieces, count);
+                if (written < 0 && errno == EINTR) {
+                        continue;
+                }
+                write_calls++;
+                if (written > 0) {
+                        written_bytes += (uint64_t)written;
+                        at += (uint64_t)written;
+                } else {
+                        at = end;
+                }
+                __atomic_store_n(&tail, at, __ATOMIC_SEQ_CST);
+                if (__atomic_load_n(&machine_waiting, __ATOMIC_SEQ_CST)) {
+                        pthread_mutex_lock(&lock);
+                        pthread_cond_signal(&room);
+                        pthread_mutex_unlock(&lock);
+                }
+        }
+}
+
+/*
+    writer_start
+    ***************************************************************************
+    Input:
+        int fd: descriptor to write the output to
+    Returns:
+        true if the writer thread is running, false if it could not be
+        started (output is then written by the machine as before)
+    Effects:
+        Allocates the ring and starts the thread that drains it to fd, and
+        arranges for writer_stop to run at exit, so that output a program
+        printed before halting is written even though halt calls exit. The
+        thread blocks every signal but SIGPIPE, so that SIGUSR1 and the
+        checkpoint timer still reach the machine's thread while a closed
+        pipe ends the process as it does without the writer.
+    Expects:
+        called once, before any machine prints
+    ***************************************************************************
+*/
+bool writer_start(int fd)
+{
+        assert(!running);
+        ring = malloc(WRITER_RING_BYTES);
+        if (ring == NULL) {
+                return false;
+        }
+        output_fd = fd;
+        sigset_t all, saved;
+        sigfillset(&all);
+        sigdelset(&all, SIGPIPE);
+        pthread_sigmask(SIG_SETMASK, &all, &saved);
+        int error = pthread_create(&thread, NULL, drain_ring, NULL);
+        pthread_sigmask(SIG_SETMASK, &saved, NULL);
+        if (error != 0) {
+                free(ring);
+                ring = NULL;
+                return false;
+        }
+        running = true;
+        atexit(writer_stop);
+        return true;
+}
+
+/*
+    writer_running
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        true between writer_start and writer_stop
+    ***************************************************************************
+*/
+bool writer_running(void)
+{
+        return running;
+}
+
+/*
+    writer_space
+    ***************************************************************************
+    Input:
+        uint32_t *bytes: set to the number of bytes that may be written
+    Returns:
+        the free part of the ring just after the bytes committed so far,
+        at least 1 byte long and not wrapping around its end
+    Effects:
+        Waits for the writer thread to free some space if the ring is full,
+        so a program printing faster than fd takes its output is held back
+        rather than the ring growing
+    Expects:
+        the writer is running; called only by the thread running the
+        machine
+    ***************************************************************************
+*/
+uint8_t *writer_space(uint32_t *bytes)
+{
+        assert(running && bytes != NULL);
+        uint64_t committed = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        uint64_t written = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (committed - written == WRITER_RING_BYTES) {
+                machine_waits++;
+                wait_for_tail(committed - WRITER_RING_BYTES + 1);
+                written = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        }
+        uint32_t at = (uint32_t)(committed & (WRITER_RING_BYTES - 1));
+        uint32_t free_bytes = WRITER_RING_BYTES -
+                              (uint32_t)(committed - written);
+        *bytes = free_bytes < WRITER_RING_BYTES - at ?
+                 free_bytes : WRITER_RING_BYTES - at;
+        return ring + at;
+}
+
+/*
+    writer_commit
+    ***************************************************************************
+    Input:
+        uint32_t bytes: bytes filled in at the start of the last space
+    Returns:
+        none
+    Effects:
+        Hands the bytes to the writer thread, waking it if it is idle
+    Expects:
+        bytes is no more than writer_space last gave
+    ***************************************************************************
+*/
+void writer_commit(uint32_t bytes)
+{
+        assert(running);
+        uint64_t committed = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        __atomic_store_n(&head, committed + bytes, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&writer_idle, __ATOMIC_SEQ_CST)) {
+                pthread_mutex_lock(&lock);
+                pthread_cond_signal(&ready);
+                pthread_mutex_unlock(&lock);
+        }
+}
+
+/*
+    writer_drain
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Waits until everything committed has been written (or dropped
+        because fd would not take it); does nothing if the writer is not
+        running
+    ***************************************************************************
+*/
+void writer_drain(void)
+{
+        if (running) {
+                wait_for_tail(__atomic_load_n(&head, __ATOMIC_RELAXED));
+        }
+}
+
+/*
+    writer_stop
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Lets the writer thread write everything committed, then joins it
+        and frees the ring; does nothing if the writer is not running
+    ***************************************************************************
+*/
+void writer_stop(void)
+{
+        if (!running) {
+                return;
+        }
+        pthread_mutex_lock(&lock);
+        __atomic_store_n(&stopping, true, __ATOMIC_SEQ_CST);
+        pthread_cond_signal(&ready);
+        pthread_mutex_unlock(&lock);
+        pthread_join(thread, NULL);
+        running = false;
+        free(ring);
+        ring = NULL;
+}
+
+/*
+    writer_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Waits for the ring to drain, then prints how many bytes the writer
+        thread wrote in how many writev calls, and how many times the
+        machine had to wait for room in the ring
+    ***************************************************************************
+*/
+void writer_report(FILE *fp)
+{
+        writer_drain();
+        fprintf(fp, "async output: %llu bytes in %llu writes, machine "
+                    "waited for room %llu times\n",
+                (unsigned long long)written_bytes,
+                (unsigned long long)write_calls,
+                (unsigned long long)machine_waits);
+}
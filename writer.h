@@ -0,0 +1,136 @@
+/**************************************************************
+ *
+ *                     writer.h
+ *
+ *     Assignment: um
+ *     Authors:  Youssed Ezzo (yezzo01), Kerwin Teh (kteh01)
+ *     Date:     11/19/2023
+ *
+ *     writer.h holds the definitions of the functions used in
+ *     writer.c, the output writer thread that --async-output
+ *     hands a machine's standard output to
+ *
+ **************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#ifndef WRITER_H
+#define WRITER_H
+
+/* Bytes in the ring between the machine and the writer thread; a power of
+   two */
+#define WRITER_RING_BYTES (1u << 20)
+
+/* Whether standard output is written by a thread of its own
+   (--async-output) */
+extern bool async_output;
+
+/*
+    writer_start
+    ***************************************************************************
+    Input:
+        int fd: descriptor to write the output to
+    Returns:
+        true if the writer thread is running, false if it could not be
+        started (output is then written by the machine as before)
+    Effects:
+        Allocates the ring and starts the thread that drains it to fd, and
+        arranges for writer_stop to run at exit, so that output a program
+        printed before halting is written even though halt calls exit
+    Expects:
+        called once, before any machine prints
+    ***************************************************************************
+*/
+bool writer_start(int fd);
+
+/*
+    writer_running
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        true between writer_start and writer_stop
+    ***************************************************************************
+*/
+bool writer_running(void);
+
+/*
+    writer_space
+    ***************************************************************************
+    Input:
+        uint32_t *bytes: set to the number of bytes that may be written
+    Returns:
+        the free part of the ring just after the bytes committed so far,
+        at least 1 byte long and not wrapping around its end
+    Effects:
+        Waits for the writer thread to free some space if the ring is full,
+        so a program printing faster than fd takes its output is held back
+        rather than the ring growing
+    Expects:
+        the writer is running; called only by the thread running the
+        machine
+    ***************************************************************************
+*/
+uint8_t *writer_space(uint32_t *bytes);
+
+/*
+    writer_commit
+    ***************************************************************************
+    Input:
+        uint32_t bytes: bytes filled in at the start of the last space
+    Returns:
+        none
+    Effects:
+        Hands the bytes to the writer thread, waking it if it is idle
+    Expects:
+        bytes is no more than writer_space last gave
+    ***************************************************************************
+*/
+void writer_commit(uint32_t bytes);
+
+/*
+    writer_drain
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Waits until everything committed has been written (or dropped
+        because fd would not take it); does nothing if the writer is not
+        running
+    ***************************************************************************
+*/
+void writer_drain(void);
+
+/*
+    writer_stop
+    ***************************************************************************
+    Input:
+        none
+    Returns:
+        none
+    Effects:
+        Lets the writer thread write everything committed, then joins it
+        and frees the ring; does nothing if the writer is not running
+    ***************************************************************************
+*/
+void writer_stop(void);
+
+/*
+    writer_report
+    ***************************************************************************
+    Input:
+        FILE *fp: stream to print to
+    Returns:
+        none
+    Effects:
+        Waits for the ring to drain, then prints how many bytes the writer
+        thread wrote in how many writev calls, and how many times the
+        machine had to wait for room in the ring
+    ***************************************************************************
+*/
+void writer_report(FILE *fp);
+
+#endif